@@ -1,13 +1,14 @@
+#include <iostream>
 #include <string>
 #include <memory>
 #include <vector>
-#include <iostream>
 #include <unordered_map>
 #include <bsoncxx/json.hpp>
 #include <bsoncxx/builder/stream/document.hpp>
 #include <mongocxx/client.hpp>
 #include <mongocxx/instance.hpp>
 #include <mongocxx/uri.hpp>
+#include "../common/async_logger.hpp"
 
 // NodeType: Define the type of node (Operator or Operand)
 enum class NodeType {
@@ -60,7 +61,7 @@ public:
         collection.insert_one(
             bsoncxx::builder::stream::document{} << "rule_name" << rule_name << "ast" << doc << bsoncxx::builder::stream::finalize
         );
-        std::cout << "Rule saved successfully!" << std::endl;
+        LOG_INFO("Rule {} saved successfully!", rule_name);
     }
 
     // Retrieve a rule AST from MongoDB
@@ -73,7 +74,7 @@ public:
         if (doc) {
             return parseBSON(doc->view()["ast"].get_document().view());
         } else {
-            std::cerr << "Rule not found!" << std::endl;
+            LOG_ERROR("Rule {} not found!", rule_name);
             return nullptr;
         }
     }
@@ -165,6 +166,7 @@ int main() {
     if (loadedRule) {
         std::unordered_map<std::string, int> data = {{"age", 35}, {"salary", 60000}};
         bool result = evaluateAST(loadedRule, data);
+        AsyncLogger::instance().flush(); // Results go to stdout, after the log lines before them
         std::cout << "Evaluation result: " << (result ? "True" : "False") << std::endl;
     }
 
@@ -179,6 +181,7 @@ int main() {
     if (loadedCombinedRule) {
         std::unordered_map<std::string, int> data = {{"age", 40}, {"salary", 55000}, {"experience", 6}};
         bool combinedResult = evaluateAST(loadedCombinedRule, data);
+        AsyncLogger::instance().flush();
         std::cout << "Combined rule evaluation result: " << (combinedResult ? "True" : "False") << std::endl;
     }
 
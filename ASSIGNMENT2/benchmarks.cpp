@@ -0,0 +1,1833 @@
+// Benchmarks run by ./weather_data_aggregator --bench <name>.
+
+#include <curl/curl.h>
+#include <nlohmann/json.hpp>
+#include "../common/async_logger.hpp"
+#include "weather/metrics.hpp"
+#include "weather/http_server.hpp"
+#include "weather/observation.hpp"
+#include "weather/latest_store.hpp"
+#include "weather/range_index.hpp"
+#include "weather/query_api.hpp"
+#include "weather/json_stream.hpp"
+#include "weather/fetch.hpp"
+#include "weather/aggregation.hpp"
+#include "weather/metric_aggregator.hpp"
+#include "weather/trend_estimator.hpp"
+#include "weather/dedup.hpp"
+#include "weather/storage_filter.hpp"
+#include "weather/forecast_errors.hpp"
+#include "weather/anomaly_detector.hpp"
+#include "weather/rollups.hpp"
+#include "weather/station_index.hpp"
+#include "weather/columnar_exporter.hpp"
+#include "weather/mongo_handler.hpp"
+#include "weather/history_query.hpp"
+#include "weather/mock_server.hpp"
+#include "weather/hash_ring.hpp"
+#include "weather/poll_planner.hpp"
+#include "weather/ingest_worker.hpp"
+#include "weather/checkpoint.hpp"
+#include "weather/benchmarks.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Benchmark: cost of stage instrumentation with metrics enabled and disabled
+int benchMetricsOverhead() {
+    const int iterations = 200000;
+    std::string payload = makeSamplePayload("Delhi", 300.15, 1700000000);
+    auto run = [&](bool enabled) {
+        PipelineMetrics::setEnabled(enabled);
+        double sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            nlohmann::json data;
+            {
+                ScopedStageTimer timer(PipelineMetrics::Parse);
+                data = nlohmann::json::parse(payload);
+            }
+            {
+                ScopedStageTimer timer(PipelineMetrics::Aggregate);
+                sink += data["main"]["temp"].get<double>() - 273.15;
+            }
+            PipelineMetrics::add(PipelineMetrics::BytesReceived, payload.size());
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (sink == 0) std::cout << "";
+        return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    };
+
+    run(true); // warm-up
+    double offNs = run(false);
+    double onNs = run(true);
+    std::cout << "parse+aggregate per observation: metrics off " << offNs << " ns, on " << onNs << " ns ("
+              << (onNs - offNs) / offNs * 100 << "% overhead)" << std::endl;
+
+    const int timerIterations = 10000000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < timerIterations; ++i) {
+        ScopedStageTimer timer(PipelineMetrics::AlertCheck);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "empty ScopedStageTimer: " << std::chrono::duration<double, std::nano>(elapsed).count() / timerIterations
+              << " ns/scope" << std::endl;
+    return 0;
+}
+
+// Benchmark: total ingest rate against the mock API as sharded workers scale from 1 to 8
+int benchShardedIngest() {
+    const int cityCount = 2000;
+    const auto duration = std::chrono::seconds(2);
+    MockWeatherServer mock(0, 16);
+    if (!mock.start()) {
+        std::cerr << "Could not start mock server" << std::endl;
+        return 1;
+    }
+    WeatherDataFetcher::apiBaseUrl() = mock.baseUrl();
+    std::vector<std::string> cities;
+    for (int i = 0; i < cityCount; ++i) cities.push_back("City" + std::to_string(i));
+
+    for (int workers = 1; workers <= 8; ++workers) {
+        ConsistentHashRing ring;
+        for (int id = 0; id < workers; ++id) ring.addWorker(id);
+        auto assignment = ring.assign(cities);
+
+        std::vector<std::pair<pid_t, int>> children;
+        for (int id = 0; id < workers; ++id) {
+            int fds[2];
+            if (pipe(fds) != 0) return 1;
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                IngestWorker worker(nullptr, "mock", 1000.0);
+                worker.setCities(assignment[id], "");
+                auto deadline = std::chrono::steady_clock::now() + duration;
+                while (std::chrono::steady_clock::now() < deadline) worker.runCycle();
+                uint64_t fetched = worker.observationsFetched();
+                ssize_t written = write(fds[1], &fetched, sizeof(fetched));
+                _exit(written == sizeof(fetched) ? 0 : 1);
+            }
+            close(fds[1]);
+            children.emplace_back(pid, fds[0]);
+        }
+
+        uint64_t total = 0;
+        for (const auto& child : children) {
+            uint64_t fetched = 0;
+            if (read(child.second, &fetched, sizeof(fetched)) == sizeof(fetched)) total += fetched;
+            close(child.second);
+            waitpid(child.first, nullptr, 0);
+        }
+        std::cout << workers << " worker(s): " << total / std::chrono::duration<double>(duration).count()
+                  << " observations/s" << std::endl;
+    }
+
+    // Fraction of cities that change owner when a worker joins, against the ideal 1/N.
+    for (int workers = 2; workers <= 8; ++workers) {
+        ConsistentHashRing before, after;
+        for (int id = 0; id < workers - 1; ++id) before.addWorker(id);
+        for (int id = 0; id < workers; ++id) after.addWorker(id);
+        int moved = 0;
+        for (const auto& city : cities) moved += before.ownerOf(city) != after.ownerOf(city);
+        std::cout << "join " << workers - 1 << " -> " << workers << ": moved " << 100.0 * moved / cityCount
+                  << "% of cities (ideal " << 100.0 / workers << "%)" << std::endl;
+    }
+    return 0;
+}
+
+// Benchmark: anomaly detector updates per second and memory for 100k cities
+int benchAnomalyDetector() {
+    const uint32_t cityCount = 100000;
+    const int rounds = 50;
+    AnomalyDetector detector;
+    detector.reserve(cityCount);
+    std::vector<float> baseTemps(cityCount);
+    for (uint32_t c = 0; c < cityCount; ++c) baseTemps[c] = -10.0f + static_cast<float>(c % 45);
+
+    uint64_t anomalies = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        int hour = round % AnomalyDetector::kHours;
+        for (uint32_t c = 0; c < cityCount; ++c) {
+            float temp = baseTemps[c] + static_cast<float>((c * 7 + round * 13) % 5) - 2.0f;
+            anomalies += detector.isAnomalous(detector.update(c, temp, hour));
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "updates/s: " << cityCount * static_cast<double>(rounds) / seconds << "\n"
+              << "state for " << cityCount << " cities: " << detector.memoryBytes() / (1024.0 * 1024.0) << " MiB ("
+              << detector.memoryBytes() / cityCount << " bytes/city)\n"
+              << "anomalies flagged: " << anomalies << std::endl;
+    return 0;
+}
+
+// Benchmark: batched /latest queries per second and latency while a writer ingests at full speed
+int benchQueryApi() {
+    const uint32_t cityCount = 10000;
+    const int batchSize = 20;
+    const int readers = 4;
+    const auto duration = std::chrono::seconds(3);
+    LatestObservationStore store(cityCount);
+    std::vector<std::string> cities;
+    for (uint32_t c = 0; c < cityCount; ++c) cities.push_back("City" + std::to_string(c));
+
+    Observation obs;
+    std::strcpy(obs.condition, "Clear");
+    for (const auto& city : cities) store.publish(city, obs);
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> writes{0};
+    std::thread writer([&] {
+        Observation next = obs;
+        uint64_t n = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            next.dt = 1700000000 + static_cast<int64_t>(n / cityCount) * 60;
+            next.tempC = 20.0 + static_cast<double>(n % 17);
+            store.publish(cities[n % cityCount], next);
+            ++n;
+        }
+        writes = n;
+    });
+
+    // In-process reads first, then the same batches over HTTP with keep-alive connections.
+    LatencyHistogram directLatency;
+    std::string body;
+    std::vector<std::string> batch(batchSize);
+    auto directDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    for (uint64_t q = 0; std::chrono::steady_clock::now() < directDeadline; ++q) {
+        for (int i = 0; i < batchSize; ++i) batch[i] = cities[(q * 7919 + i * 104729) % cityCount];
+        body.clear();
+        auto start = std::chrono::steady_clock::now();
+        store.appendBatchJson(batch, body);
+        directLatency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    QueryApi api(store, 0, readers);
+    api.start();
+    std::vector<LatencyHistogram> httpLatency(readers);
+    std::vector<std::thread> clients;
+    auto deadline = std::chrono::steady_clock::now() + duration;
+    for (int r = 0; r < readers; ++r) {
+        clients.emplace_back([&, r] {
+            CURL* curl = curl_easy_init();
+            std::string response;
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, +[](void* contents, size_t size, size_t nmemb, void* userp) {
+                static_cast<std::string*>(userp)->append(static_cast<char*>(contents), size * nmemb);
+                return size * nmemb;
+            });
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+            for (uint64_t q = r; std::chrono::steady_clock::now() < deadline; q += readers) {
+                std::string url = "http://127.0.0.1:" + std::to_string(api.port()) + "/latest?cities=";
+                for (int i = 0; i < batchSize; ++i) url += (i ? "," : "") + cities[(q * 7919 + i * 104729) % cityCount];
+                response.clear();
+                curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+                auto start = std::chrono::steady_clock::now();
+                if (curl_easy_perform(curl) != CURLE_OK) break;
+                httpLatency[r].record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            }
+            curl_easy_cleanup(curl);
+        });
+    }
+    for (auto& client : clients) client.join();
+    stop = true;
+    writer.join();
+
+    LatencyHistogram http;
+    for (const auto& hist : httpLatency) hist.mergeInto(http);
+    double seconds = std::chrono::duration<double>(duration).count();
+    std::cout << "direct: " << directLatency.count() << " batches/s of " << batchSize << " cities, p50 "
+              << directLatency.percentile(0.5) / 1000.0 << " us, p99 " << directLatency.percentile(0.99) / 1000.0 << " us\n"
+              << "http:   " << http.count() / seconds << " batches/s, p50 " << http.percentile(0.5) / 1000.0
+              << " us, p99 " << http.percentile(0.99) / 1000.0 << " us\n"
+              << "writer: " << writes / (seconds + 1) << " publishes/s during the run" << std::endl;
+    return 0;
+}
+
+// Benchmark: rollup update cost per closed day, late-correction cost and year-range query latency
+int benchRollups() {
+    const int cityCount = 200;
+    const int64_t firstDay = daysFromCivil(2023, 1, 1);
+    const int dayCount = 730;
+    RollupStore store;
+    std::vector<std::string> cities;
+    for (int c = 0; c < cityCount; ++c) {
+        cities.push_back("City" + std::to_string(c));
+        store.setRegion(cities.back(), "Region" + std::to_string(c % 10));
+    }
+    static const char* conditions[] = {"Clear", "Clouds", "Rain", "Haze"};
+    auto dayStats = [&](int c, int64_t day, double shift) {
+        RollupStats stats;
+        for (int i = 0; i < 24; ++i) {
+            double temp = 15 + 12 * std::sin((day % 365) / 58.0) + 5 * std::sin(i / 3.8) + (c % 13) + shift;
+            stats.add(temp, conditions[(day + i + c) % 4]);
+        }
+        return stats;
+    };
+
+    std::vector<RollupStats> prepared;
+    prepared.reserve(static_cast<size_t>(cityCount) * dayCount);
+    for (int64_t d = 0; d < dayCount; ++d) {
+        for (int c = 0; c < cityCount; ++c) prepared.push_back(dayStats(c, firstDay + d, 0));
+    }
+    auto start = std::chrono::steady_clock::now();
+    size_t n = 0;
+    for (int64_t d = 0; d < dayCount; ++d) {
+        for (int c = 0; c < cityCount; ++c) store.addDay(cities[c], firstDay + d, prepared[n++]);
+    }
+    double addNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+    store.takeDirty();
+
+    const int corrections = 20000;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < corrections; ++i) {
+        int c = (i * 7919) % cityCount;
+        int64_t day = firstDay + (i * 104729) % dayCount;
+        store.correctDay(cities[c], day, dayStats(c, day, (i % 2) ? 8.0 : -8.0));
+    }
+    double correctNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / corrections;
+
+    // A late reading is merged into its day: the stored day keeps its readings plus the late one.
+    RollupStats late;
+    late.add(20.0, "Clear");
+    uint64_t before = store.query(RollupStore::cityScope(cities[0]), firstDay + 3, firstDay + 3).count;
+    uint64_t after = store.mergeIntoDay(cities[0], firstDay + 3, late).count;
+
+    // Year-range queries: one aligned year, and an unaligned 365-day range.
+    const int queries = 20000;
+    LatencyHistogram aligned, unaligned;
+    double sink = 0;
+    for (int i = 0; i < queries; ++i) {
+        const std::string scope = i % 2 ? RollupStore::cityScope(cities[i % cityCount]) : RollupStore::regionScope("Region" + std::to_string(i % 10));
+        auto t0 = std::chrono::steady_clock::now();
+        sink += store.query(scope, daysFromCivil(2023, 1, 1), daysFromCivil(2023, 12, 31)).average();
+        auto t1 = std::chrono::steady_clock::now();
+        int64_t from = firstDay + 17 + i % 300;
+        sink += store.query(scope, from, from + 364).average();
+        auto t2 = std::chrono::steady_clock::now();
+        aligned.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        unaligned.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+    }
+    std::cout << "addDay: " << addNs / 1000.0 << " us per closed city-day (updates 6 rollups)\n"
+              << "correctDay: " << correctNs / 1000.0 << " us per late correction\n"
+              << "late reading: day count " << before << " -> " << after << (after == before + 1 ? " (ok)" : " (WRONG)") << "\n"
+              << "calendar-year query: p50 " << aligned.percentile(0.5) / 1000.0 << " us, p99 " << aligned.percentile(0.99) / 1000.0 << " us\n"
+              << "unaligned 365-day query: p50 " << unaligned.percentile(0.5) / 1000.0 << " us, p99 "
+              << unaligned.percentile(0.99) / 1000.0 << " us" << (sink == 0 ? " " : "") << std::endl;
+    return 0;
+}
+
+// Benchmark: radius queries per second over 100k stations and incremental updates
+int benchStationIndex() {
+    const uint32_t stationCount = 100000;
+    StationIndex index;
+    uint64_t seed = 42;
+    auto next = [&seed] {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return static_cast<double>(seed % 1000000) / 1000000.0;
+    };
+    // Stations are clustered on land-like bands rather than spread uniformly over oceans.
+    std::vector<std::pair<double, double>> coords;
+    for (uint32_t i = 0; i < stationCount; ++i) {
+        double lat = -40 + next() * 100, lon = -180 + next() * 360;
+        coords.emplace_back(lat, lon);
+        uint32_t id = index.upsertStation("S" + std::to_string(i), lat, lon);
+        index.setRegion(id, "R" + std::to_string(i % 50));
+        index.updateTemp(id, 10 + next() * 25);
+    }
+
+    const int updates = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < updates; ++i) index.updateTemp(static_cast<uint32_t>(i % stationCount), 10 + (i % 250) * 0.1);
+    double updateNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / updates;
+
+    const int queries = 20000;
+    uint64_t matched = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+        const auto& c = coords[(i * 7919) % stationCount];
+        matched += index.radiusAggregate(c.first, c.second, 50).count;
+    }
+    double radiusSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) index.nearest(-40 + next() * 100, -180 + next() * 360);
+    double nearestSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double regionSink = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; ++i) regionSink += index.regionAggregate("R" + std::to_string(i % 50)).max;
+    double regionSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "temperature updates: " << 1000.0 / updateNs << " M/s\n"
+              << "50 km radius aggregates: " << queries / radiusSeconds << " queries/s (avg "
+              << static_cast<double>(matched) / queries << " stations matched)\n"
+              << "nearest station: " << queries / nearestSeconds << " queries/s\n"
+              << "region summary (2000 stations): " << 1000 / regionSeconds << " queries/s" << (regionSink == 0 ? " " : "") << std::endl;
+    return 0;
+}
+
+// Benchmark: leaderboard update cost at 100k cities, and lock-free reads during 10k updates/s
+int benchLeaderboard() {
+    const uint32_t cityCount = 100000;
+    TemperatureLeaderboard board(cityCount);
+    std::vector<std::string> names;
+    for (uint32_t c = 0; c < cityCount; ++c) names.push_back("City" + std::to_string(c));
+    uint64_t seed = 7;
+    auto nextTemp = [&seed] {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return -30.0 + static_cast<double>(seed >> 40) / (1 << 24) * 75.0;
+    };
+    for (uint32_t c = 0; c < cityCount; ++c) board.update(c, names[c], nextTemp());
+
+    // Raw update cost.
+    const int updates = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < updates; ++i) {
+        uint32_t c = static_cast<uint32_t>((i * 2654435761ULL) % cityCount);
+        board.update(c, names[c], nextTemp());
+    }
+    double updateNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / updates;
+
+    // Paced writer at 10k updates/s while a reader polls top-20 lists and ranks.
+    std::atomic<bool> stop{false};
+    std::thread writer([&] {
+        auto next = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+            uint32_t c = static_cast<uint32_t>((i * 2654435761ULL) % cityCount);
+            board.update(c, names[c], nextTemp());
+            if (i % 100 == 99) {
+                next += std::chrono::milliseconds(10);
+                std::this_thread::sleep_until(next);
+            }
+        }
+    });
+    LatencyHistogram topLatency, rankLatency;
+    uint64_t sink = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    for (uint32_t i = 0; std::chrono::steady_clock::now() < deadline; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        sink += board.top(20, i % 2 == 0).size();
+        auto t1 = std::chrono::steady_clock::now();
+        sink += board.rankOfCity(i % cityCount);
+        auto t2 = std::chrono::steady_clock::now();
+        topLatency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        rankLatency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+    }
+    stop = true;
+    writer.join();
+
+    auto hottest = board.top(3, true);
+    std::cout << "update: " << updateNs << " ns/observation at " << cityCount << " cities\n"
+              << "top-20 read: " << topLatency.count() / 2.0 << " reads/s, p50 " << topLatency.percentile(0.5)
+              << " ns, p99 " << topLatency.percentile(0.99) << " ns\n"
+              << "rank query: p50 " << rankLatency.percentile(0.5) << " ns, p99 " << rankLatency.percentile(0.99) << " ns\n"
+              << "hottest: " << hottest[0].name << " " << hottest[0].centiDegrees / 100.0 << " °C"
+              << (sink == 0 ? " " : "") << std::endl;
+    return 0;
+}
+
+// Benchmark: checkpoint pause and restart-to-ready time for 100k cities
+int benchCheckpoint() {
+    const int cityCount = 100000;
+    const int observationsPerCity = 4;
+    const std::string path = "bench_checkpoint.bin";
+    IngestWorker worker(nullptr, "mock", 1000.0);
+    std::vector<std::string> cities;
+    for (int c = 0; c < cityCount; ++c) cities.push_back("City" + std::to_string(c));
+    worker.setCities(cities, "");
+    // Readings from today, since a restore keeps only the current day's observations
+    const int64_t midnight = static_cast<int64_t>(std::time(nullptr)) / 86400 * 86400;
+    for (int i = 0; i < observationsPerCity; ++i) {
+        for (int c = 0; c < cityCount; ++c) {
+            worker.ingest(cities[c], nlohmann::json::parse(makeSamplePayload(cities[c], 280.0 + c % 30 + i, midnight + i * 600)));
+        }
+    }
+
+    CheckpointManager checkpoints(path);
+    auto start = std::chrono::steady_clock::now();
+    checkpoints.checkpoint(worker);
+    bool written = checkpoints.wait();
+    double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    struct stat info {};
+    stat(path.c_str(), &info);
+
+    start = std::chrono::steady_clock::now();
+    IngestWorker restoredWorker(nullptr, "mock", 1000.0);
+    bool restored = checkpoints.restore(restoredWorker);
+    restoredWorker.setCities(cities, "");
+    double restoreMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::remove(path.c_str());
+
+    std::cout << "checkpoint pause (fork): " << std::chrono::duration<double, std::milli>(checkpoints.lastPauseTime()).count()
+              << " ms; background write finished after " << totalMs << " ms (" << (written ? "ok" : "failed") << ")\n"
+              << "file size: " << info.st_size / (1024.0 * 1024.0) << " MiB for " << cityCount << " cities x "
+              << observationsPerCity << " observations\n"
+              << "restart-to-ready (load + ownership): " << restoreMs << " ms (" << (restored ? "ok" : "failed")
+              << "), before the rawData replay" << std::endl;
+    return 0;
+}
+
+// Benchmark: writes saved and summary correctness with dedup under repeated polling
+int benchDedup() {
+    const int cityCount = 2000;
+    const int polls = 65;       // one poll a minute
+    const int updateEvery = 10; // upstream publishes a new reading every 10 minutes
+    IngestWorker worker(nullptr, "mock", 1000.0);
+    std::vector<std::string> cities;
+    for (int c = 0; c < cityCount; ++c) cities.push_back("City" + std::to_string(c));
+    worker.setCities(cities, "");
+
+    size_t offered = 0, written = 0;
+    double uniqueSum = 0, naiveSum = 0;
+    std::vector<nlohmann::json> rawData;
+    auto start = std::chrono::steady_clock::now();
+    for (int poll = 0; poll < polls; ++poll) {
+        int64_t dt = 1700000000 + (poll / updateEvery) * 600;
+        for (int c = 0; c < cityCount; ++c) {
+            double tempK = 280.0 + c % 25 + (dt - 1700000000) / 600 * 0.5; // warming through the hour
+            auto data = nlohmann::json::parse(makeSamplePayload(cities[c], tempK, dt));
+            naiveSum += tempK - 273.15;
+            ++offered;
+            if (poll % updateEvery == 0) uniqueSum += tempK - 273.15;
+            if (worker.offer(cities[c], data)) {
+                ++written;
+                rawData.push_back(std::move(data));
+            }
+        }
+    }
+    double pollSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t replayed = worker.replay(rawData); // a replay of everything already stored must add nothing
+
+    size_t uniqueCount = static_cast<size_t>(cityCount) * ((polls + updateEvery - 1) / updateEvery);
+    auto summary = worker.summarize();
+    std::cout << "offered " << offered << " polled readings, wrote " << written << " (" << uniqueCount << " unique); "
+              << 100.0 * (offered - written) / offered << "% of writes avoided\n"
+              << "average temp: " << summary.averageTemp << " C with dedup, " << uniqueSum / uniqueCount
+              << " C expected, " << naiveSum / offered << " C without\n"
+              << "full replay re-ingested " << replayed << " readings; " << offered / pollSeconds
+              << " readings/s through offer()" << std::endl;
+
+    ObservationDeduplicator deduplicator;
+    const int checks = 2000000;
+    std::vector<uint32_t> ids(checks);
+    uint64_t seed = 7;
+    for (auto& id : ids) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        id = static_cast<uint32_t>(seed % 100000);
+    }
+    start = std::chrono::steady_clock::now();
+    size_t accepted = 0;
+    for (int i = 0; i < checks; ++i) accepted += deduplicator.accept(ids[i], 1700000000 + (i / 100000) * 600 - (i % 7 == 0) * 1200);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / checks;
+    std::cout << "accept(): " << ns << " ns per check at 100k cities (" << accepted << " accepted), "
+              << deduplicator.memoryBytes() / (1024.0 * 1024.0) << " MiB" << std::endl;
+    return 0;
+}
+
+// Benchmark: rawData reduction and reconstruction error of the storage filter on a replayed day
+int benchCompression() {
+    const int cityCount = 200;
+    const int readings = 1440; // one reading a minute for a day
+    std::vector<std::vector<nlohmann::json>> trace(cityCount);
+    uint64_t seed = 11;
+    auto noise = [&seed] {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return static_cast<double>(seed % 1000) / 1000.0 - 0.5;
+    };
+    for (int c = 0; c < cityCount; ++c) {
+        for (int i = 0; i < readings; ++i) {
+            double diurnal = 6.0 * std::sin(2 * M_PI * (i + c * 7) / readings);
+            double front = i > 900 + c ? -3.0 : 0.0; // a cold front passing through
+            double tempK = 295.0 + c % 10 + diurnal + front + 0.04 * noise();
+            auto data = nlohmann::json::parse(makeSamplePayload("City" + std::to_string(c), tempK, 1700000000 + i * 60));
+            data["main"]["humidity"] = 50 + static_cast<int>(10 * std::cos(2 * M_PI * i / readings));
+            trace[c].push_back(std::move(data));
+        }
+    }
+
+    std::cout << "mode          tol(C)  stored   reduction  max err(C)  rms err(C)  max err(%RH)\n";
+    for (StorageFilter::Mode mode : {StorageFilter::Deadband, StorageFilter::SwingingDoor}) {
+        for (double tolerance : {0.05, 0.1, 0.25, 0.5}) {
+            StorageFilter::Config config;
+            config.mode = mode;
+            config.tolerance = {tolerance, 1.0};
+            StorageFilter filter(config);
+            size_t stored = 0;
+            double maxError = 0, sumSquares = 0, maxHumidityError = 0;
+            for (int c = 0; c < cityCount; ++c) {
+                std::vector<nlohmann::json> kept;
+                for (const auto& data : trace[c]) filter.offer(c, Observation::fromJson(data), data, kept);
+                filter.flushCity(c, kept);
+                stored += kept.size();
+                // Reconstruct every original reading from the kept ones
+                size_t next = 0;
+                for (const auto& data : trace[c]) {
+                    Observation obs = Observation::fromJson(data);
+                    while (next + 1 < kept.size() && kept[next + 1]["dt"].get<int64_t>() <= obs.dt) ++next;
+                    Observation a = Observation::fromJson(kept[next]);
+                    double temp = a.tempC, humidity = a.humidity;
+                    if (mode == StorageFilter::SwingingDoor && next + 1 < kept.size()) {
+                        Observation b = Observation::fromJson(kept[next + 1]);
+                        double f = static_cast<double>(obs.dt - a.dt) / static_cast<double>(b.dt - a.dt);
+                        temp = a.tempC + f * (b.tempC - a.tempC);
+                        humidity = a.humidity + f * (b.humidity - a.humidity);
+                    }
+                    maxError = std::max(maxError, std::fabs(temp - obs.tempC));
+                    maxHumidityError = std::max(maxHumidityError, std::fabs(humidity - obs.humidity));
+                    sumSquares += (temp - obs.tempC) * (temp - obs.tempC);
+                }
+            }
+            size_t total = static_cast<size_t>(cityCount) * readings;
+            std::printf("%-13s %6.2f  %7zu  %8.1fx  %10.3f  %10.3f  %12.2f\n",
+                        mode == StorageFilter::Deadband ? "deadband" : "swinging-door", tolerance, stored,
+                        static_cast<double>(total) / stored, maxError, std::sqrt(sumSquares / total), maxHumidityError);
+        }
+    }
+    return 0;
+}
+
+// Benchmark: summary kernel throughput, AVX2 against scalar and against the JSON path
+int benchKernels() {
+    const size_t n = 10000000;
+    const size_t cityCount = 100000;
+    ObservationBatch batch;
+    std::vector<int32_t> centiKelvin(n);
+    uint64_t seed = 5;
+    static const char* conditions[] = {"Clear", "Clouds", "Rain", "Haze"};
+    for (size_t i = 0; i < n; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        double kelvin = 273.15 + static_cast<double>(seed % 4500) / 100.0;
+        batch.add(kelvin, conditions[seed % 4]);
+        centiKelvin[i] = static_cast<int32_t>(std::lround(kelvin * 100));
+        if ((i + 1) % (n / cityCount) == 0) batch.endCity();
+    }
+    std::vector<float> celsius(n);
+    std::vector<SummaryKernels::Moments> perCity(cityCount);
+    WeatherAggregator aggregator;
+    PipelineMetrics::setEnabled(false);
+
+    auto rate = [](size_t count, std::chrono::steady_clock::time_point start) {
+        return count / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+    };
+    const int rounds = 10;
+    for (bool scalar : {true, false}) {
+        SummaryKernels::setForceScalar(scalar);
+        if (!scalar && !SummaryKernels::avx2Available()) {
+            std::cout << "AVX2 not available on this CPU\n";
+            break;
+        }
+        double sink = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) SummaryKernels::kelvinToCelsius(batch.tempKelvin.data(), celsius.data(), n);
+        double convert = rate(n * rounds, start);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) sink += SummaryKernels::reduce(batch.tempKelvin.data(), n, -273.15).m2;
+        double reduceFloat = rate(n * rounds, start);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) sink += SummaryKernels::reduceFixed(centiKelvin.data(), n, -273.15).m2;
+        double reduceFixed = rate(n * rounds, start);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            SummaryKernels::reduceSegments(batch.tempKelvin.data(), batch.cityOffsets.data(), cityCount, perCity.data(), -273.15);
+            sink += perCity[r].m2;
+        }
+        double segmented = rate(n * rounds, start);
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) sink += aggregator.calculateSummary(batch).averageTemp;
+        double summary = rate(n * rounds, start);
+        std::printf("%-7s Mobs/s per core: K->C %.0f, sum/min/max/var float %.0f, fixed-point %.0f, "
+                    "per-city (100 obs) %.0f, full summary with conditions %.0f%s\n",
+                    scalar ? "scalar" : "avx2", convert, reduceFloat, reduceFixed, segmented, summary,
+                    sink == 42 ? " " : "");
+    }
+    SummaryKernels::setForceScalar(false);
+
+    auto avx = SummaryKernels::reduce(batch.tempKelvin.data(), n, -273.15);
+    auto fixed = SummaryKernels::reduceFixed(centiKelvin.data(), n, -273.15);
+    std::printf("float mean %.6f var %.6f, fixed-point mean %.6f var %.6f\n", avx.mean(), avx.variance(), fixed.mean(),
+                fixed.variance());
+
+    const size_t jsonCount = 200000;
+    std::vector<nlohmann::json> documents;
+    for (size_t i = 0; i < jsonCount; ++i) {
+        documents.push_back(nlohmann::json::parse(makeSamplePayload("City", batch.tempKelvin[i], 1700000000 + i)));
+    }
+    auto start = std::chrono::steady_clock::now();
+    double average = aggregator.calculateDailySummary(documents).averageTemp;
+    std::printf("JSON documents through calculateDailySummary: %.2f Mobs/s (avg %.3f C)\n", rate(jsonCount, start), average);
+    PipelineMetrics::setEnabled(true);
+    return 0;
+}
+
+// Benchmark: aggregation scaling from 1 to N threads and bit-for-bit reproducibility
+int benchParallel() {
+    const size_t n = 20000000;
+    ObservationBatch batch;
+    uint64_t seed = 9;
+    static const char* conditions[] = {"Clear", "Clouds", "Rain", "Haze", "Mist"};
+    for (size_t i = 0; i < n; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        batch.add(250.0 + static_cast<double>(seed % 7000) / 100.0, conditions[seed % 5]);
+    }
+    batch.endCity();
+    PipelineMetrics::setEnabled(false);
+
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threadCounts = {1, 2, 4, 8};
+    if (hardware > 8) threadCounts.push_back(hardware);
+    double baseline = 0;
+    PartialSummary reference;
+    bool identical = true;
+    for (unsigned threads : threadCounts) {
+        WeatherAggregator aggregator(threads);
+        PartialSummary result;
+        const int rounds = 5;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) result = aggregator.aggregate(batch);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / rounds;
+        if (threads == 1) {
+            baseline = seconds;
+            reference = result;
+        }
+        bool same = std::memcmp(&result.sum, &reference.sum, sizeof(double)) == 0 &&
+                    std::memcmp(&result.compensation, &reference.compensation, sizeof(double)) == 0 &&
+                    std::memcmp(&result.m2, &reference.m2, sizeof(double)) == 0 &&
+                    result.conditionCounts == reference.conditionCounts;
+        identical = identical && same;
+        std::printf("%2u threads: %7.1f Mobs/s, speedup %.2fx, mean %.12f var %.12f (%s)\n", threads,
+                    n / seconds / 1e6, baseline / seconds, result.mean(), result.variance(),
+                    same ? "bit-identical" : "DIFFERS");
+    }
+    std::cout << "hardware threads: " << hardware << "; results " << (identical ? "identical" : "not identical")
+              << " across thread counts" << std::endl;
+    PipelineMetrics::setEnabled(true);
+    return identical ? 0 : 1;
+}
+
+// Benchmark: per-call cost of logging on the calling thread
+int benchLogging() {
+    std::FILE* devNull = std::fopen("/dev/null", "w");
+    if (!devNull) return 1;
+    AsyncLogger& logger = AsyncLogger::instance();
+    logger.setOutput(devNull, devNull);
+    const int calls = 200000;
+    auto perCall = [](std::chrono::steady_clock::time_point start, int count) {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    };
+
+    // Stay under the ring size per burst so every call is a real enqueue, not a drop
+    double asyncNs = 0;
+    const int burst = static_cast<int>(AsyncLogger::kSlots / 2);
+    for (int done = 0; done < calls; done += burst) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < burst; ++i) {
+            logger.log(AsyncLogger::Warn, "Alert: Unusual temperature for {}: {} °C (z-score {})", "Hyderabad", 41.5 + i, 3.2);
+        }
+        asyncNs += perCall(start, burst) / (calls / burst);
+        logger.flush();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i) LOG_DEBUG("Filtered at compile time {}", i);
+    double filteredNs = perCall(start, calls);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i) LOG_WARN("Rate limited {}", i); // 100 per second pass, the rest are counted
+    double limitedNs = perCall(start, calls);
+    logger.flush();
+
+    std::ofstream stream("/dev/null");
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; ++i) {
+        stream << "Alert: Unusual temperature for " << "Hyderabad" << ": " << 41.5 + i << " °C (z-score " << 3.2 << ")"
+               << std::endl;
+    }
+    double streamNs = perCall(start, calls);
+
+    std::vector<double> threadNs(4);
+    std::vector<std::thread> producers;
+    for (size_t t = 0; t < threadNs.size(); ++t) {
+        producers.emplace_back([&threadNs, &logger, t] {
+            auto begin = std::chrono::steady_clock::now();
+            for (int i = 0; i < 1000; ++i) logger.log(AsyncLogger::Info, "producer {} record {}", t, i);
+            threadNs[t] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / 1000;
+        });
+    }
+    for (auto& producer : producers) producer.join();
+    logger.flush();
+    logger.setOutput(stdout, stderr);
+    std::fclose(devNull);
+
+    std::printf("async log call: %.0f ns; compiled-out debug: %.2f ns; rate-limited: %.0f ns; "
+                "std::endl to /dev/null: %.0f ns\n", asyncNs, filteredNs, limitedNs, streamNs);
+    std::printf("4 concurrent producers: %.0f / %.0f / %.0f / %.0f ns per call; %llu records dropped\n", threadNs[0],
+                threadNs[1], threadNs[2], threadNs[3], static_cast<unsigned long long>(logger.droppedRecords()));
+    return 0;
+}
+
+// Benchmark: streaming forecast parsing and ingestion against the local mock API
+int benchForecast() {
+    const int payloads = 2000;
+    std::vector<std::string> bodies;
+    for (int c = 0; c < payloads; ++c) bodies.push_back(makeSampleForecast("City" + std::to_string(c), 280.0 + c % 30, 1700000000));
+    size_t bytes = 0;
+    for (const auto& body : bodies) bytes += body.size();
+
+    // Streaming parser fed in 1400-byte chunks, as a socket would deliver them
+    size_t records = 0;
+    double checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& body : bodies) {
+        ForecastStreamParser parser(1700000000, [&](const ForecastRecord& record) { checksum += record.tempC; ++records; });
+        for (size_t offset = 0; offset < body.size(); offset += 1400) parser.feed(body.data() + offset, std::min<size_t>(1400, body.size() - offset));
+        parser.finish();
+    }
+    double streamSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double domChecksum = 0;
+    start = std::chrono::steady_clock::now();
+    for (const auto& body : bodies) {
+        auto doc = nlohmann::json::parse(body);
+        for (const auto& entry : doc["list"]) domChecksum += entry["main"]["temp"].get<double>() - 273.15;
+    }
+    double domSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("parse %zu records (%.1f KB per payload): streaming %.2f M records/s (%.0f MB/s), DOM %.2f M records/s%s\n",
+                records, bytes / 1024.0 / payloads, records / streamSeconds / 1e6, bytes / streamSeconds / 1e6,
+                records / domSeconds / 1e6, std::fabs(checksum - domChecksum) < 1e-3 ? "" : " (MISMATCH)");
+
+    // 2 ms upstream latency; enough mock threads for every scheduler connection
+    MockWeatherServer mock(0, 16);
+    if (!mock.start()) return 1;
+    mock.setLatency(std::chrono::milliseconds(2));
+    WeatherDataFetcher::apiBaseUrl() = mock.baseUrl();
+    std::vector<std::string> cities;
+    for (int c = 0; c < payloads; ++c) cities.push_back("City" + std::to_string(c));
+    size_t fetched = 0;
+    start = std::chrono::steady_clock::now();
+    for (const auto& city : cities) fetched += WeatherDataFetcher::fetchForecast(city, "mock", 0, [](const ForecastRecord&) {});
+    double fetchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("mock forecast cycle, serial:    %d cities in %.2f s (%.0f cities/s, %.0f records/s)\n", payloads,
+                fetchSeconds, payloads / fetchSeconds, fetched / fetchSeconds);
+    IngestWorker worker(nullptr, "mock", 1000.0);
+    worker.setCities(cities, "");
+    start = std::chrono::steady_clock::now();
+    fetched = worker.runForecastCycle();
+    fetchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("mock forecast cycle, scheduler: %d cities in %.2f s (%.0f cities/s, %.0f records/s, %zu failed)\n",
+                payloads, fetchSeconds, payloads / fetchSeconds, fetched / fetchSeconds, worker.lastForecastCycleStats().failed);
+
+    // Score five days of 40-entry runs against observations with growing error
+    ForecastErrorTracker tracker;
+    const int cityCount = 2000;
+    int64_t t0 = 1700000000 - 1700000000 % ForecastErrorTracker::kLeadStep;
+    for (int run = 0; run < 40; ++run) {
+        int64_t runTime = t0 + run * ForecastErrorTracker::kLeadStep;
+        for (int c = 0; c < cityCount; ++c) {
+            for (int i = 0; i < 40; ++i) {
+                ForecastRecord record;
+                record.runTime = runTime;
+                record.targetTime = runTime + (i + 1) * ForecastErrorTracker::kLeadStep;
+                record.tempC = 20.0 + ((c * 31 + i * 17 + run) % 21 - 10) * 0.05 * (i + 1) / 8.0; // spread grows with lead
+                tracker.addForecast(c, record);
+            }
+        }
+    }
+    size_t observations = 0;
+    start = std::chrono::steady_clock::now();
+    for (int64_t dt = t0; dt <= t0 + 80 * ForecastErrorTracker::kLeadStep; dt += 600) {
+        for (int c = 0; c < cityCount; ++c) {
+            tracker.onObservation(c, dt, 20.0);
+            ++observations;
+        }
+    }
+    double scoreNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / observations;
+    std::printf("error tracking: %.0f ns per observation, %zu forecasts still pending\n", scoreNs, tracker.pendingForecasts());
+    for (int bucket : {0, 7, 15, 23, 31, 39}) {
+        const auto& stats = tracker.leadBucket(bucket);
+        std::printf("  lead %3d h: %8llu scored, MAE %.3f C, RMSE %.3f C, bias %+.3f C\n",
+                    (bucket + 1) * 3, static_cast<unsigned long long>(stats.count), stats.mae(), stats.rmse(), stats.bias());
+    }
+    return 0;
+}
+
+#ifdef WEATHER_COUNT_ALLOCS
+// Allocation counting for the allocations benchmark (build with -DWEATHER_COUNT_ALLOCS): every
+// operator new on the calling thread, plus libcurl's own mallocs via curl_global_init_mem.
+thread_local uint64_t threadAllocations = 0;
+thread_local uint64_t curlAllocations = 0; // Subset of threadAllocations made inside libcurl
+
+void* operator new(size_t size) {
+    ++threadAllocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+// GCC pairs the inlined free() with the allocating new-expression and warns; both go through malloc here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+static void* countingMalloc(size_t size) { ++threadAllocations; ++curlAllocations; return std::malloc(size); }
+static void countingFree(void* p) { std::free(p); }
+static void* countingRealloc(void* p, size_t size) { ++threadAllocations; ++curlAllocations; return std::realloc(p, size); }
+static char* countingStrdup(const char* text) { ++threadAllocations; ++curlAllocations; return strdup(text); }
+static void* countingCalloc(size_t count, size_t size) { ++threadAllocations; ++curlAllocations; return std::calloc(count, size); }
+#endif
+
+// Benchmark: heap allocations and latency per request on the fetch path after warm-up
+int benchAllocations() {
+#ifndef WEATHER_COUNT_ALLOCS
+    std::cout << "Rebuild with -DWEATHER_COUNT_ALLOCS to count allocations" << std::endl;
+    return 1;
+#else
+    curl_global_init_mem(CURL_GLOBAL_DEFAULT, countingMalloc, countingFree, countingRealloc, countingStrdup, countingCalloc);
+    MockWeatherServer mock(0, 2);
+    if (!mock.start()) return 1;
+    WeatherDataFetcher::apiBaseUrl() = mock.baseUrl();
+    std::vector<std::string> cities;
+    for (int c = 0; c < 100; ++c) cities.push_back("City" + std::to_string(c));
+    const std::string apiKey = "mock";
+    const int requests = 5000;
+
+    auto measure = [&](const char* label, const std::function<void(const std::string&)>& fetch) {
+        for (int i = 0; i < 200; ++i) fetch(cities[i % cities.size()]); // Warm-up
+        uint64_t before = threadAllocations, curlBefore = curlAllocations;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < requests; ++i) fetch(cities[i % cities.size()]);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / requests;
+        std::printf("%-34s %8.2f allocations/request (%.2f in libcurl), %6.1f us/request\n", label,
+                    static_cast<double>(threadAllocations - before) / requests,
+                    static_cast<double>(curlAllocations - curlBefore) / requests, us);
+    };
+
+    // The fetch path as it was: fresh handle, growing buffer, URL string and DOM per request
+    measure("fresh handle + buffer + DOM", [&](const std::string& city) {
+        CURL* curl = curl_easy_init();
+        std::string readBuffer;
+        std::string url = WeatherDataFetcher::apiBaseUrl() + "/data/2.5/weather?q=" + city + "&appid=" + apiKey;
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, +[](void* contents, size_t size, size_t nmemb, void* userp) {
+            static_cast<std::string*>(userp)->append(static_cast<char*>(contents), size * nmemb);
+            return size * nmemb;
+        });
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+        curl_easy_perform(curl);
+        curl_easy_cleanup(curl);
+        auto doc = nlohmann::json::parse(readBuffer);
+    });
+    measure("pooled handle + buffer, DOM", [&](const std::string& city) {
+        auto doc = WeatherDataFetcher::fetchWeatherData(city, apiKey);
+    });
+    Observation slot;
+    size_t parsed = 0;
+    measure("pooled, streamed into Observation", [&](const std::string& city) {
+        parsed += WeatherDataFetcher::fetchObservation(city, apiKey, slot);
+    });
+    // One connection, like the paths above; each call fetches all 100 cities
+    FetchScheduler::Config serial;
+    serial.concurrency = 1;
+    FetchScheduler scheduler(serial);
+    size_t cycle = 0;
+    measure("FetchScheduler, streamed", [&](const std::string&) {
+        if (cycle++ % cities.size() == 0) parsed += scheduler.run(cities, apiKey, [](const std::string&, const FetchScheduler::Response&) {}, nullptr).succeeded;
+    });
+    std::printf("%zu observations parsed; last: %s %.2f C %s\n", parsed, "City99", slot.tempC, slot.condition);
+    return 0;
+#endif
+}
+
+// Benchmark: cycle time and yield under injected upstream failures, serial without retries
+// against the FetchScheduler with backoff and circuit breaking
+int benchRetries() {
+    MockWeatherServer mock(0, 16);
+    if (!mock.start()) return 1;
+    mock.setLatency(std::chrono::milliseconds(2));
+    WeatherDataFetcher::apiBaseUrl() = mock.baseUrl();
+    std::vector<std::string> cities;
+    for (int c = 0; c < 400; ++c) cities.push_back("City" + std::to_string(c));
+    const std::string apiKey = "mock";
+
+    std::printf("%-6s %-10s %9s %9s %8s %8s %11s %6s\n", "errors", "path", "cycle s", "cities/s", "fetched", "retries",
+                "fast-failed", "trips");
+    for (double rate : {0.0, 0.05, 0.2, 0.5}) {
+        mock.setFailureRate(rate);
+
+        // The old loop: one blocking request per city, failures dropped until the next cycle
+        size_t ok = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& city : cities) {
+            try {
+                WeatherDataFetcher::fetchWeatherData(city, apiKey);
+                ++ok;
+            } catch (const std::exception&) {
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%5.0f%% %-10s %9.3f %9.0f %7.1f%% %8d %11d %6d\n", rate * 100, "serial", seconds, ok / seconds,
+                    100.0 * ok / cities.size(), 0, 0, 0);
+
+        // With the default breaker, and with it disabled to show what retries alone recover
+        for (bool breaker : {true, false}) {
+            FetchScheduler::Config config;
+            if (!breaker) config.breaker.errorThreshold = 2.0;
+            FetchScheduler scheduler(config);
+            start = std::chrono::steady_clock::now();
+            auto stats = scheduler.run(cities, apiKey, [](const std::string&, const FetchScheduler::Response&) {}, nullptr);
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::printf("%5.0f%% %-10s %9.3f %9.0f %7.1f%% %8zu %11zu %6llu\n", rate * 100, breaker ? "scheduler" : "no breaker",
+                        seconds, stats.succeeded / seconds, 100.0 * stats.succeeded / cities.size(), stats.retries,
+                        stats.fastFailed, static_cast<unsigned long long>(scheduler.circuitBreaker().trips()));
+        }
+    }
+    return 0;
+}
+
+// Benchmark: cycle completion latency against a heavy-tailed upstream, with and without hedging
+int benchHedging() {
+    MockWeatherServer mock(0, 64);
+    if (!mock.start()) return 1;
+    mock.setLatency(std::chrono::milliseconds(1), 1.5); // p50 1.6 ms, p99 22 ms, p99.9 100 ms per request
+    WeatherDataFetcher::apiBaseUrl() = mock.baseUrl();
+    std::vector<std::string> cities;
+    for (int c = 0; c < 40; ++c) cities.push_back("City" + std::to_string(c));
+    const int cycles = 1000;
+
+    struct Variant {
+        const char* label;
+        bool enabled;
+        int delayMs;
+        double budget;
+    };
+    const Variant variants[] = {{"no hedging", false, 0, 0}, {"p95, 5% budget", true, 0, 0.05},
+                                {"p95, 10% budget", true, 0, 0.10}, {"10 ms, 10% budget", true, 10, 0.10}};
+    std::printf("%-18s %9s %9s %9s %10s %10s\n", "hedging", "p50 ms", "p99 ms", "p99.9 ms", "extra load", "hedge wins");
+    for (const auto& variant : variants) {
+        FetchScheduler::Config config;
+        config.hedging.enabled = variant.enabled;
+        config.hedging.delay = std::chrono::milliseconds(variant.delayMs);
+        config.hedging.budget = variant.budget;
+        FetchScheduler scheduler(config);
+        LatencyHistogram cycleLatency;
+        size_t requests = 0, hedges = 0, wins = 0;
+        for (int cycle = 0; cycle < cycles; ++cycle) {
+            auto start = std::chrono::steady_clock::now();
+            auto stats = scheduler.run(cities, "mock", [](const std::string&, const FetchScheduler::Response&) {}, nullptr);
+            cycleLatency.record(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+            requests += stats.succeeded + stats.failed + stats.retries;
+            hedges += stats.hedges;
+            wins += stats.hedgeWins;
+        }
+        std::printf("%-18s %9.1f %9.1f %9.1f %9.1f%% %10zu\n", variant.label, cycleLatency.percentile(0.5) / 1e6,
+                    cycleLatency.percentile(0.99) / 1e6, cycleLatency.percentile(0.999) / 1e6, 100.0 * hedges / requests, wins);
+    }
+    return 0;
+}
+
+// Benchmark: bytes on the wire and client CPU per response with and without gzip transfer
+int benchTransfer() {
+    MockWeatherServer mock(0, 2);
+    if (!mock.start()) return 1;
+    WeatherDataFetcher::apiBaseUrl() = mock.baseUrl();
+    const std::string apiKey = "mock";
+    auto threadCpuNs = [] {
+        timespec ts{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    };
+    auto bytesReceived = [] {
+        PipelineMetrics::Shard totals;
+        PipelineMetrics::collect(totals);
+        return totals.counters[PipelineMetrics::BytesReceived].load();
+    };
+
+    Observation slot;
+    size_t sink = 0;
+    FetchScheduler::Config serial; // One connection, like the other paths; the mock has two threads
+    serial.concurrency = 1;
+    FetchScheduler scheduler(serial);
+    std::vector<std::string> batch;
+    for (int c = 0; c < 100; ++c) batch.push_back("City" + std::to_string(c));
+    struct Path {
+        const char* label;
+        int requests;
+        std::function<void(const std::string&)> fetch;
+        int perCall = 1; // Requests made by one call of fetch
+    };
+    const Path paths[] = {
+        {"weather, streamed", 4000, [&](const std::string& city) { sink += WeatherDataFetcher::fetchObservation(city, apiKey, slot); }},
+        {"weather, scheduler", 40, [&](const std::string&) {
+             sink += scheduler.run(batch, apiKey, [](const std::string&, const FetchScheduler::Response&) {}, nullptr).succeeded;
+         }, 100},
+        {"weather, DOM", 4000, [&](const std::string& city) { sink += WeatherDataFetcher::fetchWeatherData(city, apiKey).size(); }},
+        {"forecast, streamed", 1000, [&](const std::string& city) {
+             sink += WeatherDataFetcher::fetchForecast(city, apiKey, 0, [](const ForecastRecord&) {});
+         }},
+    };
+    std::printf("%-20s %-9s %12s %13s %13s\n", "path", "encoding", "wire bytes", "client CPU us", "wall us");
+    for (const auto& path : paths) {
+        for (bool compressed : {false, true}) {
+            WeatherDataFetcher::acceptCompressed() = compressed;
+            for (int i = 0; i < std::max(1, 50 / path.perCall); ++i) path.fetch("City" + std::to_string(i)); // Warm-up
+            uint64_t bytesBefore = bytesReceived(), cpuBefore = threadCpuNs();
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < path.requests; ++i) path.fetch("City" + std::to_string(i % 100));
+            double wallUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            double requests = static_cast<double>(path.requests) * path.perCall;
+            std::printf("%-20s %-9s %12.0f %13.1f %13.1f\n", path.label, compressed ? "gzip" : "identity",
+                        static_cast<double>(bytesReceived() - bytesBefore) / requests,
+                        (threadCpuNs() - cpuBefore) / 1000.0 / requests, wallUs / requests);
+        }
+    }
+    WeatherDataFetcher::acceptCompressed() = true;
+    std::cout << (sink == 0 ? " " : "") << std::endl;
+    return 0;
+}
+
+// Benchmark: alert-detection delay for a request budget, adaptive against fixed-interval polling,
+// over replayed synthetic traces (diurnal swing, random walk, warm fronts, mixed upstream cadences)
+int benchAdaptivePolling() {
+    const int cityCount = 2000;
+    const int64_t t0 = 1700000000 - 1700000000 % 86400;
+    const int64_t end = t0 + 3 * 86400;
+    const double threshold = 35.0;
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+    auto next = [&seed] {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+    auto uniform = [&next](double lo, double hi) { return lo + (hi - lo) * static_cast<double>(next() % 1000001) / 1e6; };
+
+    struct Trace {
+        int64_t cadence;
+        int64_t lag; // Seconds from dt until the reading is served
+        std::vector<int64_t> dt;
+        std::vector<double> temp;
+        std::vector<int32_t> excursion; // Index of the threshold crossing a reading belongs to, -1 below threshold
+        std::vector<int64_t> crossingAvailable;
+    };
+    std::vector<Trace> traces(cityCount);
+    size_t crossings = 0;
+    for (auto& trace : traces) {
+        uint64_t kind = next() % 10;
+        trace.cadence = kind < 7 ? 600 : kind < 9 ? 900 : 300;
+        trace.lag = 60 + static_cast<int64_t>(next() % 120);
+        bool volatileCity = next() % 10 < 3;
+        double base = uniform(18, 31), amplitude = uniform(2, 6), walk = 0, front = 0, frontTarget = 0;
+        for (int64_t dt = t0 - 3600; dt < end; dt += trace.cadence) {
+            double step = static_cast<double>(trace.cadence) / 600.0;
+            walk = 0.98 * walk + (volatileCity ? 0.3 : 0.05) * (uniform(-1, 1) + uniform(-1, 1)) * step;
+            if (frontTarget == 0 && next() % 100000 < static_cast<uint64_t>((volatileCity ? 400 : 40) * step)) frontTarget = uniform(3, 9);
+            front += (frontTarget - front) * 0.15 * step;
+            if (frontTarget > 0 && front > frontTarget - 0.2) frontTarget = 0; // Peaked; decays back
+            double hour = static_cast<double>(dt % 86400) / 3600.0;
+            trace.dt.push_back(dt);
+            trace.temp.push_back(base + amplitude * std::sin((hour - 9) / 24 * 2 * M_PI) + walk + front);
+        }
+        int32_t current = -1;
+        for (size_t k = 0; k < trace.temp.size(); ++k) {
+            if (trace.temp[k] > threshold) {
+                if (current < 0 && k > 0 && trace.dt[k] >= t0) { // Crossings before the replay starts do not count
+                    current = static_cast<int32_t>(trace.crossingAvailable.size());
+                    trace.crossingAvailable.push_back(trace.dt[k] + trace.lag);
+                }
+            } else {
+                current = -1;
+            }
+            trace.excursion.push_back(current);
+        }
+        crossings += trace.crossingAvailable.size();
+    }
+
+    struct Result {
+        uint64_t requests = 0;
+        uint64_t stale = 0; // Polls that returned a reading already seen
+        std::vector<double> delays;
+    };
+    // Serves the newest reading visible at time t and scores any undetected crossing it reveals
+    struct Replay {
+        std::vector<size_t> cursor;
+        std::vector<int64_t> lastDt;
+        std::vector<std::vector<bool>> detected;
+    };
+    auto makeReplay = [&] {
+        Replay replay;
+        replay.cursor.assign(cityCount, 0);
+        replay.lastDt.assign(cityCount, 0);
+        for (const auto& trace : traces) replay.detected.emplace_back(trace.crossingAvailable.size(), false);
+        return replay;
+    };
+    auto poll = [&](Replay& replay, Result& result, int city, int64_t t) -> size_t {
+        const Trace& trace = traces[city];
+        size_t& k = replay.cursor[city];
+        while (k + 1 < trace.dt.size() && trace.dt[k + 1] + trace.lag <= t) ++k;
+        ++result.requests;
+        if (trace.dt[k] == replay.lastDt[city]) ++result.stale;
+        replay.lastDt[city] = trace.dt[k];
+        int32_t excursion = trace.excursion[k];
+        if (excursion >= 0 && !replay.detected[city][excursion]) {
+            replay.detected[city][excursion] = true;
+            result.delays.push_back(static_cast<double>(t - trace.crossingAvailable[excursion]));
+        }
+        return k;
+    };
+    auto report = [&](const char* label, int64_t budget, Result& result) {
+        std::sort(result.delays.begin(), result.delays.end());
+        double mean = 0;
+        for (double d : result.delays) mean += d;
+        mean = result.delays.empty() ? 0 : mean / result.delays.size();
+        double p95 = result.delays.empty() ? 0 : result.delays[result.delays.size() * 95 / 100];
+        std::printf("%-10s %10lld %10.0f %8.1f%% %10.1f %10.1f %9zu\n", label, static_cast<long long>(budget),
+                    result.requests / static_cast<double>((end - t0) / 3600), 100.0 * result.stale / result.requests, mean / 60,
+                    p95 / 60, crossings - result.delays.size());
+    };
+
+    std::printf("%zu threshold crossings over %d cities and 3 days\n", crossings, cityCount);
+    std::printf("%-10s %10s %10s %9s %10s %10s %9s\n", "polling", "budget/h", "used/h", "stale", "mean min", "p95 min", "missed");
+    for (int64_t fixedInterval : {300, 600, 1200}) {
+        int64_t budget = cityCount * 3600 / fixedInterval;
+
+        Replay fixedReplay = makeReplay();
+        Result fixed;
+        for (int city = 0; city < cityCount; ++city) {
+            for (int64_t t = t0 + city * fixedInterval / cityCount; t < end; t += fixedInterval) poll(fixedReplay, fixed, city, t);
+        }
+        report("fixed", budget, fixed);
+
+        AdaptivePollPlanner::Config config;
+        config.enabled = true;
+        config.requestsPerHour = static_cast<double>(budget);
+        config.alertThreshold = threshold;
+        AdaptivePollPlanner planner(config);
+        Replay adaptiveReplay = makeReplay();
+        Result adaptive;
+        for (int city = 0; city < cityCount; ++city) planner.add(static_cast<uint32_t>(city), t0);
+        std::vector<uint32_t> due;
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t t = t0; t < end; t += 10) {
+            due.clear();
+            planner.due(t, due);
+            for (uint32_t city : due) {
+                size_t k = poll(adaptiveReplay, adaptive, static_cast<int>(city), t);
+                planner.onObservation(city, t, traces[city].dt[k], traces[city].temp[k]);
+            }
+        }
+        double plannerNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        report("adaptive", budget, adaptive);
+        std::printf("           planner cost %.0f ns per poll (including replay), final quota stretch %.2f\n",
+                    plannerNs / adaptive.requests, planner.stretch());
+    }
+    return 0;
+}
+
+// Benchmark: generated MetricAggregator against hand-written loops, for 1 and 8 metrics
+int benchMetricAggregator() {
+    const size_t count = 1 << 20;
+    const int passes = 20;
+    std::vector<WeatherReading> readings(count);
+    uint64_t seed = 88172645463325252ULL;
+    auto uniform = [&seed](double lo, double hi) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return lo + (hi - lo) * static_cast<double>(seed % 1000001) / 1e6;
+    };
+    for (auto& r : readings) {
+        r.tempC = uniform(-10, 45);
+        r.feelsLikeC = r.tempC + uniform(-3, 3);
+        r.tempMinC = r.tempC - uniform(0, 2);
+        r.tempMaxC = r.tempC + uniform(0, 2);
+        r.pressure = uniform(980, 1040);
+        r.humidity = uniform(5, 100);
+        r.windSpeed = uniform(0, 20);
+        r.clouds = uniform(0, 100);
+    }
+
+    auto time = [&](const char* label, const std::function<double()>& run) {
+        double check = run(); // Warm-up
+        auto start = std::chrono::steady_clock::now();
+        for (int p = 0; p < passes; ++p) check = run();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / passes / count;
+        std::printf("%-34s %6.2f ns/reading  (check %.6f)\n", label, ns, check);
+    };
+
+    time("hand-written, 1 metric", [&] {
+        uint64_t n = 0;
+        double sum = 0, lo = std::numeric_limits<double>::infinity(), hi = -lo;
+        for (const auto& r : readings) {
+            if (std::isnan(r.tempC)) continue;
+            ++n;
+            sum += r.tempC;
+            lo = std::min(lo, r.tempC);
+            hi = std::max(hi, r.tempC);
+        }
+        return sum / static_cast<double>(n) + lo + hi;
+    });
+    time("MetricAggregator, 1 metric", [&] {
+        MetricAggregator<TypeList<metric::Temperature>, TypeList<stats::Mean, stats::Min, stats::Max>> aggregator;
+        for (const auto& r : readings) aggregator.add(r);
+        return aggregator.get<metric::Temperature, stats::Mean>() + aggregator.get<metric::Temperature, stats::Min>() +
+               aggregator.get<metric::Temperature, stats::Max>();
+    });
+
+    time("hand-written, 8 metrics", [&] {
+        uint64_t n[8] = {};
+        double sum[8] = {}, lo[8], hi[8];
+        std::fill(lo, lo + 8, std::numeric_limits<double>::infinity());
+        std::fill(hi, hi + 8, -std::numeric_limits<double>::infinity());
+        auto add = [&](int m, double v) {
+            if (std::isnan(v)) return;
+            ++n[m];
+            sum[m] += v;
+            lo[m] = std::min(lo[m], v);
+            hi[m] = std::max(hi[m], v);
+        };
+        for (const auto& r : readings) {
+            add(0, r.tempC);
+            add(1, r.feelsLikeC);
+            add(2, r.tempMinC);
+            add(3, r.tempMaxC);
+            add(4, r.pressure);
+            add(5, r.humidity);
+            add(6, r.windSpeed);
+            add(7, r.clouds);
+        }
+        double check = 0;
+        for (int m = 0; m < 8; ++m) check += sum[m] / static_cast<double>(n[m]) + lo[m] + hi[m];
+        return check;
+    });
+    using Eight = TypeList<metric::Temperature, metric::FeelsLike, metric::TempMin, metric::TempMax, metric::Pressure,
+                           metric::Humidity, metric::WindSpeed, metric::Clouds>;
+    time("MetricAggregator, 8 metrics", [&] {
+        MetricAggregator<Eight, TypeList<stats::Mean, stats::Min, stats::Max>> aggregator;
+        for (const auto& r : readings) aggregator.add(r);
+        double check = 0;
+        aggregator.forEachField([&check](const std::string&, double value) { check += value; });
+        return check;
+    });
+    time("MetricAggregator, 8 metrics + var", [&] {
+        MetricAggregator<Eight, TypeList<stats::Mean, stats::Min, stats::Max, stats::Variance>> aggregator;
+        for (const auto& r : readings) aggregator.add(r);
+        return aggregator.get<metric::Pressure, stats::Variance>();
+    });
+
+    MetricAggregator<Eight, TypeList<stats::Mean, stats::Min, stats::Max>> sample;
+    sample.add(WeatherReading::fromJson(nlohmann::json::parse(makeSamplePayload("Delhi", 300.15, 1700000000))));
+    std::cout << "fields: " << sample.toJson().dump() << std::endl;
+    return 0;
+}
+
+// Benchmark: Parquet export against JSON lines for one day of 5-minute observations
+int benchColumnarExport() {
+    const int cityCount = 1000;
+    const int64_t start = 1700006400; // 00:00 UTC
+    static const char* conditions[] = {"Clear", "Clouds", "Rain", "Haze", "Mist", "Drizzle"};
+    std::vector<std::string> cities;
+    std::vector<nlohmann::json> documents;
+    uint64_t seed = 88172645463325252ULL;
+    auto next = [&seed] {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+    for (int c = 0; c < cityCount; ++c) cities.push_back("City" + std::to_string(c));
+    for (int64_t dt = start; dt < start + 86400; dt += 300) {
+        for (int c = 0; c < cityCount; ++c) {
+            double kelvin = 290 + c % 20 + 6 * std::sin(static_cast<double>(dt % 86400) / 86400 * 6.283) + static_cast<double>(next() % 100) / 100;
+            nlohmann::json doc = nlohmann::json::parse(makeSamplePayload(cities[c], kelvin, dt));
+            doc["weather"][0]["main"] = conditions[(c + dt / 10800) % 6];
+            doc["main"]["pressure"] = 990 + static_cast<int>(next() % 30);
+            doc["main"]["humidity"] = 20 + static_cast<int>(next() % 70);
+            doc["wind"]["speed"] = static_cast<double>(next() % 150) / 10;
+            doc["clouds"] = {{"all", static_cast<int>(next() % 101)}};
+            documents.push_back(std::move(doc));
+        }
+    }
+    std::vector<Observation> parsed;
+    for (const auto& doc : documents) parsed.push_back(Observation::fromJson(doc));
+    double rows = static_cast<double>(documents.size());
+
+    auto fileSize = [](const std::string& path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        return file ? static_cast<uint64_t>(file.tellg()) : 0;
+    };
+    auto report = [rows](const char* label, double seconds, uint64_t bytes) {
+        std::printf("%-22s %8.2f MB  %6.1f bytes/row  %7.0f k rows/s\n", label, static_cast<double>(bytes) / 1e6,
+                    static_cast<double>(bytes) / rows, rows / seconds / 1e3);
+    };
+    std::printf("%.0f observations (%d cities, 5-minute polls, one day)\n", rows, cityCount);
+
+    for (bool compress : {false, true}) {
+        auto begin = std::chrono::steady_clock::now();
+        std::string lines;
+        for (const auto& doc : documents) lines += doc.dump() + '\n';
+        if (compress) lines = HttpServer::gzip(lines);
+        std::ofstream("bench-export.json", std::ios::binary | std::ios::trunc) << lines;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        report(compress ? "JSON lines, gzip" : "JSON lines", seconds, fileSize("bench-export.json"));
+        std::remove("bench-export.json");
+    }
+
+    for (bool compress : {false, true}) {
+        ColumnarExporter::Config config;
+        config.directory = "bench-export";
+        config.compress = compress;
+        ColumnarExporter exporter(config);
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < documents.size(); ++i) {
+            exporter.addObservation(documents[i]["name"].get_ref<const std::string&>(), parsed[i], WeatherReading::fromJson(documents[i]));
+        }
+        exporter.close();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        uint64_t bytes = 0;
+        for (const auto& path : exporter.files()) {
+            bytes += fileSize(path);
+            std::remove(path.c_str());
+        }
+        report(compress ? "Parquet, gzip pages" : "Parquet", seconds, bytes);
+    }
+    rmdir("bench-export");
+    return 0;
+}
+
+// Benchmark: day-average error under clustered poll failures, and WindowEngine cost per observation
+int benchGapInterpolation() {
+    const int cityCount = 1000;
+    const int days = 3;
+    const int64_t interval = 300;
+    const int64_t start = 1700006400; // 00:00 UTC
+    const double pi = 3.14159265358979;
+    uint64_t seed = 88172645463325252ULL;
+    auto uniform = [&seed] {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return static_cast<double>(seed % 1000000) / 1e6;
+    };
+    // Diurnal swing peaking at 15:00; the true day mean is each city's base temperature. Most
+    // afternoon polls fail (an upstream that is overloaded at peak hours), so samples under-
+    // represent the warm part of the day.
+    std::vector<std::string> cities;
+    for (int c = 0; c < cityCount; ++c) cities.push_back("City" + std::to_string(c));
+    std::vector<std::pair<uint32_t, Observation>> stream;
+    for (int64_t dt = start; dt < start + days * 86400; dt += interval) {
+        double hour = static_cast<double>(dt % 86400) / 3600;
+        double failure = hour >= 11 && hour < 17 ? 0.6 : 0.05;
+        for (uint32_t c = 0; c < cityCount; ++c) {
+            if (uniform() < failure) continue;
+            Observation obs;
+            obs.dt = dt;
+            obs.tempC = 10 + c % 25 + 8 * std::sin(2 * pi * (hour - 9) / 24) + (uniform() - 0.5);
+            std::strncpy(obs.condition, hour >= 11 && hour < 17 ? "Clear" : "Clouds", sizeof(obs.condition) - 1);
+            stream.emplace_back(c, obs);
+        }
+    }
+    std::printf("%zu observations (%d cities, %d days, %.0f%% of 5-minute polls missing)\n", stream.size(), cityCount, days,
+                100.0 - 100.0 * static_cast<double>(stream.size()) / (cityCount * days * 86400.0 / interval));
+
+    struct Variant {
+        const char* label;
+        WindowEngine::GapConfig config;
+        bool sampleMean;
+    };
+    WindowEngine::GapConfig off;
+    off.maxGap = -1; // No span is integrated: per-sample statistics only
+    WindowEngine::GapConfig detect;
+    detect.expectedInterval = interval;
+    WindowEngine::GapConfig linearFill = detect;
+    linearFill.fill = true;
+    WindowEngine::GapConfig previous = detect;
+    previous.interpolation = WindowEngine::Previous;
+    std::vector<Variant> variants = {{"sample mean (no interpolation)", off, true},
+                                     {"sample mean, linear fill", linearFill, true},
+                                     {"time-weighted, previous value", previous, false},
+                                     {"time-weighted, linear", detect, false},
+                                     {"time-weighted, linear + fill", linearFill, false}};
+    std::printf("%-32s %12s %10s %10s %12s\n", "variant", "ns/obs", "mean err", "max err", "missed/day");
+    for (const auto& variant : variants) {
+        double errorSum = 0, errorMax = 0;
+        uint64_t closedDays = 0, missed = 0;
+        WindowEngine engine([&](const std::string& city, int64_t, const RollupStats& stats, bool) {
+            double truth = 10 + std::stoi(city.substr(4)) % 25;
+            double error = std::fabs((variant.sampleMean ? stats.sampleAverage() : stats.average()) - truth);
+            errorSum += error;
+            errorMax = std::max(errorMax, error);
+            missed += stats.missedPolls;
+            ++closedDays;
+        });
+        engine.setGapConfig(variant.config);
+        auto begin = std::chrono::steady_clock::now();
+        for (const auto& entry : stream) engine.add(cities[entry.first], entry.second);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() /
+                    static_cast<double>(stream.size());
+        engine.closeAll();
+        std::printf("%-32s %12.1f %9.3f° %9.3f° %12.1f\n", variant.label, ns, errorSum / static_cast<double>(closedDays), errorMax,
+                    static_cast<double>(missed) / static_cast<double>(closedDays));
+    }
+    return 0;
+}
+
+// Benchmark: range min/max/avg latency over a year of 5-minute readings per city, index against scan
+int benchRangeIndex() {
+    const int cityCount = 1000; // A year for 10k cities needs ~8.5 GB; latency depends on readings per city
+    const int64_t interval = 300;
+    const int64_t start = 1672531200; // 2023-01-01
+    const size_t perCity = 365 * 86400 / interval;
+    uint64_t seed = 88172645463325252ULL;
+    auto next = [&seed] {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+    std::vector<std::string> cities;
+    for (int c = 0; c < cityCount; ++c) cities.push_back("City" + std::to_string(c));
+    std::vector<std::vector<float>> scanCopy(cityCount, std::vector<float>(perCity));
+
+    RangeAggregateIndex index(0); // A year of readings: no retention horizon
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < perCity; ++i) {
+        int64_t dt = start + static_cast<int64_t>(i) * interval;
+        for (int c = 0; c < cityCount; ++c) {
+            float tempC = static_cast<float>(15 + c % 20 + 10 * std::sin(static_cast<double>(i) / 288 * 6.283) + static_cast<double>(next() % 100) / 50);
+            scanCopy[c][i] = tempC;
+            index.add(cities[c], dt, tempC);
+        }
+    }
+    double appendNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() /
+                      static_cast<double>(perCity * cityCount);
+    uint64_t bytes = index.memoryBytes();
+    std::printf("%d cities x %zu readings: %.0f ns per append, %.1f bytes per reading, %.0f MB (%.1f GB for 10k cities)\n",
+                cityCount, perCity, appendNs, static_cast<double>(bytes) / static_cast<double>(index.readings()),
+                static_cast<double>(bytes) / 1e6, static_cast<double>(bytes) / 1e9 * 10000 / cityCount);
+
+    // The same year through the default 30-day retention horizon, as the workers keep it
+    RangeAggregateIndex recent;
+    begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < perCity; ++i) {
+        int64_t dt = start + static_cast<int64_t>(i) * interval;
+        for (int c = 0; c < cityCount; ++c) recent.add(cities[c], dt, scanCopy[c][i]);
+    }
+    double recentNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() /
+                      static_cast<double>(perCity * cityCount);
+    std::printf("with 30-day retention: %.0f ns per append, %llu readings kept, %.0f MB\n", recentNs,
+                static_cast<unsigned long long>(recent.readings()), static_cast<double>(recent.memoryBytes()) / 1e6);
+
+    // A catch-up delivered out of order, as handoff imports and replays can: 30 days per city, newest first
+    RangeAggregateIndex backfill;
+    const size_t backfillCount = std::min<size_t>(perCity, 30 * 86400 / interval);
+    begin = std::chrono::steady_clock::now();
+    for (size_t i = backfillCount; i-- > 0;) {
+        int64_t dt = start + static_cast<int64_t>(i) * interval;
+        for (int c = 0; c < cityCount; ++c) backfill.add(cities[c], dt, scanCopy[c][i]);
+    }
+    std::printf("30 days added newest first: %.0f ns per append\n",
+                std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() /
+                    static_cast<double>(backfillCount * cityCount));
+
+    struct Span {
+        const char* label;
+        int64_t seconds; // 0: arbitrary from/to within the year
+    };
+    const int queries = 20000;
+    double sink = 0;
+    std::printf("%-16s %12s %12s %12s %12s\n", "range", "index p50", "index p99", "scan p50", "scan p99");
+    for (const Span& span : {Span{"1 hour", 3600}, Span{"1 day", 86400}, Span{"30 days", 30 * 86400}, Span{"arbitrary", 0}}) {
+        std::vector<double> indexed, scanned;
+        for (int q = 0; q < queries; ++q) {
+            int c = static_cast<int>(next() % cityCount);
+            int64_t from = start + static_cast<int64_t>(next() % (365 * 86400));
+            int64_t to = span.seconds ? from + span.seconds : start + static_cast<int64_t>(next() % (365 * 86400));
+            if (to < from) std::swap(from, to);
+            auto t0 = std::chrono::steady_clock::now();
+            RangeAggregateIndex::Result result = index.query(cities[c], from, to);
+            auto t1 = std::chrono::steady_clock::now();
+            // Scan of the same readings, located by arithmetic (the best case for a scan)
+            size_t lo = static_cast<size_t>((from - start + interval - 1) / interval);
+            size_t hi = std::min(perCity, static_cast<size_t>((to - start) / interval + 1));
+            double sum = 0, lowest = std::numeric_limits<double>::infinity(), highest = -lowest;
+            for (size_t i = lo; i < hi; ++i) {
+                sum += scanCopy[c][i];
+                lowest = std::min(lowest, static_cast<double>(scanCopy[c][i]));
+                highest = std::max(highest, static_cast<double>(scanCopy[c][i]));
+            }
+            auto t2 = std::chrono::steady_clock::now();
+            if (result.count != hi - lo || result.max != highest || result.min != lowest) {
+                std::printf("mismatch for %s [%lld, %lld]\n", cities[c].c_str(), static_cast<long long>(from), static_cast<long long>(to));
+                return 1;
+            }
+            sink += result.sum - sum;
+            indexed.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+            scanned.push_back(std::chrono::duration<double, std::micro>(t2 - t1).count());
+        }
+        auto percentile = [](std::vector<double>& values, double p) {
+            std::sort(values.begin(), values.end());
+            return values[static_cast<size_t>(p * static_cast<double>(values.size() - 1))];
+        };
+        std::printf("%-16s %10.2f us %10.2f us %10.2f us %10.2f us\n", span.label, percentile(indexed, 0.5), percentile(indexed, 0.99),
+                    percentile(scanned, 0.5), percentile(scanned, 0.99));
+    }
+    std::cout << (std::fabs(sink) < 1 ? "" : " ") << std::endl;
+    return 0;
+}
+
+// Benchmark: trend estimator updates per second for 100k cities, and how early it predicts a
+// threshold breach on a simulated hot day (5-minute readings, daily peaks spread from 27 to 37 °C)
+int benchTrendEstimator() {
+    const uint32_t cityCount = 100000;
+    const int64_t interval = 300;
+    const int rounds = 24 * 3600 / interval;
+    const double threshold = 35.0;
+    const double pi = 3.14159265358979323846;
+    TrendEstimator::Config config;
+    config.threshold = threshold;
+    TrendEstimator estimator(config);
+    estimator.reserve(cityCount);
+
+    // Daily cycle peaking at 15:00, precomputed along with the sensor noise so the timed loop is updates only.
+    std::vector<double> cycle(rounds);
+    for (int r = 0; r < rounds; ++r) cycle[r] = std::sin(2 * pi * (r * interval - 9 * 3600) / 86400.0);
+    std::vector<double> noise(4096);
+    uint64_t seed = 7;
+    for (auto& n : noise) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        n = static_cast<double>(seed % 601) / 1000.0 - 0.3;
+    }
+    std::vector<double> peaks(cityCount);
+    for (uint32_t c = 0; c < cityCount; ++c) peaks[c] = 27.0 + (c % 100) * 0.1;
+
+    std::vector<int64_t> alertedAt(cityCount, -1), crossedAt(cityCount, -1);
+    const int64_t base = 1700000000 - 1700000000 % 86400;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        int64_t dt = base + r * interval;
+        for (uint32_t c = 0; c < cityCount; ++c) {
+            double temp = peaks[c] - 8.0 + 8.0 * cycle[r] + noise[(c * 31 + r) & 4095];
+            TrendEstimator::Prediction p = estimator.update(c, dt, temp);
+            if (p.alert && alertedAt[c] < 0) alertedAt[c] = dt;
+            if (temp >= threshold && crossedAt[c] < 0) crossedAt[c] = dt;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double updates = cityCount * static_cast<double>(rounds);
+
+    size_t crossing = 0, warned = 0, falseAlerts = 0;
+    double lowestFalsePeak = threshold;
+    std::vector<int64_t> leads;
+    for (uint32_t c = 0; c < cityCount; ++c) {
+        if (crossedAt[c] < 0) {
+            if (alertedAt[c] >= 0) {
+                ++falseAlerts;
+                lowestFalsePeak = std::min(lowestFalsePeak, peaks[c]);
+            }
+            continue;
+        }
+        ++crossing;
+        if (alertedAt[c] >= 0 && alertedAt[c] < crossedAt[c]) {
+            ++warned;
+            leads.push_back((crossedAt[c] - alertedAt[c]) / 60);
+        }
+    }
+    std::sort(leads.begin(), leads.end());
+    std::cout << "updates/s: " << updates / seconds << " (" << seconds * 1e9 / updates << " ns per update)\n"
+              << "state for " << cityCount << " cities: " << estimator.memoryBytes() / (1024.0 * 1024.0) << " MiB ("
+              << estimator.memoryBytes() / cityCount << " bytes/city)\n"
+              << "cities crossing " << threshold << " °C: " << crossing << ", warned beforehand: " << warned;
+    if (!leads.empty()) std::cout << " (median lead " << leads[leads.size() / 2] << " min)";
+    std::cout << "\nalerts for cities that stayed below: " << falseAlerts << " of " << cityCount - crossing;
+    if (falseAlerts) std::cout << " (all peaking at " << lowestFalsePeak << " °C or above)";
+    std::cout << std::endl;
+    return 0;
+}
+
+// Benchmark: historical summaries over 10M stored readings (1000 cities, 10000 5-minute readings each).
+// The client-side work of each path is measured in-process: parsing and summarising every projected
+// reading (local) against merging the $group output (pushdown). With a MongoDB server on localhost the
+// readings are loaded once into weatherBench.rawData and both paths are timed end to end.
+int benchHistoryPushdown() {
+    const uint32_t cityCount = 1000;
+    const int64_t perCity = 10000;
+    const int64_t interval = 300;
+    const int64_t total = cityCount * perCity;
+    const int64_t start = 1700000000 - 1700000000 % 86400;
+    const int64_t end = start + (perCity - 1) * interval;
+    static const char* conditions[] = {"Clear", "Clouds", "Rain", "Haze"};
+    auto reading = [&](uint32_t c, int64_t i) {
+        int64_t dt = start + i * interval;
+        double kelvin = 285.0 + c % 20 + 8.0 * std::sin(static_cast<double>(dt % 86400) / 86400.0 * 6.283) +
+                        static_cast<double>((c * 31 + i) % 100) / 100.0;
+        nlohmann::json weather = nlohmann::json::array();
+        weather.push_back({{"main", conditions[(c + i / 12) % 4]}});
+        return nlohmann::json{{"id", c}, {"name", "City" + std::to_string(c)}, {"dt", dt},
+                              {"main", {{"temp", kelvin}, {"humidity", 40}}}, {"weather", weather}};
+    };
+
+    // Local path: every reading crosses the wire as {dt, main.temp, weather[0].main} and is parsed
+    // and grouped here. A pool of projected documents stands in for the cursor.
+    std::vector<std::string> pool;
+    size_t poolBytes = 0;
+    for (int64_t i = 0; i < 4096; ++i) {
+        nlohmann::json doc = reading(static_cast<uint32_t>(i % cityCount), i);
+        nlohmann::json projected = {{"dt", doc["dt"]}, {"main", {{"temp", doc["main"]["temp"]}}}, {"weather", doc["weather"]}};
+        pool.push_back(projected.dump());
+        poolBytes += pool.back().size();
+    }
+    HistoricalSummaryQuery::Groups localGroups;
+    auto timer = std::chrono::steady_clock::now();
+    for (int64_t i = 0; i < total; ++i) {
+        HistoricalSummaryQuery::accumulate(nlohmann::json::parse(pool[i & 4095]), true, localGroups);
+    }
+    double localSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timer).count();
+
+    // Pushdown path: one $group document per (day, condition) comes back and is merged.
+    std::vector<std::string> groupDocs;
+    size_t groupBytes = 0;
+    for (const auto& group : localGroups) {
+        nlohmann::json doc = {{"_id", {{"c", group.first.second}, {"d", group.first.first * 86400}}},
+                              {"n", group.second.count}, {"sum", group.second.sum},
+                              {"min", group.second.min}, {"max", group.second.max}};
+        groupDocs.push_back(doc.dump());
+        groupBytes += groupDocs.back().size();
+    }
+    timer = std::chrono::steady_clock::now();
+    HistoricalSummaryQuery::Groups pushedGroups;
+    for (const auto& doc : groupDocs) HistoricalSummaryQuery::mergeGroup(nlohmann::json::parse(doc), pushedGroups);
+    auto pushedResult = HistoricalSummaryQuery::finish(pushedGroups.begin(), pushedGroups.end());
+    double pushSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timer).count();
+    auto localResult = HistoricalSummaryQuery::finish(localGroups.begin(), localGroups.end());
+
+    std::cout << "client side, " << total << " readings grouped by day:\n"
+              << "  local:    " << localSeconds << " s (" << localSeconds * 1e9 / total << " ns per reading), ~"
+              << static_cast<double>(poolBytes) / pool.size() * total / (1024.0 * 1024.0) << " MiB as JSON\n"
+              << "  pushdown: " << pushSeconds * 1e6 << " us for " << groupDocs.size() << " group documents ("
+              << groupBytes / 1024.0 << " KiB)\n"
+              << "  same summary: " << (localResult.count == pushedResult.count &&
+                                        std::abs(localResult.summary.averageTemp - pushedResult.summary.averageTemp) < 1e-9 &&
+                                        localResult.summary.dominantCondition == pushedResult.summary.dominantCondition
+                                            ? "yes" : "no")
+              << std::endl;
+
+    MongoDBHandler dbHandler("weatherBench");
+    if (!dbHandler.reachable()) {
+        std::cout << "no MongoDB server on localhost:27017; skipping the end-to-end comparison" << std::endl;
+        return 0;
+    }
+    if (dbHandler.countWeatherData(nlohmann::json::object(), total) < total) {
+        std::vector<nlohmann::json> batch;
+        for (uint32_t c = 0; c < cityCount; ++c) {
+            for (int64_t i = 0; i < perCity; ++i) {
+                batch.push_back(reading(c, i));
+                if (batch.size() == 10000) {
+                    dbHandler.storeWeatherDataBatch(batch);
+                    batch.clear();
+                }
+            }
+        }
+        dbHandler.storeWeatherDataBatch(batch);
+    }
+
+    struct Range {
+        const char* name;
+        std::string city;
+        int64_t from, to;
+    };
+    std::vector<Range> ranges = {{"1 city, 1 day", "City7", start, start + 86399},
+                                 {"1 city, all days", "City7", start, end},
+                                 {"all cities, 1 day", "", start, start + 86399},
+                                 {"all cities, all days", "", start, end}};
+    HistoricalSummaryQuery history(&dbHandler);
+    HistoricalSummaryQuery::Config config;
+    for (const auto& range : ranges) {
+        double ms[2];
+        HistoricalSummaryQuery::Result results[2];
+        for (int path = 0; path < 2; ++path) {
+            config.mode = path ? HistoricalSummaryQuery::Local : HistoricalSummaryQuery::Pushdown;
+            history.setConfig(config);
+            timer = std::chrono::steady_clock::now();
+            results[path] = history.summarize(range.city, range.from, range.to);
+            ms[path] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timer).count();
+        }
+        config.mode = HistoricalSummaryQuery::Auto;
+        history.setConfig(config);
+        bool autoPushed = history.summarize(range.city, range.from, range.to).pushedDown;
+        bool same = results[0].count == results[1].count &&
+                    std::abs(results[0].summary.averageTemp - results[1].summary.averageTemp) < 1e-6;
+        std::cout << range.name << " (" << results[0].count << " readings): pushdown " << ms[0] << " ms, local " << ms[1]
+                  << " ms, auto picks " << (autoPushed ? "pushdown" : "local") << (same ? "" : ", RESULTS DIFFER") << std::endl;
+    }
+    return 0;
+}
+
+// Function to run a named benchmark (./weather_data_aggregator --bench <name>)
+int runBenchmark(const std::string& name) {
+    const std::vector<std::pair<std::string, std::function<int()>>> benchmarks = {
+        {"metrics", benchMetricsOverhead},
+        {"sharding", benchShardedIngest},
+        {"anomaly", benchAnomalyDetector},
+        {"query", benchQueryApi},
+        {"rollups", benchRollups},
+        {"stations", benchStationIndex},
+        {"leaderboard", benchLeaderboard},
+        {"checkpoint", benchCheckpoint},
+        {"dedup", benchDedup},
+        {"compression", benchCompression},
+        {"kernels", benchKernels},
+        {"parallel", benchParallel},
+        {"logging", benchLogging},
+        {"forecast", benchForecast},
+        {"allocations", benchAllocations},
+        {"retries", benchRetries},
+        {"hedging", benchHedging},
+        {"transfer", benchTransfer},
+        {"polling", benchAdaptivePolling},
+        {"aggregator", benchMetricAggregator},
+        {"export", benchColumnarExport},
+        {"gaps", benchGapInterpolation},
+        {"ranges", benchRangeIndex},
+        {"trends", benchTrendEstimator},
+        {"pushdown", benchHistoryPushdown},
+    };
+    for (const auto& bench : benchmarks) {
+        if (bench.first == name) return bench.second();
+    }
+    std::cerr << "Unknown benchmark '" << name << "'. Available:";
+    for (const auto& bench : benchmarks) std::cerr << " " << bench.first;
+    std::cerr << std::endl;
+    return 1;
+}
@@ -1,142 +1,230 @@
-#include <iostream>
-#include <vector>
-#include <curl/curl.h>
 #include <nlohmann/json.hpp>
-#include <mongocxx/client.hpp>
-#include <mongocxx/instance.hpp>
-#include <mongocxx/uri.hpp>
-#include <bsoncxx/json.hpp>
-#include <unordered_map>
+#include "../common/async_logger.hpp"
+#include "weather/metrics_exporter.hpp"
+#include "weather/latest_store.hpp"
+#include "weather/range_index.hpp"
+#include "weather/query_api.hpp"
+#include "weather/metric_aggregator.hpp"
+#include "weather/storage_filter.hpp"
+#include "weather/rollups.hpp"
+#include "weather/columnar_exporter.hpp"
+#include "weather/mongo_handler.hpp"
+#include "weather/history_query.hpp"
+#include "weather/poll_planner.hpp"
+#include "weather/ingest_worker.hpp"
+#include "weather/checkpoint.hpp"
+#include "weather/shard_coordinator.hpp"
+#include "weather/benchmarks.hpp"
 #include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
-// WeatherDataFetcher class
-class WeatherDataFetcher {
-public:
-    static nlohmann::json fetchWeatherData(const std::string& city, const std::string& apiKey) {
-        CURL* curl;
-        CURLcode res;
-        std::string readBuffer;
+// Function to run one shard worker: follows the published assignment, polls owned cities
+// and stores a summary of its cities whenever the UTC day rolls over.
+int runShardWorker(int id, const std::string& shardDir, const std::string& apiKey, double alertThreshold,
+                   std::chrono::seconds pollInterval, uint16_t queryPort,
+                   const std::unordered_map<std::string, std::string>& cityRegions,
+                   std::chrono::seconds checkpointInterval, StorageFilter::Config storageFilter,
+                   std::chrono::seconds forecastInterval, AdaptivePollPlanner::Config polling,
+                   ColumnarExporter::Config exportConfig, WindowEngine::GapConfig gaps) {
+    MongoDBHandler dbHandler;
+    IngestWorker worker(&dbHandler, apiKey, alertThreshold);
+    worker.setStorageFilter(storageFilter);
+    worker.setGapConfig(gaps);
+    if (polling.enabled) worker.setAdaptivePolling(polling);
+    for (const auto& entry : cityRegions) worker.setRegion(entry.first, entry.second);
+    LatestObservationStore latestStore(65536);
+    TemperatureLeaderboard leaderboard(65536);
+    worker.setLatestStore(&latestStore);
+    worker.setLeaderboard(&leaderboard);
+    exportConfig.prefix = "worker-" + std::to_string(id) + "-";
+    ColumnarExporter exporter(exportConfig);
+    worker.setColumnarExporter(&exporter);
+    RangeAggregateIndex rangeIndex;
+    worker.setRangeIndex(&rangeIndex);
+    QueryApi queryApi(latestStore, queryPort, 4, &leaderboard, &rangeIndex);
+    if (!queryApi.start()) LOG_ERROR("Query endpoint unavailable on port {}", queryPort);
+
+    CheckpointManager checkpoints(shardDir + "/worker-" + std::to_string(id) + ".ckpt");
+    bool restored = checkpoints.restore(worker);
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    auto lastForecast = std::chrono::steady_clock::time_point{};
+    int64_t epoch = -1;
+    int64_t day = static_cast<int64_t>(std::time(nullptr)) / 86400;
+    while (true) {
+        std::ifstream file(ShardCoordinator::assignmentPath(shardDir));
+        nlohmann::json assignment = nlohmann::json::parse(file, nullptr, false);
+        if (assignment.is_object() && assignment.value("epoch", int64_t{-1}) != epoch) {
+            epoch = assignment["epoch"].get<int64_t>();
+            std::vector<std::string> owned;
+            auto mine = assignment["workers"].find(std::to_string(id));
+            if (mine != assignment["workers"].end()) owned = mine->get<std::vector<std::string>>();
+            worker.setCities(owned, shardDir);
+            size_t assigned = 0;
+            for (const auto& entry : assignment["workers"].items()) assigned += entry.value().size();
+            if (assigned > 0) worker.setPollQuota(polling.requestsPerHour * static_cast<double>(owned.size()) / static_cast<double>(assigned));
+            if (restored) {
+                worker.replay(dbHandler.loadWeatherDataSince(worker.replayStartTime()));
+                restored = false;
+            }
+        }
 
-        curl = curl_easy_init();
-        if(curl) {
-            std::string url = "http://api.openweathermap.org/data/2.5/weather?q=" + city + "&appid=" + apiKey;
-            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-            res = curl_easy_perform(curl);
-            curl_easy_cleanup(curl);
+        worker.runCycle();
+        if (std::chrono::steady_clock::now() - lastForecast >= forecastInterval) {
+            worker.runForecastCycle();
+            lastForecast = std::chrono::steady_clock::now();
+        }
+        if (std::chrono::steady_clock::now() - lastCheckpoint >= checkpointInterval) {
+            checkpoints.checkpoint(worker);
+            lastCheckpoint = std::chrono::steady_clock::now();
         }
 
-        return nlohmann::json::parse(readBuffer);
+        int64_t today = static_cast<int64_t>(std::time(nullptr)) / 86400;
+        if (today != day && worker.hasData()) {
+            DailyMetrics metrics = worker.summarizeMetrics();
+            dbHandler.storeDailySummary(worker.summarize(), &metrics, day, id);
+            worker.clearState();
+        }
+        day = today;
+        // Adaptive polling wakes for the next due city; fixed polling sleeps the full interval
+        int64_t untilDue = worker.nextPollDue() - static_cast<int64_t>(std::time(nullptr));
+        std::this_thread::sleep_for(std::chrono::seconds(std::max<int64_t>(1, std::min<int64_t>(untilDue, pollInterval.count()))));
     }
+}
 
-private:
-    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-        ((std::string*)userp)->append((char*)contents, size * nmemb);
-        return size * nmemb;
+// Main function
+int main(int argc, char* argv[]) {
+    if (argc > 2 && std::string(argv[1]) == "--bench") {
+        return runBenchmark(argv[2]);
     }
-};
-
-// WeatherAggregator class
-class WeatherAggregator {
-public:
-    struct WeatherSummary {
-        double averageTemp;
-        double maxTemp;
-        double minTemp;
-        std::string dominantCondition;
-    };
-
-    WeatherSummary calculateDailySummary(const std::vector<nlohmann::json>& dailyData) {
-        double sumTemp = 0, maxTemp = -1e9, minTemp = 1e9;
-        std::unordered_map<std::string, int> conditionCount;
-        for (const auto& entry : dailyData) {
-            double temp = entry["main"]["temp"].get<double>() - 273.15; // Convert from Kelvin to Celsius
-            sumTemp += temp;
-            maxTemp = std::max(maxTemp, temp);
-            minTemp = std::min(minTemp, temp);
-            std::string condition = entry["weather"][0]["main"].get<std::string>();
-            conditionCount[condition]++;
-        }
 
-        std::string dominantCondition = std::max_element(conditionCount.begin(), conditionCount.end(),
-                                                          [](const auto& a, const auto& b) { return a.second < b.second; })->first;
-
-        return {sumTemp / dailyData.size(), maxTemp, minTemp, dominantCondition};
+    std::string apiKey = "your_openweathermap_api_key"; // Replace with your actual API key
+    std::vector<std::string> cities = {"Delhi", "Mumbai", "Chennai", "Bangalore", "Kolkata", "Hyderabad"};
+    std::unordered_map<std::string, std::string> cityRegions = {
+        {"Delhi", "North"}, {"Mumbai", "West"}, {"Chennai", "South"},
+        {"Bangalore", "South"}, {"Kolkata", "East"}, {"Hyderabad", "South"}};
+    double alertThreshold = 35.0; // Threshold temperature for alerts in Celsius
+    uint16_t metricsPort = 9464; // Prometheus scrape endpoint at http://127.0.0.1:9464/metrics
+    std::string metricsDumpPath = "weather_metrics.prom";
+    uint16_t queryPort = 8088; // Latest observations at http://127.0.0.1:8088/latest?cities=Delhi,Mumbai
+    std::string shardDir = "shards"; // Shared by the coordinator and its workers
+    auto pollInterval = std::chrono::seconds(300);
+    auto forecastInterval = std::chrono::seconds(3 * 3600); // Forecast runs are issued every 3 hours
+    std::string checkpointPath = "weather_checkpoint.bin"; // Workers use <shardDir>/worker-<id>.ckpt
+    auto checkpointInterval = std::chrono::seconds(60);
+    // rawData stays lossless: replay and history queries read it as the complete record. Set a mode
+    // (e.g. SwingingDoor, 0.1 °C / 1% humidity) to keep only the readings needed within tolerance.
+    StorageFilter::Config storageFilter;
+    storageFilter.mode = StorageFilter::Off;
+    AdaptivePollPlanner::Config polling; // Workers poll each city every 1-30 minutes as its weather demands
+    polling.enabled = true;
+    polling.requestsPerHour = 3600; // Shared by all workers, e.g. OpenWeatherMap's 60 calls/minute
+    polling.alertThreshold = alertThreshold;
+    ColumnarExporter::Config exportConfig; // Hourly row groups in exports/*-YYYY-MM-DD.parquet
+    WindowEngine::GapConfig gaps; // Day averages are time-weighted; a reading > 1.5 intervals late is a gap
+    gaps.expectedInterval = pollInterval.count();
+
+    // Sharded mode: --coordinator <workers> spawns workers; --worker <id> [shardDir] runs one
+    if (argc > 2 && std::string(argv[1]) == "--coordinator") {
+        ShardCoordinator coordinator(cities, shardDir);
+        coordinator.run(std::stoi(argv[2]), "/proc/self/exe");
+        return 0;
+    }
+    if (argc > 2 && std::string(argv[1]) == "--worker") {
+        int id = std::stoi(argv[2]);
+        metricsPort = static_cast<uint16_t>(metricsPort + 1 + id);
+        metricsDumpPath = "weather_metrics." + std::to_string(id) + ".prom";
+        MetricsExporter workerMetrics;
+        workerMetrics.serve(metricsPort);
+        workerMetrics.startPeriodicDump(metricsDumpPath, std::chrono::seconds(10));
+        return runShardWorker(id, argc > 3 ? argv[3] : shardDir, apiKey, alertThreshold, pollInterval,
+                              static_cast<uint16_t>(queryPort + 1 + id), cityRegions, checkpointInterval,
+                              storageFilter, forecastInterval, polling, exportConfig, gaps);
     }
-};
 
-// AlertManager class
-class AlertManager {
-public:
-    void checkForAlert(double currentTemp, const double threshold) {
-        if (currentTemp > threshold) {
-            std::cout << "Alert: Temperature exceeds threshold!" << std::endl;
-            // Additional code to send email notifications or logs
+    // Historical summary from rawData: --history <city|all> <from> <to> [days]
+    if (argc > 4 && std::string(argv[1]) == "--history") {
+        MongoDBHandler dbHandler;
+        HistoricalSummaryQuery history(&dbHandler);
+        std::string city = std::string(argv[2]) == "all" ? "" : argv[2];
+        int64_t from = std::stoll(argv[3]), to = std::stoll(argv[4]);
+        nlohmann::json out = nlohmann::json::object();
+        if (argc > 5 && std::string(argv[5]) == "days") {
+            for (const auto& day : history.summarizeDays(city, from, to)) out[std::to_string(day.first)] = day.second.toJson();
+        } else {
+            out = history.summarize(city, from, to).toJson();
         }
+        std::cout << out.dump(2) << std::endl;
+        return 0;
     }
-};
 
-// MongoDBHandler class
-class MongoDBHandler {
-public:
-    MongoDBHandler() {
-        mongocxx::instance instance{};
-        client = mongocxx::client{mongocxx::uri{"mongodb://localhost:27017"}};
-        db = client["weatherDB"];
+    MetricsExporter metricsExporter;
+    if (!metricsExporter.serve(metricsPort)) {
+        LOG_ERROR("Metrics endpoint unavailable on port {}", metricsPort);
     }
+    metricsExporter.startPeriodicDump(metricsDumpPath, std::chrono::seconds(10));
 
-    void storeWeatherData(const nlohmann::json& data) {
-        auto collection = db["rawData"];
-        bsoncxx::document::value doc_value = bsoncxx::from_json(data.dump());
-        collection.insert_one(doc_value.view());
+    MongoDBHandler dbHandler;
+    IngestWorker worker(&dbHandler, apiKey, alertThreshold);
+    worker.setStorageFilter(storageFilter);
+    worker.setGapConfig(gaps);
+    worker.setCities(cities, "");
+    for (const auto& entry : cityRegions) worker.setRegion(entry.first, entry.second);
+    LatestObservationStore latestStore(cities.size());
+    TemperatureLeaderboard leaderboard(cities.size());
+    worker.setLatestStore(&latestStore);
+    worker.setLeaderboard(&leaderboard);
+    ColumnarExporter exporter(exportConfig);
+    worker.setColumnarExporter(&exporter);
+    RangeAggregateIndex rangeIndex;
+    worker.setRangeIndex(&rangeIndex);
+    QueryApi queryApi(latestStore, queryPort, 4, &leaderboard, &rangeIndex);
+    if (!queryApi.start()) {
+        LOG_ERROR("Query endpoint unavailable on port {}", queryPort);
     }
 
-    void storeDailySummary(const WeatherAggregator::WeatherSummary& summary) {
-        auto collection = db["dailySummaries"];
-        bsoncxx::builder::stream::document document{};
-        document << "averageTemp" << summary.averageTemp
-                 << "maxTemp" << summary.maxTemp
-                 << "minTemp" << summary.minTemp
-                 << "dominantCondition" << summary.dominantCondition;
-        collection.insert_one(document.view());
+    // Resume today's in-flight state after a restart, then catch up from rawData
+    CheckpointManager checkpoints(checkpointPath);
+    if (checkpoints.restore(worker)) {
+        worker.setCities(cities, "");
+        size_t replayed = worker.replay(dbHandler.loadWeatherDataSince(worker.replayStartTime()));
+        LOG_INFO("Restored checkpoint; replayed {} observations", replayed);
     }
 
-private:
-    mongocxx::client client;
-    mongocxx::database db;
-};
-
-// Main function
-int main() {
-    std::string apiKey = "your_openweathermap_api_key"; // Replace with your actual API key
-    std::vector<std::string> cities = {"Delhi", "Mumbai", "Chennai", "Bangalore", "Kolkata", "Hyderabad"};
-    double alertThreshold = 35.0; // Threshold temperature for alerts in Celsius
-
-    MongoDBHandler dbHandler;
-    WeatherAggregator aggregator;
-    AlertManager alertManager;
-
-    // Fetch weather data for each city
-    std::vector<nlohmann::json> dailyData;
-    for (const auto& city : cities) {
-        auto data = WeatherDataFetcher::fetchWeatherData(city, apiKey);
-        dbHandler.storeWeatherData(data);
-        dailyData.push_back(data);
-        double currentTemp = data["main"]["temp"].get<double>() - 273.15; // Convert to Celsius
-        alertManager.checkForAlert(currentTemp, alertThreshold);
+    // Fetch current weather and the 5-day/3-hour forecast for each city
+    worker.runCycle();
+    worker.runForecastCycle();
+    if (!worker.hasData()) {
+        LOG_ERROR("No weather data fetched");
+        return 1;
     }
 
     // Calculate and store daily summary
-    auto summary = aggregator.calculateDailySummary(dailyData);
-    dbHandler.storeDailySummary(summary);
-
-    // Output daily summary
+    auto summary = worker.summarize();
+    DailyMetrics metrics = worker.summarizeMetrics();
+    dbHandler.storeDailySummary(summary, &metrics, static_cast<int64_t>(std::time(nullptr)) / 86400);
+    worker.clearState(); // Summarised; the checkpoint carries only what the next summary still needs
+    worker.flushStorage();
+    exporter.close();
+    checkpoints.checkpoint(worker);
+    checkpoints.wait();
+
+    // Output daily summary: program output goes to stdout, after the log lines queued so far
+    AsyncLogger::instance().flush();
     std::cout << "Daily Summary:\n"
               << "Average Temperature: " << summary.averageTemp << " °C\n"
               << "Max Temperature: " << summary.maxTemp << " °C\n"
               << "Min Temperature: " << summary.minTemp << " °C\n"
               << "Dominant Condition: " << summary.dominantCondition << "\n";
 
+    MetricsExporter::dumpToFile(metricsDumpPath);
     return 0;
 }
@@ -0,0 +1,517 @@
+// Tests for the in-memory stages: merge reproducibility, dedup and replay, storage filter
+// reconstruction, range index against a scan and Parquet round trips. Needs only nlohmann/json
+// and zlib (see README.MD for the build command); exits non-zero when a check fails.
+
+#include <zlib.h>
+#include <nlohmann/json.hpp>
+#include "../weather/aggregation.hpp"
+#include "../weather/binary_io.hpp"
+#include "../weather/dedup.hpp"
+#include "../weather/observation.hpp"
+#include "../weather/parquet.hpp"
+#include "../weather/range_index.hpp"
+#include "../weather/storage_filter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                          \
+    do {                                                                                          \
+        if (!(condition)) {                                                                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #condition << std::endl; \
+            ++failures;                                                                           \
+        }                                                                                         \
+    } while (0)
+
+static bool sameBits(double a, double b) { return std::memcmp(&a, &b, sizeof(double)) == 0; }
+
+// Merge reproducibility: the same batch gives the same bits for any thread count, and the
+// merged result agrees with a long double reference.
+static void testMergeReproducibility() {
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> kelvin(230.0, 320.0);
+    const char* conditions[] = {"Clear", "Clouds", "Rain", "Mist"};
+    ObservationBatch batch;
+    const size_t n = 5 * WeatherAggregator::kPartition + 12345; // Several partitions, a ragged last one
+    long double sum = 0, sumSquares = 0;
+    double lo = std::numeric_limits<double>::infinity(), hi = -lo;
+    for (size_t i = 0; i < n; ++i) {
+        batch.add(kelvin(rng), conditions[i % 7 % 4]);
+        double celsius = static_cast<double>(batch.tempKelvin.back()) - 273.15;
+        sum += celsius;
+        sumSquares += static_cast<long double>(celsius) * celsius;
+        lo = std::min(lo, celsius);
+        hi = std::max(hi, celsius);
+    }
+    batch.endCity();
+
+    PartialSummary reference = WeatherAggregator(1).aggregate(batch);
+    CHECK(reference.count == n);
+    for (unsigned threads : {2u, 3u, 8u}) {
+        PartialSummary partial = WeatherAggregator(threads).aggregate(batch);
+        CHECK(partial.count == reference.count);
+        CHECK(sameBits(partial.sum, reference.sum));
+        CHECK(sameBits(partial.compensation, reference.compensation));
+        CHECK(sameBits(partial.m2, reference.m2));
+        CHECK(sameBits(partial.min, reference.min));
+        CHECK(sameBits(partial.max, reference.max));
+        CHECK(partial.conditionNames == reference.conditionNames);
+        CHECK(partial.conditionCounts == reference.conditionCounts);
+    }
+
+    long double mean = sum / n;
+    long double variance = (sumSquares - sum * mean) / (n - 1);
+    CHECK(std::fabs(reference.mean() - static_cast<double>(mean)) < 1e-9);
+    CHECK(std::fabs(reference.variance() - static_cast<double>(variance)) < 1e-6 * static_cast<double>(variance));
+    CHECK(std::fabs(reference.min - lo) < 1e-9);
+    CHECK(std::fabs(reference.max - hi) < 1e-9);
+    CHECK(reference.dominantCondition() == "Clear"); // i % 7 % 4 == 0 for i % 7 in {0, 4}
+
+    // Merging into an empty summary and merging an empty one are both identities.
+    PartialSummary empty, copy = reference;
+    empty.merge(reference);
+    copy.merge(PartialSummary());
+    CHECK(sameBits(empty.total(), reference.total()) && empty.count == reference.count);
+    CHECK(sameBits(copy.total(), reference.total()) && copy.count == reference.count);
+}
+
+// Dedup and replay: repeated and replayed readings are dropped, genuinely new late readings
+// get through (up to the false positive rate), and a saved deduplicator remembers everything.
+static void testDedupReplay() {
+    const uint32_t cities = 1000;
+    const int readings = 50;
+    ObservationDeduplicator dedup(1 << 20, 0.001);
+    uint64_t accepted = 0;
+    for (int r = 0; r < readings; ++r) {
+        for (uint32_t city = 0; city < cities; ++city) {
+            int64_t dt = 1700000000 + r * 600;
+            accepted += dedup.accept(city, dt);
+            CHECK(!dedup.accept(city, dt)); // The next poll returns the same reading
+        }
+    }
+    CHECK(accepted == uint64_t{cities} * readings);
+
+    uint64_t replayed = 0;
+    for (uint32_t city = 0; city < cities; ++city) {
+        for (int r = 0; r < readings; ++r) replayed += dedup.accept(city, 1700000000 + r * 600);
+    }
+    CHECK(replayed == 0);
+
+    // Late readings between the ones already seen were never accepted before.
+    uint64_t late = 0;
+    for (uint32_t city = 0; city < cities; ++city) late += dedup.accept(city, 1700000000 + 300);
+    CHECK(late >= cities * 99 / 100);
+
+    std::FILE* file = std::tmpfile();
+    CHECK(file != nullptr);
+    if (!file) return;
+    BinaryWriter writer(file);
+    dedup.save(writer);
+    CHECK(writer.good());
+    std::string saved(static_cast<size_t>(std::ftell(file)), '\0');
+    std::rewind(file);
+    CHECK(std::fread(&saved[0], 1, saved.size(), file) == saved.size());
+    std::fclose(file);
+
+    ObservationDeduplicator restored(1 << 20, 0.001);
+    BinaryReader reader(saved);
+    restored.load(reader);
+    uint64_t afterRestore = 0;
+    for (uint32_t city = 0; city < cities; ++city) {
+        for (int r = 0; r < readings; ++r) afterRestore += restored.accept(city, 1700000000 + r * 600);
+    }
+    CHECK(afterRestore == 0);
+    CHECK(restored.accept(0, 1700000000 + readings * 600)); // Newer than anything seen
+}
+
+static nlohmann::json makeReading(int64_t dt, double tempC, double humidity) {
+    return {{"dt", dt}, {"main", {{"temp", tempC + 273.15}, {"humidity", humidity}}}, {"weather", {{{"main", "Clear"}}}}};
+}
+
+// Offers every reading of one city, flushes, and returns the stored documents sorted by dt.
+static std::vector<nlohmann::json> filterSeries(StorageFilter& filter, const std::vector<nlohmann::json>& series) {
+    std::vector<nlohmann::json> stored;
+    for (const auto& data : series) filter.offer(0, Observation::fromJson(data), data, stored);
+    filter.flushAll(stored);
+    std::sort(stored.begin(), stored.end(), [](const nlohmann::json& a, const nlohmann::json& b) {
+        return a["dt"].get<int64_t>() < b["dt"].get<int64_t>();
+    });
+    return stored;
+}
+
+// Storage filter reconstruction: every reading, stored or not, is rebuilt from the stored ones
+// within the configured tolerance, by holding (deadband) or interpolating (swinging door).
+static void testStorageFilterReconstruction() {
+    std::mt19937 rng(7);
+    std::normal_distribution<double> noise(0.0, 0.05);
+    std::vector<nlohmann::json> series;
+    for (int i = 0; i < 2000; ++i) {
+        double hours = i / 6.0;
+        series.push_back(makeReading(1700000000 + i * 600, 25 + 6 * std::sin(hours * M_PI / 12) + noise(rng),
+                                     60 + 20 * std::cos(hours * M_PI / 12) + 10 * noise(rng)));
+    }
+
+    for (StorageFilter::Mode mode : {StorageFilter::Deadband, StorageFilter::SwingingDoor}) {
+        StorageFilter::Config config;
+        config.mode = mode;
+        config.tolerance = {0.5, 3.0};
+        StorageFilter filter(config);
+        std::vector<nlohmann::json> stored = filterSeries(filter, series);
+        CHECK(stored.size() < series.size() / 2);
+        CHECK(stored.front()["dt"] == series.front()["dt"]);
+        if (mode == StorageFilter::SwingingDoor) CHECK(stored.back()["dt"] == series.back()["dt"]);
+
+        size_t next = 0; // First stored reading after the current one
+        double worst[2] = {0, 0};
+        for (const auto& data : series) {
+            Observation obs = Observation::fromJson(data);
+            while (next < stored.size() && stored[next]["dt"].get<int64_t>() <= obs.dt) ++next;
+            Observation before = Observation::fromJson(stored[next - 1]);
+            double values[2] = {obs.tempC, obs.humidity};
+            double rebuilt[2] = {before.tempC, before.humidity};
+            if (mode == StorageFilter::SwingingDoor && before.dt != obs.dt && next < stored.size()) {
+                Observation after = Observation::fromJson(stored[next]);
+                double t = static_cast<double>(obs.dt - before.dt) / static_cast<double>(after.dt - before.dt);
+                rebuilt[0] += t * (after.tempC - before.tempC);
+                rebuilt[1] += t * (after.humidity - before.humidity);
+            }
+            for (int m = 0; m < 2; ++m) worst[m] = std::max(worst[m], std::fabs(values[m] - rebuilt[m]));
+        }
+        CHECK(worst[0] <= config.tolerance[0] + 1e-9);
+        CHECK(worst[1] <= config.tolerance[1] + 1e-9);
+    }
+
+    // A late reading is stored as it is and does not disturb the held one.
+    StorageFilter::Config config;
+    config.mode = StorageFilter::SwingingDoor;
+    StorageFilter filter(config);
+    std::vector<nlohmann::json> stored =
+        filterSeries(filter, {makeReading(1000, 20, 50), makeReading(1060, 20, 50), makeReading(1120, 20, 50), makeReading(900, 25, 50)});
+    std::vector<int64_t> times;
+    for (const auto& data : stored) times.push_back(data["dt"].get<int64_t>());
+    CHECK((times == std::vector<int64_t>{900, 1000, 1120}));
+}
+
+// Range index against a scan: random readings, many of them out of order, then random ranges
+// compared with a scan over the same (float-rounded) readings.
+static void testRangeIndexMatchesScan() {
+    std::mt19937_64 rng(99);
+    RangeAggregateIndex index(0);
+    std::map<std::string, std::vector<std::pair<int64_t, float>>> readings;
+    const char* cities[] = {"Delhi", "Mumbai", "Chennai"};
+    const int64_t start = 1700000000;
+    std::uniform_real_distribution<double> temp(-10.0, 45.0);
+    std::uniform_int_distribution<int64_t> jitter(0, 40 * 86400);
+    for (int i = 0; i < 30000; ++i) {
+        const char* city = cities[i % 3];
+        // Mostly in order, a quarter anywhere in the last 40 days (including before the first)
+        int64_t dt = i % 4 == 0 ? start + (i / 3) * 300 - jitter(rng) : start + (i / 3) * 300;
+        double value = temp(rng);
+        index.add(city, dt, value);
+        readings[city].emplace_back(dt, static_cast<float>(value));
+    }
+    CHECK(index.readings() == 30000);
+
+    std::uniform_int_distribution<int64_t> point(start - 45 * 86400, start + 40 * 86400);
+    for (int q = 0; q < 3000; ++q) {
+        const char* city = cities[q % 3];
+        int64_t from = point(rng), to = point(rng);
+        if (q % 10 == 0) to = from; // Single instants
+        if (from > to) std::swap(from, to);
+        RangeAggregateIndex::Result result = index.query(city, from, to);
+        uint64_t count = 0;
+        double sum = 0, lo = std::numeric_limits<double>::infinity(), hi = -lo;
+        for (const auto& reading : readings[city]) {
+            if (reading.first < from || reading.first > to) continue;
+            ++count;
+            sum += reading.second;
+            lo = std::min<double>(lo, reading.second);
+            hi = std::max<double>(hi, reading.second);
+        }
+        CHECK(result.count == count);
+        CHECK(std::fabs(result.sum - sum) <= 1e-9 * std::max(1.0, std::fabs(sum)) + 1e-6);
+        if (count) CHECK(result.min == lo && result.max == hi);
+    }
+    CHECK(index.query("Nowhere", 0, start * 2).count == 0);
+}
+
+// Just enough of a Parquet reader to check ParquetWriter's output: a generic Thrift compact
+// decoder, PLAIN and RLE_DICTIONARY pages, and gzip inflation.
+struct ThriftValue {
+    int64_t integer = 0;
+    std::string binary;
+    std::vector<ThriftValue> list;
+    std::map<int16_t, ThriftValue> fields;
+
+    const ThriftValue& operator[](int16_t id) const {
+        auto it = fields.find(id);
+        if (it == fields.end()) throw std::runtime_error("missing Thrift field " + std::to_string(id));
+        return it->second;
+    }
+    bool has(int16_t id) const { return fields.count(id) != 0; }
+};
+
+class ThriftCompactReader {
+public:
+    ThriftCompactReader(const std::string& data, size_t pos) : data(data), pos(pos) {}
+
+    ThriftValue readStruct() {
+        ThriftValue value;
+        int16_t lastId = 0;
+        for (;;) {
+            uint8_t header = byte();
+            if (header == 0) return value;
+            int16_t id = header >> 4 ? static_cast<int16_t>(lastId + (header >> 4)) : static_cast<int16_t>(unzigzag(varint()));
+            value.fields[id] = read(header & 0x0F);
+            lastId = id;
+        }
+    }
+
+    size_t position() const { return pos; }
+
+private:
+    ThriftValue read(uint8_t type) {
+        ThriftValue value;
+        switch (type) {
+        case ThriftCompactWriter::True: value.integer = 1; break;
+        case ThriftCompactWriter::False: value.integer = 0; break;
+        case 3: case 4: case ThriftCompactWriter::I32: case ThriftCompactWriter::I64: value.integer = unzigzag(varint()); break;
+        case ThriftCompactWriter::Binary: {
+            size_t size = static_cast<size_t>(varint());
+            value.binary = data.substr(pos, size);
+            pos += size;
+            break;
+        }
+        case ThriftCompactWriter::List: {
+            uint8_t header = byte();
+            size_t size = header >> 4 == 15 ? static_cast<size_t>(varint()) : header >> 4;
+            for (size_t i = 0; i < size; ++i) value.list.push_back(read(header & 0x0F));
+            break;
+        }
+        case ThriftCompactWriter::Struct: value = readStruct(); break;
+        default: throw std::runtime_error("unexpected Thrift type " + std::to_string(type));
+        }
+        return value;
+    }
+
+    uint8_t byte() {
+        if (pos >= data.size()) throw std::runtime_error("Thrift data ends early");
+        return static_cast<uint8_t>(data[pos++]);
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t b = byte();
+            value |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return value;
+        }
+    }
+
+    static int64_t unzigzag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+    const std::string& data;
+    size_t pos;
+};
+
+static std::string gunzip(const std::string& compressed) {
+    z_stream stream{};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) throw std::runtime_error("inflateInit2 failed");
+    std::string out;
+    char buffer[1 << 14];
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+    stream.avail_in = static_cast<uInt>(compressed.size());
+    int status = Z_OK;
+    while (status == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+        status = inflate(&stream, Z_NO_FLUSH);
+        out.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END) throw std::runtime_error("gzip page does not inflate");
+    return out;
+}
+
+// One column of a Parquet file, every row group concatenated. Values are kept as their PLAIN
+// bytes (strings as the bytes themselves) so the test compares exactly what was written.
+struct ParquetColumn {
+    std::string name;
+    int32_t physicalType = 0;
+    std::vector<std::string> values;
+};
+
+static std::vector<ParquetColumn> readParquet(const std::string& path, int64_t& rows, size_t& rowGroups) {
+    std::ifstream in(path, std::ios::binary);
+    std::string file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (file.size() < 12 || file.compare(0, 4, "PAR1") != 0 || file.compare(file.size() - 4, 4, "PAR1") != 0) {
+        throw std::runtime_error("not a Parquet file");
+    }
+    uint32_t footerLength;
+    std::memcpy(&footerLength, file.data() + file.size() - 8, 4);
+    ThriftValue meta = ThriftCompactReader(file, file.size() - 8 - footerLength).readStruct();
+
+    std::vector<ParquetColumn> columns;
+    const auto& schema = meta[2].list;
+    for (size_t c = 1; c < schema.size(); ++c) {
+        columns.push_back({schema[c][4].binary, static_cast<int32_t>(schema[c][1].integer), {}});
+    }
+    rows = meta[3].integer;
+    rowGroups = meta[4].list.size();
+    for (const auto& group : meta[4].list) {
+        const auto& chunks = group[1].list;
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            const ThriftValue& chunk = chunks[c][3];
+            bool gzip = chunk[4].integer == 2;
+            int64_t remaining = chunk[5].integer;
+            size_t pos = static_cast<size_t>(chunk.has(11) ? chunk[11].integer : chunk[9].integer);
+            std::vector<std::string> dictionary;
+            while (remaining > 0) {
+                ThriftCompactReader reader(file, pos);
+                ThriftValue header = reader.readStruct();
+                pos = reader.position();
+                std::string body = file.substr(pos, static_cast<size_t>(header[3].integer));
+                pos += body.size();
+                if (gzip) body = gunzip(body);
+                if (body.size() != static_cast<size_t>(header[2].integer)) throw std::runtime_error("page size mismatch");
+                bool isDictionary = header[1].integer == 2;
+                const ThriftValue& pageInfo = header[isDictionary ? 7 : 5];
+                size_t count = static_cast<size_t>(pageInfo[1].integer);
+                if (isDictionary) {
+                    for (size_t at = 0, i = 0; i < count; ++i) {
+                        uint32_t size;
+                        std::memcpy(&size, body.data() + at, 4);
+                        dictionary.push_back(body.substr(at + 4, size));
+                        at += 4 + size;
+                    }
+                    continue;
+                }
+                auto& values = columns[c].values;
+                if (pageInfo[2].integer == 8) { // RLE_DICTIONARY: bit width, then the hybrid runs
+                    int bitWidth = static_cast<uint8_t>(body[0]);
+                    size_t at = 1, produced = 0;
+                    while (produced < count) {
+                        uint64_t runHeader = 0;
+                        for (int shift = 0;; shift += 7) {
+                            uint8_t b = static_cast<uint8_t>(body.at(at++));
+                            runHeader |= static_cast<uint64_t>(b & 0x7F) << shift;
+                            if (!(b & 0x80)) break;
+                        }
+                        if (runHeader & 1) { // Bit-packed groups of 8
+                            size_t n = static_cast<size_t>(runHeader >> 1) * 8;
+                            uint64_t bits = 0;
+                            int available = 0;
+                            for (size_t i = 0; i < n; ++i) {
+                                while (available < bitWidth) bits |= static_cast<uint64_t>(static_cast<uint8_t>(body.at(at++))) << available, available += 8;
+                                uint32_t code = static_cast<uint32_t>(bits & ((uint64_t{1} << bitWidth) - 1));
+                                bits >>= bitWidth, available -= bitWidth;
+                                if (produced < count) values.push_back(dictionary.at(code)), ++produced;
+                            }
+                        } else {
+                            uint32_t code = 0;
+                            for (int b = 0; b < (bitWidth + 7) / 8; ++b) code |= static_cast<uint32_t>(static_cast<uint8_t>(body.at(at++))) << (8 * b);
+                            for (uint64_t i = 0; i < runHeader >> 1 && produced < count; ++i) values.push_back(dictionary.at(code)), ++produced;
+                        }
+                    }
+                } else {
+                    size_t width = columns[c].physicalType == 1 ? 4 : 8;
+                    if (body.size() != count * width) throw std::runtime_error("PLAIN page size mismatch");
+                    for (size_t i = 0; i < count; ++i) values.push_back(body.substr(i * width, width));
+                }
+                remaining -= static_cast<int64_t>(count);
+            }
+        }
+    }
+    return columns;
+}
+
+template <class T>
+static std::string plainBytes(T value) {
+    return std::string(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Parquet round trip: what ParquetWriter writes reads back value for value, with and without
+// gzip, across row groups, for every column type including dictionary runs and NaN.
+static void testParquetRoundTrip() {
+    std::string path = "weather_tests_" + std::to_string(getpid()) + ".parquet";
+    for (bool compress : {false, true}) {
+        std::vector<std::string> cities, expectedDt, expectedTemp, expectedDay;
+        {
+            ParquetWriter writer(path, {{"city", ParquetWriter::Type::String}, {"dt", ParquetWriter::Type::Int64},
+                                        {"temp", ParquetWriter::Type::Double}, {"day", ParquetWriter::Type::Date}},
+                                 compress);
+            CHECK(writer.ok());
+            const char* names[] = {"Delhi", "Mumbai", "Chennai", "Bengaluru", "São Paulo"};
+            for (int i = 0; i < 5000; ++i) {
+                // Long runs of one city (RLE runs) alternate with short mixed stretches (bit-packed)
+                std::string city = i % 1000 < 600 ? names[(i / 1000) % 5] : names[i % 5];
+                int64_t dt = 1700000000 + int64_t{i} * 600 - (i % 3 == 0 ? 86400 : 0);
+                double temp = i == 17 ? std::numeric_limits<double>::quiet_NaN() : -20.0 + i * 0.0137;
+                int64_t day = dt / 86400;
+                writer.add(0, city);
+                writer.add(1, dt);
+                writer.add(2, temp);
+                writer.add(3, day);
+                cities.push_back(city);
+                expectedDt.push_back(plainBytes(dt));
+                expectedTemp.push_back(plainBytes(temp));
+                expectedDay.push_back(plainBytes(static_cast<int32_t>(day)));
+                if (i == 2999) CHECK(writer.flush());
+            }
+            CHECK(writer.close());
+        }
+        int64_t rows = 0;
+        size_t rowGroups = 0;
+        std::vector<ParquetColumn> columns;
+        try {
+            columns = readParquet(path, rows, rowGroups);
+        } catch (const std::exception& e) {
+            std::cerr << "reading " << path << ": " << e.what() << std::endl;
+            ++failures;
+        }
+        std::remove(path.c_str());
+        if (columns.size() != 4) {
+            CHECK(columns.size() == 4);
+            continue;
+        }
+        CHECK(rows == 5000);
+        CHECK(rowGroups == 2);
+        CHECK(columns[0].name == "city" && columns[1].name == "dt" && columns[2].name == "temp" && columns[3].name == "day");
+        CHECK(columns[0].values == cities);
+        CHECK(columns[1].values == expectedDt);
+        CHECK(columns[2].values == expectedTemp);
+        CHECK(columns[3].values == expectedDay);
+    }
+}
+
+int main() {
+    const std::vector<std::pair<const char*, std::function<void()>>> tests = {
+        {"merge reproducibility", testMergeReproducibility},
+        {"dedup and replay", testDedupReplay},
+        {"storage filter reconstruction", testStorageFilterReconstruction},
+        {"range index matches scan", testRangeIndexMatchesScan},
+        {"parquet round trip", testParquetRoundTrip},
+    };
+    for (const auto& test : tests) {
+        int before = failures;
+        test.second();
+        std::cout << (failures == before ? "PASS " : "FAIL ") << test.first << std::endl;
+    }
+    if (failures) std::cout << failures << " check(s) failed" << std::endl;
+    return failures ? 1 : 0;
+}
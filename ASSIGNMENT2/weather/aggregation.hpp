@@ -0,0 +1,401 @@
+// Daily aggregation: struct-of-arrays batches, SIMD summary kernels and mergeable partial summaries.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "metrics.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define WEATHER_HAVE_AVX2_KERNELS 1
+#endif
+
+// ObservationBatch: struct-of-arrays buffer of observations grouped by city, read by the
+// summary kernels instead of walking JSON documents.
+struct ObservationBatch {
+    std::vector<float> tempKelvin;
+    std::vector<uint8_t> condition;         // Index into conditionNames
+    std::vector<std::string> conditionNames;
+    std::vector<uint32_t> cityOffsets{0};   // City i spans [cityOffsets[i], cityOffsets[i + 1])
+
+    void add(double kelvin, const std::string& name) {
+        tempKelvin.push_back(static_cast<float>(kelvin));
+        condition.push_back(internCondition(name));
+    }
+
+    void add(const nlohmann::json& entry) {
+        add(entry["main"]["temp"].get<double>(), entry["weather"][0]["main"].get<std::string>());
+    }
+
+    // Closes the current city's segment.
+    void endCity() { cityOffsets.push_back(static_cast<uint32_t>(tempKelvin.size())); }
+
+    size_t size() const { return tempKelvin.size(); }
+    size_t cityCount() const { return cityOffsets.size() - 1; }
+
+    void clear() {
+        tempKelvin.clear();
+        condition.clear();
+        cityOffsets.assign(1, 0);
+    }
+
+private:
+    // Only a handful of conditions exist, so a linear scan beats hashing.
+    uint8_t internCondition(const std::string& name) {
+        for (size_t i = 0; i < conditionNames.size(); ++i) {
+            if (conditionNames[i] == name) return static_cast<uint8_t>(i);
+        }
+        if (conditionNames.size() == 255) return 254; // Folded into the last slot
+        conditionNames.push_back(name);
+        return static_cast<uint8_t>(conditionNames.size() - 1);
+    }
+};
+
+// SummaryKernels: sum/min/max/variance and Kelvin-to-Celsius over contiguous float or
+// fixed-point (centi-Kelvin) temperature arrays. AVX2 versions are picked at run time when
+// the CPU has them; the scalar versions are the fallback. Sums are taken in double around a
+// shift (the first value), so the variance does not suffer from cancellation.
+class SummaryKernels {
+public:
+    struct Moments {
+        uint64_t count = 0;
+        double sum = 0;
+        double m2 = 0; // Sum of squared deviations from the mean
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+
+        double mean() const { return count ? sum / count : 0; }
+        double variance() const { return count > 1 ? m2 / (count - 1) : 0; }
+    };
+
+    static bool avx2Available() {
+#ifdef WEATHER_HAVE_AVX2_KERNELS
+        static const bool available = __builtin_cpu_supports("avx2");
+        return available && !forceScalar();
+#else
+        return false;
+#endif
+    }
+
+    // Benchmarks use this to compare against the scalar path.
+    static void setForceScalar(bool on) { forceScalar() = on; }
+
+    static void kelvinToCelsius(const float* kelvin, float* celsius, size_t n) {
+#ifdef WEATHER_HAVE_AVX2_KERNELS
+        if (avx2Available()) return kelvinToCelsiusAvx2(kelvin, celsius, n);
+#endif
+        for (size_t i = 0; i < n; ++i) celsius[i] = kelvin[i] - 273.15f;
+    }
+
+    // Moments of values[0..n) after adding offset to each (pass -273.15 to get Celsius from Kelvin).
+    static Moments reduce(const float* values, size_t n, double offset = 0) {
+        if (n == 0) return {};
+#ifdef WEATHER_HAVE_AVX2_KERNELS
+        if (avx2Available()) return reduceAvx2(values, n, offset);
+#endif
+        double shift = values[0], s1 = 0, s2 = 0;
+        float lo = values[0], hi = values[0];
+        for (size_t i = 0; i < n; ++i) {
+            double d = values[i] - shift;
+            s1 += d;
+            s2 += d * d;
+            lo = std::min(lo, values[i]);
+            hi = std::max(hi, values[i]);
+        }
+        return finish(n, shift, s1, s2, lo, hi, offset);
+    }
+
+    // Fixed-point variant: values in hundredths, e.g. centi-Kelvin. Sums are exact integers.
+    static Moments reduceFixed(const int32_t* values, size_t n, double offset = 0) {
+        if (n == 0) return {};
+        int64_t shift = values[0], s1 = 0, s2 = 0;
+        int32_t lo = values[0], hi = values[0];
+        size_t i = 0;
+#ifdef WEATHER_HAVE_AVX2_KERNELS
+        if (avx2Available()) i = reduceFixedAvx2(values, n, static_cast<int32_t>(shift), s1, s2, lo, hi);
+#endif
+        for (; i < n; ++i) {
+            int64_t d = values[i] - shift;
+            s1 += d;
+            s2 += d * d;
+            lo = std::min(lo, values[i]);
+            hi = std::max(hi, values[i]);
+        }
+        Moments m;
+        m.count = n;
+        m.sum = (static_cast<double>(shift) * n + s1) / 100.0 + offset * n;
+        m.m2 = (static_cast<double>(s2) - static_cast<double>(s1) * s1 / n) / 10000.0;
+        m.min = lo / 100.0 + offset;
+        m.max = hi / 100.0 + offset;
+        return m;
+    }
+
+    // Segmented reduction: one Moments per segment [offsets[i], offsets[i + 1]).
+    static void reduceSegments(const float* values, const uint32_t* offsets, size_t segments, Moments* out,
+                               double offset = 0) {
+        for (size_t i = 0; i < segments; ++i) out[i] = reduce(values + offsets[i], offsets[i + 1] - offsets[i], offset);
+    }
+
+private:
+    static bool& forceScalar() {
+        static bool force = false;
+        return force;
+    }
+
+    static Moments finish(size_t n, double shift, double s1, double s2, float lo, float hi, double offset) {
+        Moments m;
+        m.count = n;
+        m.sum = shift * n + s1 + offset * n;
+        m.m2 = std::max(0.0, s2 - s1 * s1 / n);
+        m.min = lo + offset;
+        m.max = hi + offset;
+        return m;
+    }
+
+#ifdef WEATHER_HAVE_AVX2_KERNELS
+    __attribute__((target("avx2"))) static void kelvinToCelsiusAvx2(const float* kelvin, float* celsius, size_t n) {
+        const __m256 zero = _mm256_set1_ps(273.15f);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) _mm256_storeu_ps(celsius + i, _mm256_sub_ps(_mm256_loadu_ps(kelvin + i), zero));
+        for (; i < n; ++i) celsius[i] = kelvin[i] - 273.15f;
+    }
+
+    __attribute__((target("avx2"))) static Moments reduceAvx2(const float* values, size_t n, double offset) {
+        const double shift = values[0];
+        const __m256d k = _mm256_set1_pd(shift);
+        __m256 lo = _mm256_set1_ps(values[0]), hi = lo;
+        __m256d s1a = _mm256_setzero_pd(), s1b = s1a, s2a = s1a, s2b = s1a;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_loadu_ps(values + i);
+            lo = _mm256_min_ps(lo, v);
+            hi = _mm256_max_ps(hi, v);
+            __m256d a = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), k);
+            __m256d b = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), k);
+            s1a = _mm256_add_pd(s1a, a);
+            s1b = _mm256_add_pd(s1b, b);
+            s2a = _mm256_add_pd(s2a, _mm256_mul_pd(a, a));
+            s2b = _mm256_add_pd(s2b, _mm256_mul_pd(b, b));
+        }
+        alignas(32) double d1[4], d2[4];
+        alignas(32) float fl[8], fh[8];
+        _mm256_store_pd(d1, _mm256_add_pd(s1a, s1b));
+        _mm256_store_pd(d2, _mm256_add_pd(s2a, s2b));
+        _mm256_store_ps(fl, lo);
+        _mm256_store_ps(fh, hi);
+        double s1 = (d1[0] + d1[1]) + (d1[2] + d1[3]);
+        double s2 = (d2[0] + d2[1]) + (d2[2] + d2[3]);
+        float mn = *std::min_element(fl, fl + 8), mx = *std::max_element(fh, fh + 8);
+        for (; i < n; ++i) {
+            double d = values[i] - shift;
+            s1 += d;
+            s2 += d * d;
+            mn = std::min(mn, values[i]);
+            mx = std::max(mx, values[i]);
+        }
+        return finish(n, shift, s1, s2, mn, mx, offset);
+    }
+
+    // Processes whole blocks of 8 and returns how many values it consumed.
+    __attribute__((target("avx2"))) static size_t reduceFixedAvx2(const int32_t* values, size_t n, int32_t shift,
+                                                                   int64_t& s1, int64_t& s2, int32_t& lo, int32_t& hi) {
+        const __m256i k = _mm256_set1_epi32(shift);
+        __m256i vlo = _mm256_set1_epi32(lo), vhi = vlo;
+        __m256i sum = _mm256_setzero_si256(), squares = sum;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+            vlo = _mm256_min_epi32(vlo, v);
+            vhi = _mm256_max_epi32(vhi, v);
+            __m256i d = _mm256_sub_epi32(v, k);
+            sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(d)));
+            sum = _mm256_add_epi64(sum, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(d, 1)));
+            squares = _mm256_add_epi64(squares, _mm256_mul_epi32(d, d));                         // Even lanes
+            squares = _mm256_add_epi64(squares, _mm256_mul_epi32(_mm256_srli_epi64(d, 32),        // Odd lanes
+                                                                  _mm256_srli_epi64(d, 32)));
+        }
+        alignas(32) int64_t sums[4], sq[4];
+        alignas(32) int32_t l[8], h[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(sums), sum);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(sq), squares);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(l), vlo);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(h), vhi);
+        s1 += sums[0] + sums[1] + sums[2] + sums[3];
+        s2 += sq[0] + sq[1] + sq[2] + sq[3];
+        lo = *std::min_element(l, l + 8);
+        hi = *std::max_element(h, h + 8);
+        return i;
+    }
+#endif
+};
+
+// PartialSummary: mergeable summary of a slice of observations (count, compensated sum, min,
+// max, M2 and condition counts). Merging is Chan's pairwise update for M2 and Neumaier
+// summation for the sum, so merging in a fixed order gives the same bits every time.
+struct PartialSummary {
+    uint64_t count = 0;
+    double sum = 0;
+    double compensation = 0; // Low-order bits lost from sum
+    double m2 = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    std::vector<std::string> conditionNames;
+    std::vector<uint64_t> conditionCounts;
+
+    double total() const { return sum + compensation; }
+    double mean() const { return count ? total() / count : 0; }
+    double variance() const { return count > 1 ? m2 / (count - 1) : 0; }
+
+    void addSum(double value) {
+        double next = sum + value;
+        compensation += std::fabs(sum) >= std::fabs(value) ? (sum - next) + value : (value - next) + sum;
+        sum = next;
+    }
+
+    void addCondition(const std::string& name, uint64_t by) {
+        for (size_t i = 0; i < conditionNames.size(); ++i) {
+            if (conditionNames[i] == name) {
+                conditionCounts[i] += by;
+                return;
+            }
+        }
+        conditionNames.push_back(name);
+        conditionCounts.push_back(by);
+    }
+
+    void merge(const PartialSummary& other) {
+        if (other.count == 0) return;
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+        double delta = other.mean() - mean();
+        uint64_t merged = count + other.count;
+        m2 += other.m2 + delta * delta * (static_cast<double>(count) * other.count / merged);
+        addSum(other.sum);
+        addSum(other.compensation);
+        count = merged;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        for (size_t i = 0; i < other.conditionNames.size(); ++i) addCondition(other.conditionNames[i], other.conditionCounts[i]);
+    }
+
+    // Most frequent condition; ties go to the name that sorts first.
+    std::string dominantCondition() const {
+        size_t best = 0;
+        for (size_t i = 1; i < conditionCounts.size(); ++i) {
+            if (conditionCounts[i] > conditionCounts[best] ||
+                (conditionCounts[i] == conditionCounts[best] && conditionNames[i] < conditionNames[best])) {
+                best = i;
+            }
+        }
+        return conditionCounts.empty() ? "" : conditionNames[best];
+    }
+};
+
+// WeatherAggregator class
+class WeatherAggregator {
+public:
+    struct WeatherSummary {
+        double averageTemp;
+        double maxTemp;
+        double minTemp;
+        std::string dominantCondition;
+    };
+
+    WeatherSummary calculateDailySummary(const std::vector<nlohmann::json>& dailyData) {
+        ObservationBatch batch;
+        for (const auto& entry : dailyData) batch.add(entry);
+        batch.endCity();
+        return calculateSummary(batch);
+    }
+
+    // Observations per partition. Partitions do not depend on the thread count, and partials
+    // are merged in a fixed tree over partition order, so results are the same bits for any
+    // number of threads.
+    static constexpr size_t kPartition = 1 << 16;
+
+    explicit WeatherAggregator(unsigned threads = 1) : threads(std::max(1u, threads)) {}
+
+    void setThreads(unsigned count) { threads = std::max(1u, count); }
+
+    // Summary over every observation in the batch, converted from Kelvin to Celsius.
+    WeatherSummary calculateSummary(const ObservationBatch& batch) {
+        PartialSummary partial = aggregate(batch);
+        if (partial.count == 0) return {0, 0, 0, ""};
+        return {partial.mean(), partial.max, partial.min, partial.dominantCondition()};
+    }
+
+    // Per-partition partials computed on up to `threads` threads, then merged pairwise,
+    // one tree level at a time, also in parallel.
+    PartialSummary aggregate(const ObservationBatch& batch) {
+        ScopedStageTimer timer(PipelineMetrics::Aggregate);
+        size_t partitions = (batch.size() + kPartition - 1) / kPartition;
+        if (partitions == 0) return {};
+        std::vector<PartialSummary> partials(partitions);
+        parallelFor(partitions, [&](size_t p) {
+            size_t begin = p * kPartition, end = std::min(batch.size(), begin + kPartition);
+            partials[p] = aggregatePartition(batch, begin, end);
+        });
+        for (size_t stride = 1; stride < partitions; stride *= 2) {
+            parallelFor((partitions + 2 * stride - 1) / (2 * stride), [&](size_t pair) {
+                size_t left = pair * 2 * stride;
+                if (left + stride < partitions) partials[left].merge(partials[left + stride]);
+            });
+        }
+        return partials[0];
+    }
+
+    // Per-city moments over the batch's city segments, in Celsius.
+    std::vector<SummaryKernels::Moments> calculateCityMoments(const ObservationBatch& batch) {
+        ScopedStageTimer timer(PipelineMetrics::Aggregate);
+        std::vector<SummaryKernels::Moments> moments(batch.cityCount());
+        SummaryKernels::reduceSegments(batch.tempKelvin.data(), batch.cityOffsets.data(), batch.cityCount(),
+                                       moments.data(), -273.15);
+        return moments;
+    }
+
+private:
+    static PartialSummary aggregatePartition(const ObservationBatch& batch, size_t begin, size_t end) {
+        auto moments = SummaryKernels::reduce(batch.tempKelvin.data() + begin, end - begin, -273.15);
+        PartialSummary partial;
+        partial.count = moments.count;
+        partial.addSum(moments.sum);
+        partial.m2 = moments.m2;
+        partial.min = moments.min;
+        partial.max = moments.max;
+        std::vector<uint64_t> counts(batch.conditionNames.size());
+        for (size_t i = begin; i < end; ++i) counts[batch.condition[i]]++;
+        for (size_t c = 0; c < counts.size(); ++c) {
+            if (counts[c]) partial.addCondition(batch.conditionNames[c], counts[c]);
+        }
+        return partial;
+    }
+
+    // Runs body(0..count) on up to `threads` threads, handing out indices dynamically.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body) {
+        size_t workers = std::min<size_t>(threads, count);
+        if (workers <= 1) {
+            for (size_t i = 0; i < count; ++i) body(i);
+            return;
+        }
+        std::atomic<size_t> next{0};
+        auto run = [&] {
+            for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) body(i);
+        };
+        std::vector<std::thread> pool;
+        for (size_t w = 1; w < workers; ++w) pool.emplace_back(run);
+        run();
+        for (auto& thread : pool) thread.join();
+    }
+
+    unsigned threads;
+};
@@ -0,0 +1,31 @@
+// Threshold, anomaly and predicted-breach alerts.
+#pragma once
+
+#include "../../common/async_logger.hpp"
+#include "metrics.hpp"
+#include <cstdint>
+#include <string>
+
+// AlertManager class
+// Alerts are the system's output, not diagnostics: they go through LOG_ALERT, so every one is
+// written even when many cities alert at once.
+class AlertManager {
+public:
+    void checkForAlert(double currentTemp, const double threshold) {
+        ScopedStageTimer timer(PipelineMetrics::AlertCheck);
+        if (currentTemp > threshold) {
+            LOG_ALERT("Alert: Temperature exceeds threshold! ({} °C)", currentTemp);
+            // Additional code to send email notifications or logs
+        }
+    }
+
+    void raiseAnomaly(const std::string& city, double currentTemp, double zScore) {
+        LOG_ALERT("Alert: Unusual temperature for {}: {} °C (z-score {})", city, currentTemp, zScore);
+    }
+
+    void raisePredictedBreach(const std::string& city, double currentTemp, double threshold, int64_t secondsToBreach,
+                              double slopePerHour) {
+        LOG_ALERT("Alert: {} is on course to exceed {} °C in about {} min ({} °C now, rising {} °C/h)", city, threshold,
+                  secondsToBreach / 60, currentTemp, slopePerHour);
+    }
+};
@@ -0,0 +1,125 @@
+// Streaming per-city, per-hour temperature anomaly scores.
+#pragma once
+
+#include "binary_io.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// AnomalyDetector class
+// Streaming per-city anomaly detection on EWMA mean and variance. Each city keeps a global
+// baseline plus one baseline per local hour of day; the hourly one is used once it has
+// warmed up, so a warm afternoon is compared against previous afternoons.
+// State is fixed-size per city and stored structure-of-arrays, indexed by CityRegistry id.
+class AnomalyDetector {
+public:
+    static constexpr int kHours = 24;
+
+    explicit AnomalyDetector(float alpha = 0.05f, float zThreshold = 3.0f, uint8_t warmupSamples = 12)
+        : alpha(alpha), zThreshold(zThreshold), warmupSamples(warmupSamples) {}
+
+    void reserve(size_t cities) {
+        mean.reserve(cities);
+        variance.reserve(cities);
+        samples.reserve(cities);
+        hourMean.reserve(cities * kHours);
+        hourVariance.reserve(cities * kHours);
+        hourSamples.reserve(cities * kHours);
+    }
+
+    // Scores the observation against the baseline, then folds it in. Returns the z-score,
+    // or 0 while the baseline is still warming up.
+    float update(uint32_t city, float temp, int hourOfDay) {
+        if (city >= mean.size()) grow(city + 1);
+        size_t slot = static_cast<size_t>(city) * kHours + hourOfDay;
+
+        float z = 0;
+        if (hourSamples[slot] >= warmupSamples) {
+            z = score(temp, hourMean[slot], hourVariance[slot]);
+        } else if (samples[city] >= warmupSamples) {
+            z = score(temp, mean[city], variance[city]);
+        }
+
+        fold(temp, mean[city], variance[city], samples[city]);
+        fold(temp, hourMean[slot], hourVariance[slot], hourSamples[slot]);
+        return z;
+    }
+
+    bool isAnomalous(float zScore) const { return std::fabs(zScore) >= zThreshold; }
+
+    size_t memoryBytes() const {
+        return mean.capacity() * sizeof(float) + variance.capacity() * sizeof(float) + samples.capacity() +
+               hourMean.capacity() * sizeof(float) + hourVariance.capacity() * sizeof(float) + hourSamples.capacity();
+    }
+
+    void save(BinaryWriter& out) const {
+        out.podVector(mean);
+        out.podVector(variance);
+        out.podVector(samples);
+        out.podVector(hourMean);
+        out.podVector(hourVariance);
+        out.podVector(hourSamples);
+    }
+
+    void load(BinaryReader& in) {
+        mean = in.podVector<float>();
+        variance = in.podVector<float>();
+        samples = in.podVector<uint8_t>();
+        hourMean = in.podVector<float>();
+        hourVariance = in.podVector<float>();
+        hourSamples = in.podVector<uint8_t>();
+        if (variance.size() != mean.size() || samples.size() != mean.size() || hourMean.size() != mean.size() * kHours ||
+            hourVariance.size() != hourMean.size() || hourSamples.size() != hourMean.size()) {
+            throw std::runtime_error("checkpoint anomaly state is inconsistent");
+        }
+    }
+
+    // Local hour of an OpenWeatherMap observation (dt is UTC, timezone is the offset in seconds).
+    static int hourOfDay(int64_t dt, int64_t timezoneOffset) {
+        int64_t local = (dt + timezoneOffset) % 86400;
+        if (local < 0) local += 86400;
+        return static_cast<int>(local / 3600);
+    }
+
+private:
+    // Variance floor (°C^2) so a perfectly flat history does not turn noise into alerts.
+    static constexpr float kMinVariance = 0.25f;
+
+    static float score(float x, float m, float v) { return (x - m) / std::sqrt(std::max(v, kMinVariance)); }
+
+    // Incremental EWMA mean and variance; the first sample seeds the mean.
+    void fold(float x, float& m, float& v, uint8_t& n) const {
+        if (n == 0) {
+            m = x;
+            v = 0;
+        } else {
+            float diff = x - m;
+            float increment = alpha * diff;
+            m += increment;
+            v = (1 - alpha) * (v + diff * increment);
+        }
+        if (n < 255) ++n;
+    }
+
+    void grow(size_t cities) {
+        mean.resize(cities);
+        variance.resize(cities);
+        samples.resize(cities);
+        hourMean.resize(cities * kHours);
+        hourVariance.resize(cities * kHours);
+        hourSamples.resize(cities * kHours);
+    }
+
+    float alpha;
+    float zThreshold;
+    uint8_t warmupSamples;
+    std::vector<float> mean;
+    std::vector<float> variance;
+    std::vector<uint8_t> samples;
+    std::vector<float> hourMean;
+    std::vector<float> hourVariance;
+    std::vector<uint8_t> hourSamples;
+};
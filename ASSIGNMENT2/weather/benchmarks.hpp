@@ -0,0 +1,7 @@
+// Benchmarks run by ./weather_data_aggregator --bench <name>; defined in benchmarks.cpp.
+#pragma once
+
+#include <string>
+
+// Function to run a named benchmark; returns the process exit code
+int runBenchmark(const std::string& name);
@@ -0,0 +1,79 @@
+// Compact binary encoding used by checkpoints.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// BinaryWriter / BinaryReader: little helpers for the compact checkpoint format.
+// Values are written in host byte order; checkpoints are not meant to move between machines.
+class BinaryWriter {
+public:
+    explicit BinaryWriter(std::FILE* file) : file(file) {}
+
+    template <class T>
+    void pod(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "pod() needs a trivially copyable type");
+        ok = ok && std::fwrite(&value, sizeof(T), 1, file) == 1;
+    }
+
+    template <class T>
+    void podVector(const std::vector<T>& values) {
+        pod<uint64_t>(values.size());
+        if (!values.empty()) ok = ok && std::fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+    }
+
+    void str(const std::string& value) {
+        pod<uint32_t>(static_cast<uint32_t>(value.size()));
+        ok = ok && std::fwrite(value.data(), 1, value.size(), file) == value.size();
+    }
+
+    bool good() const { return ok; }
+
+private:
+    std::FILE* file;
+    bool ok = true;
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(const std::string& data) : data(data) {}
+
+    template <class T>
+    T pod() {
+        T value;
+        take(&value, sizeof(T));
+        return value;
+    }
+
+    template <class T>
+    std::vector<T> podVector() {
+        uint64_t size = pod<uint64_t>();
+        if (size > (data.size() - offset) / sizeof(T)) throw std::runtime_error("checkpoint truncated");
+        std::vector<T> values(size);
+        if (size) take(values.data(), size * sizeof(T));
+        return values;
+    }
+
+    std::string str() {
+        uint32_t size = pod<uint32_t>();
+        if (size > data.size() - offset) throw std::runtime_error("checkpoint truncated");
+        std::string value = data.substr(offset, size);
+        offset += size;
+        return value;
+    }
+
+private:
+    void take(void* out, size_t size) {
+        if (size > data.size() - offset) throw std::runtime_error("checkpoint truncated");
+        std::memcpy(out, data.data() + offset, size);
+        offset += size;
+    }
+
+    const std::string& data;
+    size_t offset = 0;
+};
@@ -0,0 +1,95 @@
+// Forked background checkpoints of a worker's in-memory state.
+#pragma once
+
+#include "../../common/async_logger.hpp"
+#include "metrics.hpp"
+#include "binary_io.hpp"
+#include "ingest_worker.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// CheckpointManager class
+// Fork-based snapshots of an IngestWorker: the parent only pays for fork() (copy-on-write page
+// tables), while the child writes the compact binary file, fsyncs it and renames it into place.
+class CheckpointManager {
+public:
+    static constexpr uint32_t kMagic = 0x504b4357; // "WCKP"
+    static constexpr uint32_t kVersion = 4;
+
+    explicit CheckpointManager(std::string path) : path(std::move(path)) {}
+
+    ~CheckpointManager() {
+        if (child > 0) waitpid(child, nullptr, 0);
+    }
+
+    // Starts a snapshot unless the previous one is still being written. Returns false if skipped.
+    bool checkpoint(const IngestWorker& worker) {
+        if (child > 0) {
+            if (waitpid(child, nullptr, WNOHANG) == 0) return false;
+            child = -1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        pid_t pid = fork();
+        if (pid == 0) _exit(writeSnapshot(worker, path) ? 0 : 1);
+        lastPause = std::chrono::steady_clock::now() - start;
+        PipelineMetrics::recordStage(PipelineMetrics::CheckpointPause,
+                                     std::chrono::duration_cast<std::chrono::nanoseconds>(lastPause).count());
+        if (pid < 0) return writeSnapshot(worker, path); // no fork available: write inline
+        child = pid;
+        return true;
+    }
+
+    // Waits for an in-flight snapshot; true if it was written successfully.
+    bool wait() {
+        if (child <= 0) return true;
+        int status = 0;
+        waitpid(child, &status, 0);
+        child = -1;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    // Loads the last snapshot into worker; false if there is none or it is unusable.
+    bool restore(IngestWorker& worker) const {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        try {
+            BinaryReader in(data);
+            if (in.pod<uint32_t>() != kMagic || in.pod<uint32_t>() != kVersion) return false;
+            worker.loadState(in);
+            return true;
+        } catch (const std::exception& e) {
+            LOG_WARN("Ignoring checkpoint {}: {}", path, e.what());
+            return false;
+        }
+    }
+
+    std::chrono::steady_clock::duration lastPauseTime() const { return lastPause; }
+
+    static bool writeSnapshot(const IngestWorker& worker, const std::string& path) {
+        std::string tmpPath = path + ".tmp";
+        std::FILE* file = std::fopen(tmpPath.c_str(), "wb");
+        if (!file) return false;
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        BinaryWriter out(file);
+        out.pod(kMagic);
+        out.pod(kVersion);
+        worker.saveState(out);
+        bool ok = out.good() && std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+        ok = std::fclose(file) == 0 && ok;
+        return ok && std::rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    std::string path;
+    pid_t child = -1;
+    std::chrono::steady_clock::duration lastPause{};
+};
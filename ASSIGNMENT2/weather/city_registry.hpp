@@ -0,0 +1,42 @@
+// Dense ids for city names.
+#pragma once
+
+#include "binary_io.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// CityRegistry class
+// Interns city names to dense ids so per-city state can live in contiguous arrays.
+class CityRegistry {
+public:
+    uint32_t idOf(const std::string& city) {
+        auto it = ids.find(city);
+        if (it != ids.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(names.size());
+        ids.emplace(city, id);
+        names.push_back(city);
+        return id;
+    }
+
+    const std::string& name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+    void save(BinaryWriter& out) const {
+        out.pod<uint32_t>(static_cast<uint32_t>(names.size()));
+        for (const auto& name : names) out.str(name);
+    }
+
+    void load(BinaryReader& in) {
+        ids.clear();
+        names.clear();
+        uint32_t count = in.pod<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) idOf(in.str());
+    }
+
+private:
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::string> names;
+};
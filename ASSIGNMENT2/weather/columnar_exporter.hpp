@@ -0,0 +1,138 @@
+// Daily Parquet exports of observations and closed city-days.
+#pragma once
+
+#include "../../common/async_logger.hpp"
+#include "observation.hpp"
+#include "rollups.hpp"
+#include "parquet.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+
+// ColumnarExporter class
+// Exports observations and closed city-days to Parquet for analysis outside Mongo. Observations
+// are buffered for one window of observation time and written as a row group when a later window
+// starts. Files roll over with the UTC day of the observations: observations-<day> holds that
+// day's readings and summaries-<day> the city-days closed while it was open.
+class ColumnarExporter {
+public:
+    struct Config {
+        std::string directory = "exports";
+        std::string prefix;           // e.g. "worker-2-", so shard workers never share a file
+        int64_t windowSeconds = 3600; // One row group per window
+        bool compress = true;         // gzip pages
+    };
+
+    explicit ColumnarExporter(Config config) : config(std::move(config)) {}
+    ~ColumnarExporter() { close(); }
+
+    void addObservation(const std::string& city, const Observation& obs, const WeatherReading& reading) {
+        int64_t window = obs.dt / config.windowSeconds;
+        if (window > currentWindow) startWindow(window); // Late readings join the open window
+        ParquetWriter& out = *observations;
+        out.add(0, obs.dt);
+        out.add(1, city);
+        out.add(2, std::string(obs.condition));
+        out.add(3, obs.tempC);
+        out.add(4, reading.feelsLikeC);
+        out.add(5, reading.pressure);
+        out.add(6, reading.humidity);
+        out.add(7, reading.windSpeed);
+        out.add(8, reading.clouds);
+        out.add(9, obs.hasCoord ? obs.lat : std::numeric_limits<double>::quiet_NaN());
+        out.add(10, obs.hasCoord ? obs.lon : std::numeric_limits<double>::quiet_NaN());
+        ++rows;
+    }
+
+    void addSummary(const std::string& city, int64_t day, const RollupStats& stats) {
+        if (!summaries) {
+            using Type = ParquetWriter::Type;
+            summaries = open("summaries", observations ? fileDay : day,
+                             {{"date", Type::Date}, {"city", Type::String}, {"count", Type::Int64}, {"tempAvg", Type::Double},
+                              {"tempMin", Type::Double}, {"tempMax", Type::Double}, {"dominantCondition", Type::String}});
+        }
+        ParquetWriter& out = *summaries;
+        out.add(0, day);
+        out.add(1, city);
+        out.add(2, static_cast<int64_t>(stats.count));
+        out.add(3, stats.average());
+        out.add(4, stats.min);
+        out.add(5, stats.max);
+        out.add(6, stats.dominantCondition());
+    }
+
+    // Writes the open window as a row group in each file.
+    void flush() {
+        if (observations && !observations->flush()) LOG_ERROR("Export to {} failed", observations->filePath());
+        if (summaries && !summaries->flush()) LOG_ERROR("Export to {} failed", summaries->filePath());
+    }
+
+    // Finishes the current files; the next row opens new ones.
+    void close() {
+        for (auto* writer : {&observations, &summaries}) {
+            if (*writer && !(*writer)->close()) LOG_ERROR("Export to {} failed", (*writer)->filePath());
+            writer->reset();
+        }
+        currentWindow = std::numeric_limits<int64_t>::min();
+    }
+
+    uint64_t observationsExported() const { return rows; }
+    // Every file opened so far; each is complete once closed.
+    const std::vector<std::string>& files() const { return opened; }
+
+private:
+    void startWindow(int64_t window) {
+        int64_t day = window * config.windowSeconds / 86400;
+        if (observations && day != fileDay) close();
+        flush();
+        if (!observations) {
+            using Type = ParquetWriter::Type;
+            fileDay = day;
+            observations = open("observations", day,
+                                {{"dt", Type::Int64}, {"city", Type::String}, {"condition", Type::String},
+                                 {"temp", Type::Double}, {"feelsLike", Type::Double}, {"pressure", Type::Double},
+                                 {"humidity", Type::Double}, {"windSpeed", Type::Double}, {"clouds", Type::Double},
+                                 {"lat", Type::Double}, {"lon", Type::Double}});
+        }
+        currentWindow = window;
+    }
+
+    std::unique_ptr<ParquetWriter> open(const std::string& kind, int64_t day, std::vector<ParquetWriter::Column> columns) {
+        if (mkdir(config.directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG_ERROR("Cannot create export directory {}", config.directory);
+        }
+        auto writer = std::make_unique<ParquetWriter>(uniquePath(kind, day), std::move(columns), config.compress);
+        if (!writer->ok()) LOG_ERROR("Cannot open export file {}", writer->filePath());
+        opened.push_back(writer->filePath());
+        return writer;
+    }
+
+    // <directory>/<prefix><kind>-YYYY-MM-DD[.n].parquet, never overwriting an earlier run's file
+    std::string uniquePath(const std::string& kind, int64_t day) const {
+        std::time_t time = static_cast<std::time_t>(day * 86400);
+        std::tm utc{};
+        gmtime_r(&time, &utc);
+        char date[16];
+        std::strftime(date, sizeof(date), "%Y-%m-%d", &utc);
+        std::string base = config.directory + "/" + config.prefix + kind + "-" + date;
+        std::string candidate = base + ".parquet";
+        for (int n = 1; access(candidate.c_str(), F_OK) == 0 || access((candidate + ".inprogress").c_str(), F_OK) == 0; ++n) {
+            candidate = base + "." + std::to_string(n) + ".parquet";
+        }
+        return candidate;
+    }
+
+    Config config;
+    std::unique_ptr<ParquetWriter> observations;
+    std::unique_ptr<ParquetWriter> summaries;
+    int64_t currentWindow = std::numeric_limits<int64_t>::min();
+    int64_t fileDay = 0;
+    uint64_t rows = 0;
+    std::vector<std::string> opened;
+};
@@ -0,0 +1,110 @@
+// Detection of repeated (city, dt) observations before they are stored.
+#pragma once
+
+#include "binary_io.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// ObservationDeduplicator class
+// Drops readings already seen, keyed by (city id, dt). Consecutive polls mostly return the
+// reading they returned last time, which the per-city last-seen dt catches exactly. Older
+// readings (replays, handoffs) are checked against two rotating Bloom filter generations;
+// a false positive drops a genuinely new late reading with probability falsePositiveRate.
+class ObservationDeduplicator {
+public:
+    explicit ObservationDeduplicator(size_t keysPerGeneration = 1 << 20, double falsePositiveRate = 0.001)
+        : keysPerGeneration(keysPerGeneration) {
+        double bits = -static_cast<double>(keysPerGeneration) * std::log(falsePositiveRate) / (std::log(2.0) * std::log(2.0));
+        words = std::max<size_t>(1, static_cast<size_t>(bits / 64) + 1);
+        hashes = std::max(1, static_cast<int>(std::lround(bits / keysPerGeneration * std::log(2.0))));
+        generations[0].assign(words, 0);
+        generations[1].assign(words, 0);
+    }
+
+    // True when (city, dt) has not been seen before; records it either way.
+    bool accept(uint32_t city, int64_t dt) {
+        if (city >= lastSeen.size()) lastSeen.resize(city + 1, kNever);
+        int64_t& last = lastSeen[city];
+        if (dt == last) return false;
+        uint64_t key = keyOf(city, dt);
+        if (dt < last && (mayContain(generations[0], key) || mayContain(generations[1], key))) return false;
+        last = std::max(last, dt);
+        insert(key);
+        return true;
+    }
+
+    size_t memoryBytes() const { return lastSeen.size() * sizeof(int64_t) + 2 * words * sizeof(uint64_t); }
+
+    void save(BinaryWriter& out) const {
+        out.podVector(lastSeen);
+        out.pod<uint64_t>(inserted);
+        out.pod<uint32_t>(current);
+        out.podVector(generations[0]);
+        out.podVector(generations[1]);
+    }
+
+    void load(BinaryReader& in) {
+        lastSeen = in.podVector<int64_t>();
+        inserted = in.pod<uint64_t>();
+        current = in.pod<uint32_t>() & 1;
+        for (auto& generation : generations) {
+            generation = in.podVector<uint64_t>();
+            if (generation.size() != words) {
+                generation.assign(words, 0); // Sized differently when written; start the filter over
+                inserted = 0;
+            }
+        }
+    }
+
+private:
+    static constexpr int64_t kNever = std::numeric_limits<int64_t>::min();
+
+    static uint64_t keyOf(uint32_t city, int64_t dt) {
+        uint64_t x = (static_cast<uint64_t>(city) << 40) ^ static_cast<uint64_t>(dt);
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        return x ^ (x >> 33);
+    }
+
+    // Double hashing: probe i is h1 + i * h2.
+    bool mayContain(const std::vector<uint64_t>& bits, uint64_t key) const {
+        uint64_t h1 = key, h2 = (key >> 32) | 1;
+        for (int i = 0; i < hashes; ++i) {
+            uint64_t bit = (h1 + i * h2) % (words * 64);
+            if (!(bits[bit / 64] & (1ULL << (bit % 64)))) return false;
+        }
+        return true;
+    }
+
+    // When the current generation is full the older one is cleared and takes over, so
+    // the filter always remembers at least the last keysPerGeneration readings.
+    void insert(uint64_t key) {
+        if (inserted >= keysPerGeneration) {
+            current ^= 1;
+            std::fill(generations[current].begin(), generations[current].end(), 0);
+            inserted = 0;
+        }
+        auto& bits = generations[current];
+        uint64_t h1 = key, h2 = (key >> 32) | 1;
+        for (int i = 0; i < hashes; ++i) {
+            uint64_t bit = (h1 + i * h2) % (words * 64);
+            bits[bit / 64] |= 1ULL << (bit % 64);
+        }
+        ++inserted;
+    }
+
+    size_t keysPerGeneration;
+    size_t words = 0;
+    int hashes = 1;
+    std::vector<int64_t> lastSeen;
+    std::array<std::vector<uint64_t>, 2> generations;
+    uint32_t current = 0;
+    uint64_t inserted = 0;
+};
@@ -0,0 +1,674 @@
+// Upstream fetching: pooled single requests, retries, circuit breaking and the concurrent FetchScheduler.
+#pragma once
+
+#include <curl/curl.h>
+#include <nlohmann/json.hpp>
+#include "metrics.hpp"
+#include "observation.hpp"
+#include "json_stream.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// WeatherDataFetcher class
+// Requests go through a per-thread FetchContext: one keep-alive curl handle, a pre-sized
+// response buffer and a URL assembled from a cached prefix, all reused between requests.
+class WeatherDataFetcher {
+public:
+    static nlohmann::json fetchWeatherData(const std::string& city, const std::string& apiKey) {
+        FetchContext& context = FetchContext::local();
+        context.body.clear();
+        CURLcode res = context.perform("weather", city, apiKey, &appendToBody, &context.body);
+        if (res != CURLE_OK) throw std::runtime_error(std::string("transfer failed: ") + curl_easy_strerror(res));
+        if (context.status >= 400) throw std::runtime_error("HTTP " + std::to_string(context.status));
+        if (context.body.empty()) throw std::runtime_error("empty response");
+
+        ScopedStageTimer timer(PipelineMetrics::Parse);
+        return nlohmann::json::parse(context.body);
+    }
+
+    // Allocation-free steady-state path: streams the response straight into a reusable
+    // Observation slot instead of buffering it and building a DOM.
+    static bool fetchObservation(const std::string& city, const std::string& apiKey, Observation& slot) {
+        FetchContext& context = FetchContext::local();
+        context.parser.reset(slot);
+        context.parseNs = 0;
+        CURLcode res = context.perform("weather", city, apiKey, &feedObservation, &context);
+        PipelineMetrics::recordStage(PipelineMetrics::Parse, context.parseNs);
+        return res == CURLE_OK && context.status < 400 && context.parser.finish();
+    }
+
+    // Streams a 5-day/3-hour forecast through ForecastStreamParser as curl delivers it, so the
+    // payload is never buffered or turned into a DOM. Returns the number of records emitted.
+    static size_t fetchForecast(const std::string& city, const std::string& apiKey, int64_t runTime,
+                                const ForecastStreamParser::RecordHandler& onRecord) {
+        struct Stream {
+            ForecastStreamParser parser;
+            uint64_t parseNs;
+        } stream{ForecastStreamParser(runTime, onRecord), 0};
+        CURLcode res = FetchContext::local().perform(
+            "forecast", city, apiKey, +[](void* contents, size_t size, size_t nmemb, void* userp) -> size_t {
+                auto* stream = static_cast<Stream*>(userp);
+                auto start = std::chrono::steady_clock::now();
+                bool ok = stream->parser.feed(static_cast<const char*>(contents), size * nmemb);
+                stream->parseNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                return ok ? size * nmemb : 0; // Returning short aborts the transfer on malformed input
+            },
+            &stream);
+        PipelineMetrics::recordStage(PipelineMetrics::Parse, stream.parseNs);
+        if (res != CURLE_OK || FetchContext::local().status >= 400 || !stream.parser.finish()) {
+            throw std::runtime_error("forecast fetch failed for " + city + ": " + curl_easy_strerror(res));
+        }
+        return stream.parser.records();
+    }
+
+    // Base URL of the weather API; benchmarks point it at MockWeatherServer
+    static std::string& apiBaseUrl() {
+        static std::string url = "http://api.openweathermap.org";
+        return url;
+    }
+
+    // Per-request limits, so one stalled upstream connection cannot hold a cycle indefinitely.
+    struct Timeouts {
+        long connectMs = 2000;
+        long totalMs = 5000;
+    };
+
+    static Timeouts& timeouts() {
+        static Timeouts limits;
+        return limits;
+    }
+
+    // Whether to ask for gzip/br/zstd bodies. curl inflates them chunk by chunk before the write
+    // callback, so the streaming parsers never see, or hold, a whole decompressed payload.
+    static bool& acceptCompressed() {
+        static bool enabled = true;
+        return enabled;
+    }
+
+    // Options shared by every request handle: timeouts and content encoding.
+    static void configureTransfer(CURL* curl) {
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, timeouts().connectMs);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeouts().totalMs);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L); // Timeouts must not raise SIGALRM in worker threads
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, acceptCompressed() ? "" : nullptr); // "": every encoding curl was built with
+    }
+
+    // Splits curl's cumulative timers into DNS, connect and transfer stages. Transport errors and
+    // HTTP error statuses both count as fetch errors.
+    static void recordTransferTimings(CURL* curl, bool failed, size_t bytes) {
+        if (failed) PipelineMetrics::add(PipelineMetrics::FetchErrors);
+        PipelineMetrics::add(PipelineMetrics::BytesReceived, bytes);
+        curl_off_t dnsUs = 0, connectUs = 0, totalUs = 0;
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dnsUs);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connectUs);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &totalUs);
+        PipelineMetrics::recordStage(PipelineMetrics::DnsLookup, static_cast<uint64_t>(dnsUs) * 1000);
+        PipelineMetrics::recordStage(PipelineMetrics::Connect, static_cast<uint64_t>(std::max<curl_off_t>(connectUs - dnsUs, 0)) * 1000);
+        PipelineMetrics::recordStage(PipelineMetrics::HttpTransfer, static_cast<uint64_t>(std::max<curl_off_t>(totalUs - connectUs, 0)) * 1000);
+    }
+
+private:
+    using WriteFunction = size_t (*)(void*, size_t, size_t, void*);
+
+    struct FetchContext {
+        static constexpr size_t kBodyCapacity = 64 * 1024;
+
+        CURL* handle = nullptr;
+        std::string body;
+        std::string url;
+        std::string urlBase; // apiBaseUrl() the cached prefix was built from
+        size_t prefixLength = 0;
+        ObservationStreamParser parser;
+        uint64_t parseNs = 0;
+        long status = 0; // HTTP status of the last response, 0 if none arrived
+
+        FetchContext() : handle(curl_easy_init()) {
+            body.reserve(kBodyCapacity);
+            url.reserve(1024);
+            urlBase.reserve(256);
+        }
+        ~FetchContext() {
+            if (handle) curl_easy_cleanup(handle);
+        }
+
+        static FetchContext& local() {
+            thread_local FetchContext context;
+            return context;
+        }
+
+        // "<base>/data/2.5/" is kept in url and only the tail is rewritten per request.
+        void buildUrl(const char* endpoint, const std::string& city, const std::string& apiKey) {
+            if (urlBase != apiBaseUrl()) {
+                urlBase = apiBaseUrl();
+                url.assign(urlBase).append("/data/2.5/");
+                prefixLength = url.size();
+            }
+            url.resize(prefixLength);
+            url.append(endpoint).append("?q=").append(city).append("&appid=").append(apiKey);
+        }
+
+        CURLcode perform(const char* endpoint, const std::string& city, const std::string& apiKey, WriteFunction write,
+                         void* userdata) {
+            if (!handle) throw std::runtime_error("curl_easy_init failed");
+            buildUrl(endpoint, city, apiKey);
+            curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write);
+            curl_easy_setopt(handle, CURLOPT_WRITEDATA, userdata);
+            configureTransfer(handle);
+            CURLcode res = curl_easy_perform(handle);
+            curl_off_t received = 0;
+            status = 0;
+            curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &received);
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+            recordTransferTimings(handle, res != CURLE_OK || status >= 400, static_cast<size_t>(received));
+            return res;
+        }
+    };
+
+    static size_t appendToBody(void* contents, size_t size, size_t nmemb, void* userp) {
+        static_cast<std::string*>(userp)->append(static_cast<char*>(contents), size * nmemb);
+        return size * nmemb;
+    }
+
+    static size_t feedObservation(void* contents, size_t size, size_t nmemb, void* userp) {
+        auto* context = static_cast<FetchContext*>(userp);
+        auto start = std::chrono::steady_clock::now();
+        bool ok = context->parser.feed(static_cast<const char*>(contents), size * nmemb);
+        context->parseNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        return ok ? size * nmemb : 0;
+    }
+};
+
+// CircuitBreaker class
+// Tracks the outcome of the last `window` upstream requests. Once at least minRequests have
+// been seen and the error rate reaches errorThreshold, the breaker opens and requests fail fast.
+// After the cooldown a few probes are let through (half-open): if all succeed it closes again,
+// if any fails it re-opens with the cooldown doubled, up to maxCooldown. Every state change
+// starts a new generation; a request carries the generation it was admitted under, and results
+// from earlier generations (sent before a trip, or hedged before the breaker went half-open)
+// are ignored, so only the probes decide. Owned by one fetch loop.
+class CircuitBreaker {
+public:
+    using Clock = std::chrono::steady_clock;
+    enum State { Closed, Open, HalfOpen };
+
+    struct Config {
+        size_t window = 100;
+        size_t minRequests = 20;
+        double errorThreshold = 0.5;
+        std::chrono::milliseconds cooldown{1000};
+        std::chrono::milliseconds maxCooldown{30000};
+        int probes = 3;
+    };
+
+    CircuitBreaker() : CircuitBreaker(Config{}) {}
+    explicit CircuitBreaker(Config config) : config(config), outcomes(std::max<size_t>(config.window, 1), 0), nextCooldown(config.cooldown) {}
+
+    // Whether a request may be sent now; in half-open state at most `probes` are in flight.
+    // ticket receives the generation to pass to record() with the request's result.
+    bool allow(Clock::time_point now, uint64_t& ticket) {
+        if (state == Open) {
+            if (now < reopenAt) return false;
+            state = HalfOpen;
+            ++generation;
+            probesInFlight = 0;
+            probeSuccesses = 0;
+        }
+        if (state == HalfOpen) {
+            if (probesInFlight >= config.probes) return false;
+            ++probesInFlight;
+        }
+        ticket = generation;
+        return true;
+    }
+
+    void record(uint64_t ticket, bool success, Clock::time_point now) {
+        if (ticket != generation) return; // Admitted before the last state change
+        if (state == HalfOpen) {
+            if (probesInFlight > 0) --probesInFlight;
+            if (!success) {
+                trip(now);
+            } else if (++probeSuccesses >= config.probes) {
+                close();
+            }
+            return;
+        }
+        failures -= outcomes[next];
+        outcomes[next] = success ? 0 : 1;
+        failures += outcomes[next];
+        next = (next + 1) % outcomes.size();
+        seen = std::min(seen + 1, outcomes.size());
+        if (seen >= config.minRequests && failures >= config.errorThreshold * static_cast<double>(seen)) trip(now);
+    }
+
+    State currentState() const { return state; }
+    uint64_t trips() const { return tripCount; }
+
+private:
+    void trip(Clock::time_point now) {
+        state = Open;
+        ++generation;
+        ++tripCount;
+        reopenAt = now + nextCooldown;
+        nextCooldown = std::min(nextCooldown * 2, config.maxCooldown);
+    }
+
+    void close() {
+        state = Closed;
+        ++generation;
+        std::fill(outcomes.begin(), outcomes.end(), 0);
+        failures = 0;
+        seen = 0;
+        next = 0;
+        nextCooldown = config.cooldown;
+    }
+
+    Config config;
+    State state = Closed;
+    uint64_t generation = 0;
+    std::vector<uint8_t> outcomes; // 1 = failure, ring buffer over the last `window` requests
+    size_t next = 0;
+    size_t seen = 0;
+    size_t failures = 0;
+    int probesInFlight = 0;
+    int probeSuccesses = 0;
+    uint64_t tripCount = 0;
+    std::chrono::milliseconds nextCooldown;
+    Clock::time_point reopenAt{};
+};
+
+// RetryPolicy: exponential backoff with full jitter. Attempt n waits a uniform random time in
+// [0, min(maxDelay, baseDelay * 2^(n-1))], which spreads retries from many cities apart.
+struct RetryPolicy {
+    int maxAttempts = 4; // Including the first request
+    std::chrono::milliseconds baseDelay{250};
+    std::chrono::milliseconds maxDelay{8000};
+
+    std::chrono::milliseconds delay(int attempt, uint64_t& seed) const {
+        int64_t cap = baseDelay.count() << std::min(attempt - 1, 20);
+        cap = std::min<int64_t>(cap, maxDelay.count());
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return std::chrono::milliseconds(cap > 0 ? static_cast<int64_t>(seed % static_cast<uint64_t>(cap + 1)) : 0);
+    }
+
+    // Transport failures, throttling and server errors are transient; other 4xx answers are not.
+    static bool retryable(CURLcode res, long status) {
+        if (res != CURLE_OK) return true;
+        return status == 0 || status == 429 || status >= 500;
+    }
+};
+
+// FetchScheduler class
+// Fetches current weather for a list of cities concurrently on the calling thread with curl's
+// multi interface. Failed requests go onto a due-time heap and are retried per RetryPolicy while
+// the other cities proceed, so nothing sleeps in the worker; while the CircuitBreaker is open the
+// remaining requests fail fast and are left for the next cycle. With hedging on, a request still
+// outstanding after the hedge delay gets a duplicate; the first answer wins and the other is cancelled.
+// Forecast cycles run the same way against the forecast endpoint, without hedging.
+class FetchScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+    // One parsed response; the references are valid for the duration of the handler call.
+    struct Response {
+        const Observation& observation;
+        const WeatherReading& reading;
+        int64_t cityId;
+    };
+    using ResultHandler = std::function<void(const std::string& city, const Response& response)>;
+    using ForecastHandler = std::function<void(const std::string& city, const std::vector<ForecastRecord>& records)>;
+    using ErrorHandler = std::function<void(const std::string& city, const std::string& error)>;
+
+    struct Hedging {
+        bool enabled = false;
+        std::chrono::milliseconds delay{0}; // 0: p95 of recent response times
+        double budget = 0.05;               // Hedges per cycle are capped at this fraction of requests sent
+    };
+
+    struct Config {
+        int concurrency = 8;
+        RetryPolicy retry;
+        CircuitBreaker::Config breaker;
+        Hedging hedging;
+    };
+
+    struct CycleStats {
+        size_t succeeded = 0;
+        size_t failed = 0;     // Gave up after a permanent error or the last attempt
+        size_t fastFailed = 0; // Rejected by the open circuit breaker
+        size_t retries = 0;
+        size_t hedges = 0;
+        size_t hedgeWins = 0;  // Hedges that answered before the request they duplicated
+    };
+
+    FetchScheduler() : FetchScheduler(Config{}) {}
+    explicit FetchScheduler(Config config)
+        : config(config), breaker(config.breaker),
+          seed(static_cast<uint64_t>(Clock::now().time_since_epoch().count()) | 1) {}
+
+    FetchScheduler(const FetchScheduler&) = delete;
+    FetchScheduler& operator=(const FetchScheduler&) = delete;
+
+    ~FetchScheduler() { releaseHandles(); }
+
+    void setConfig(Config next) {
+        releaseHandles();
+        config = next;
+        breaker = CircuitBreaker(config.breaker);
+    }
+
+    // Runs one cycle; returns once every city succeeded, failed or was fast-failed.
+    CycleStats run(const std::vector<std::string>& cities, const std::string& apiKey, const ResultHandler& onResult,
+                   const ErrorHandler& onError) {
+        return cycle(cities, apiKey, false, 0, onError, [&](size_t index, const Transfer& transfer) {
+            onResult(cities[index], Response{transfer.observation, transfer.reading, transfer.parser.id()});
+        });
+    }
+
+    // Fetches the 5-day/3-hour forecast of every city, stamped with runTime, through the same
+    // retries and circuit breaker.
+    CycleStats runForecasts(const std::vector<std::string>& cities, const std::string& apiKey, int64_t runTime,
+                            const ForecastHandler& onForecast, const ErrorHandler& onError) {
+        return cycle(cities, apiKey, true, runTime, onError,
+                     [&](size_t index, const Transfer& transfer) { onForecast(cities[index], transfer.records); });
+    }
+
+    const CircuitBreaker& circuitBreaker() const { return breaker; }
+
+    // Current hedge delay; zero while hedging is off or too few responses have been seen.
+    std::chrono::microseconds hedgeDelay() const {
+        if (!config.hedging.enabled) return std::chrono::microseconds(0);
+        if (config.hedging.delay.count() > 0) return config.hedging.delay;
+        return std::chrono::microseconds(latencySamples >= kMinLatencySamples ? p95Us : 0);
+    }
+
+private:
+    static constexpr size_t kLatencyWindow = 512;
+    static constexpr size_t kMinLatencySamples = 50;
+    static constexpr size_t kRecomputeEvery = 32;
+
+    // curl inflates gzip/br/zstd bodies chunk by chunk before the write callback, which feeds
+    // them straight into the transfer's parser; no response is buffered or turned into a DOM.
+    struct Transfer {
+        CURL* handle = nullptr;
+        std::string url;
+        std::string urlBase;        // apiBaseUrl() the cached prefix was built from
+        size_t prefixLength = 0;
+        ObservationStreamParser parser;
+        Observation observation;
+        WeatherReading reading;
+        bool forecast = false;      // Forecast endpoint: parsed by forecastParser into records
+        ForecastStreamParser forecastParser;
+        std::vector<ForecastRecord> records;
+        uint64_t parseNs = 0;
+        bool malformed = false;     // The parser rejected the body; the rest of it is drained
+        size_t index = 0;
+        bool busy = false;
+        bool hedge = false;         // Duplicate of a slower request
+        uint64_t ticket = 0;        // Breaker generation the request (or its primary) was admitted under
+        Transfer* twin = nullptr;   // The other copy while both are in flight
+        Clock::time_point started{};
+
+        Transfer() : forecastParser(0, [this](const ForecastRecord& record) { records.push_back(record); }) {}
+    };
+
+    struct Retry {
+        Clock::time_point due;
+        size_t index;
+        bool operator>(const Retry& other) const { return due > other.due; }
+    };
+
+    template <typename OnSuccess>
+    CycleStats cycle(const std::vector<std::string>& cities, const std::string& apiKey, bool forecast, int64_t runTime,
+                     const ErrorHandler& onError, const OnSuccess& onSuccess) {
+        CycleStats stats;
+        if (cities.empty()) return stats;
+        acquireHandles();
+        forecastCycle = forecast;
+        forecastRunTime = runTime;
+
+        // The queues are members so that their capacity carries over from one cycle to the next.
+        ready.clear();
+        readyHead = 0;
+        for (size_t i = 0; i < cities.size(); ++i) ready.push_back(i);
+        attempts.assign(cities.size(), 0);
+        retries.clear();
+        idle.clear();
+        for (auto& transfer : transfers) idle.push_back(&transfer);
+        size_t remaining = cities.size();
+        size_t sent = 0;
+        bool awaitingProbes = false;
+
+        auto giveUp = [&](size_t index, const std::string& error) {
+            --remaining;
+            if (onError) onError(cities[index], error);
+        };
+        auto release = [&](Transfer* transfer) {
+            curl_multi_remove_handle(multi, transfer->handle);
+            transfer->busy = false;
+            transfer->twin = nullptr;
+            idle.push_back(transfer);
+        };
+
+        while (remaining > 0) {
+            auto now = Clock::now();
+            while (!retries.empty() && retries.front().due <= now) {
+                ready.push_back(retries.front().index);
+                std::pop_heap(retries.begin(), retries.end(), std::greater<Retry>());
+                retries.pop_back();
+            }
+
+            // Hedges go ahead of new cities: the slowest requests are the ones that set the cycle time.
+            auto hedgeAfter = forecast ? std::chrono::microseconds(0) : hedgeDelay();
+            if (hedgeAfter.count() > 0 && breaker.currentState() == CircuitBreaker::Closed) {
+                for (auto& primary : transfers) {
+                    if (idle.empty()) break;
+                    if (!primary.busy || primary.hedge || primary.twin || now - primary.started < hedgeAfter) continue;
+                    if (static_cast<double>(stats.hedges + 1) > config.hedging.budget * static_cast<double>(sent)) break;
+                    Transfer* hedge = idle.back();
+                    idle.pop_back();
+                    hedge->index = primary.index;
+                    hedge->hedge = true;
+                    hedge->twin = &primary;
+                    hedge->ticket = primary.ticket;
+                    primary.twin = hedge;
+                    start(*hedge, cities[hedge->index], apiKey, now);
+                    ++stats.hedges;
+                    PipelineMetrics::add(PipelineMetrics::Hedges);
+                }
+            }
+
+            awaitingProbes = false;
+            while (readyHead < ready.size() && !idle.empty()) {
+                uint64_t ticket;
+                if (!breaker.allow(now, ticket)) {
+                    awaitingProbes = breaker.currentState() == CircuitBreaker::HalfOpen;
+                    if (awaitingProbes) break; // Wait for the probes in flight
+                    ++stats.fastFailed;
+                    PipelineMetrics::add(PipelineMetrics::FastFailed);
+                    giveUp(ready[readyHead++], "circuit open");
+                    continue;
+                }
+                Transfer* transfer = idle.back();
+                idle.pop_back();
+                transfer->index = ready[readyHead++];
+                transfer->hedge = false;
+                transfer->ticket = ticket;
+                ++attempts[transfer->index];
+                ++sent;
+                start(*transfer, cities[transfer->index], apiKey, now);
+            }
+
+            int running = 0;
+            curl_multi_perform(multi, &running);
+            int queued = 0;
+            while (CURLMsg* message = curl_multi_info_read(multi, &queued)) {
+                if (message->msg != CURLMSG_DONE) continue;
+                Transfer* transfer = nullptr;
+                curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &transfer);
+                if (!transfer->busy) continue; // Cancelled as the losing twin
+                CURLcode res = message->data.result;
+                Transfer* twin = transfer->twin;
+                bool wasHedge = transfer->hedge;
+                size_t index = transfer->index;
+                release(transfer);
+
+                long status = 0;
+                curl_off_t received = 0;
+                curl_easy_getinfo(transfer->handle, CURLINFO_RESPONSE_CODE, &status);
+                curl_easy_getinfo(transfer->handle, CURLINFO_SIZE_DOWNLOAD_T, &received);
+                std::string error;
+                if (res != CURLE_OK) {
+                    error = std::string("transfer failed: ") + curl_easy_strerror(res);
+                } else if (status >= 400) {
+                    error = "HTTP " + std::to_string(status);
+                } else if (transfer->malformed || !(forecast ? transfer->forecastParser.finish() : transfer->parser.finish())) {
+                    error = "malformed response";
+                }
+                PipelineMetrics::recordStage(PipelineMetrics::Parse, transfer->parseNs);
+                WeatherDataFetcher::recordTransferTimings(transfer->handle, !error.empty(), static_cast<size_t>(received));
+                now = Clock::now();
+                breaker.record(transfer->ticket, error.empty(), now);
+
+                if (!error.empty() && twin) {
+                    twin->twin = nullptr; // The twin still in flight now carries the request
+                    continue;
+                }
+                if (error.empty()) {
+                    if (!forecast) recordLatency(now - transfer->started); // Forecasts are larger; keep the p95 to current weather
+                    if (twin) release(twin); // Cancel the loser
+                    if (wasHedge) ++stats.hedgeWins;
+                    ++stats.succeeded;
+                    --remaining;
+                    onSuccess(index, *transfer);
+                } else if (RetryPolicy::retryable(res, status) && attempts[index] < config.retry.maxAttempts) {
+                    ++stats.retries;
+                    PipelineMetrics::add(PipelineMetrics::Retries);
+                    retries.push_back({now + config.retry.delay(attempts[index], seed), index});
+                    std::push_heap(retries.begin(), retries.end(), std::greater<Retry>());
+                } else {
+                    ++stats.failed;
+                    giveUp(index, error);
+                }
+            }
+            if (remaining == 0) break;
+
+            // Sleep in curl until a socket is ready, the earliest retry is due or a request becomes hedgeable.
+            auto wake = Clock::now() + std::chrono::milliseconds(100);
+            if (!retries.empty()) wake = std::min(wake, retries.front().due);
+            if (hedgeAfter.count() > 0) {
+                for (const auto& transfer : transfers) {
+                    if (transfer.busy && !transfer.hedge && !transfer.twin) wake = std::min(wake, transfer.started + hedgeAfter);
+                }
+            }
+            auto untilWake = std::chrono::duration_cast<std::chrono::microseconds>(wake - Clock::now()).count();
+            int waitMs = static_cast<int>(std::max<int64_t>(0, (untilWake + 999) / 1000));
+            if (readyHead < ready.size() && !idle.empty() && !awaitingProbes) waitMs = 0;
+            curl_multi_poll(multi, nullptr, 0, waitMs, nullptr);
+        }
+        return stats;
+    }
+
+    // Keeps the last kLatencyWindow response times and refreshes their p95 every few responses.
+    void recordLatency(Clock::duration elapsed) {
+        if (latencies.size() < kLatencyWindow) latencies.resize(kLatencyWindow);
+        latencies[latencySamples % kLatencyWindow] =
+            static_cast<uint32_t>(std::min<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), UINT32_MAX));
+        ++latencySamples;
+        if (latencySamples < kMinLatencySamples || latencySamples % kRecomputeEvery != 0) return;
+        size_t n = std::min<size_t>(latencySamples, kLatencyWindow);
+        scratch.assign(latencies.begin(), latencies.begin() + static_cast<std::ptrdiff_t>(n));
+        auto p95 = scratch.begin() + static_cast<std::ptrdiff_t>(n * 95 / 100);
+        std::nth_element(scratch.begin(), p95, scratch.end());
+        p95Us = *p95;
+    }
+
+    void acquireHandles() {
+        if (!multi) multi = curl_multi_init();
+        if (!multi) throw std::runtime_error("curl_multi_init failed");
+        for (auto& transfer : transfers) { // Left over if a handler threw
+            curl_multi_remove_handle(multi, transfer.handle);
+            transfer.busy = false;
+            transfer.twin = nullptr;
+        }
+        while (transfers.size() < static_cast<size_t>(std::max(config.concurrency, 1))) {
+            transfers.emplace_back();
+            transfers.back().handle = curl_easy_init();
+            if (!transfers.back().handle) throw std::runtime_error("curl_easy_init failed");
+        }
+    }
+
+    void releaseHandles() {
+        for (auto& transfer : transfers) {
+            if (multi) curl_multi_remove_handle(multi, transfer.handle);
+            curl_easy_cleanup(transfer.handle);
+        }
+        transfers.clear();
+        if (multi) curl_multi_cleanup(multi);
+        multi = nullptr;
+    }
+
+    void start(Transfer& transfer, const std::string& city, const std::string& apiKey, Clock::time_point now) {
+        transfer.forecast = forecastCycle;
+        if (transfer.forecast) {
+            transfer.forecastParser.reset(forecastRunTime);
+            transfer.records.clear();
+        } else {
+            transfer.parser.reset(transfer.observation, &transfer.reading);
+        }
+        transfer.parseNs = 0;
+        transfer.malformed = false;
+        transfer.busy = true;
+        transfer.started = now;
+        // "<base>/data/2.5/" is kept in url and only the tail is rewritten per request.
+        if (transfer.urlBase != WeatherDataFetcher::apiBaseUrl()) {
+            transfer.urlBase = WeatherDataFetcher::apiBaseUrl();
+            transfer.url.reserve(1024);
+            transfer.url.assign(transfer.urlBase).append("/data/2.5/");
+            transfer.prefixLength = transfer.url.size();
+        }
+        transfer.url.resize(transfer.prefixLength);
+        transfer.url.append(transfer.forecast ? "forecast" : "weather").append("?q=").append(city).append("&appid=").append(apiKey);
+        curl_easy_setopt(transfer.handle, CURLOPT_URL, transfer.url.c_str());
+        curl_easy_setopt(transfer.handle, CURLOPT_WRITEFUNCTION, +[](void* contents, size_t size, size_t nmemb, void* userp) {
+            auto* transfer = static_cast<Transfer*>(userp);
+            if (!transfer->malformed) {
+                auto started = Clock::now();
+                const char* data = static_cast<const char*>(contents);
+                transfer->malformed = !(transfer->forecast ? transfer->forecastParser.feed(data, size * nmemb)
+                                                           : transfer->parser.feed(data, size * nmemb));
+                transfer->parseNs += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count();
+            }
+            return size * nmemb; // An error status or malformed body is reported once the transfer ends
+        });
+        curl_easy_setopt(transfer.handle, CURLOPT_WRITEDATA, &transfer);
+        curl_easy_setopt(transfer.handle, CURLOPT_PRIVATE, &transfer);
+        WeatherDataFetcher::configureTransfer(transfer.handle);
+        curl_multi_add_handle(multi, transfer.handle);
+    }
+
+    Config config;
+    CircuitBreaker breaker;
+    uint64_t seed;
+    CURLM* multi = nullptr;
+    std::deque<Transfer> transfers; // Stable addresses for CURLOPT_PRIVATE
+    std::vector<size_t> ready;      // City indices to send; consumed from readyHead, retries appended
+    size_t readyHead = 0;
+    std::vector<int> attempts;
+    std::vector<Retry> retries;     // Min-heap on due time
+    std::vector<Transfer*> idle;
+    bool forecastCycle = false;     // The endpoint start() requests in the current cycle
+    int64_t forecastRunTime = 0;
+    std::vector<uint32_t> latencies; // Microseconds, ring of the last kLatencyWindow responses
+    std::vector<uint32_t> scratch;
+    size_t latencySamples = 0;
+    uint32_t p95Us = 0;
+};
@@ -0,0 +1,93 @@
+// Forecast error by lead time, scored against later observations.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "json_stream.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+// ForecastErrorTracker class
+// Scores forecasts against what was later observed, incrementally. Forecasts wait per city
+// keyed by target time; the first observation at or after a target (within matchWindow)
+// resolves every run that forecast it, and the error lands in a bucket by lead time (3 h
+// steps up to 5 days) and in the city's running totals. Unmatched targets expire.
+class ForecastErrorTracker {
+public:
+    static constexpr int kLeadBuckets = 40;
+    static constexpr int64_t kLeadStep = 3 * 3600;
+
+    struct ErrorStats {
+        uint64_t count = 0;
+        double sum = 0;        // forecast - observed, for bias
+        double sumAbs = 0;
+        double sumSquares = 0;
+
+        void add(double error) {
+            ++count;
+            sum += error;
+            sumAbs += std::fabs(error);
+            sumSquares += error * error;
+        }
+        double bias() const { return count ? sum / count : 0; }
+        double mae() const { return count ? sumAbs / count : 0; }
+        double rmse() const { return count ? std::sqrt(sumSquares / count) : 0; }
+
+        nlohmann::json toJson() const { return {{"count", count}, {"mae", mae()}, {"rmse", rmse()}, {"bias", bias()}}; }
+    };
+
+    explicit ForecastErrorTracker(int64_t matchWindow = 1800) : matchWindow(matchWindow) {}
+
+    // A later run for the same target replaces nothing: each run is scored separately.
+    void addForecast(uint32_t city, const ForecastRecord& record) {
+        if (city >= pending.size()) {
+            pending.resize(city + 1);
+            perCity.resize(city + 1);
+        }
+        auto& runs = pending[city][record.targetTime];
+        for (auto& run : runs) {
+            if (run.first == record.runTime) {
+                run.second = static_cast<float>(record.tempC);
+                return;
+            }
+        }
+        runs.emplace_back(record.runTime, static_cast<float>(record.tempC));
+        ++waiting;
+    }
+
+    void onObservation(uint32_t city, int64_t dt, double tempC) {
+        if (city >= pending.size()) return;
+        auto& targets = pending[city];
+        for (auto it = targets.begin(); it != targets.end() && it->first <= dt;) {
+            if (dt - it->first <= matchWindow) {
+                for (const auto& run : it->second) {
+                    double error = run.second - tempC;
+                    int64_t lead = std::max<int64_t>(it->first - run.first - 1, 0); // Bucket i: up to (i + 1) * 3 h
+                    int bucket = static_cast<int>(std::min<int64_t>(lead / kLeadStep, kLeadBuckets - 1));
+                    byLead[bucket].add(error);
+                    perCity[city].add(error);
+                }
+            }
+            waiting -= it->second.size();
+            it = targets.erase(it);
+        }
+    }
+
+    const ErrorStats& leadBucket(int bucket) const { return byLead[bucket]; }
+    ErrorStats city(uint32_t id) const { return id < perCity.size() ? perCity[id] : ErrorStats{}; }
+    // One past the highest city id with any forecast.
+    size_t cityCount() const { return perCity.size(); }
+    size_t pendingForecasts() const { return waiting; }
+
+private:
+    int64_t matchWindow;
+    std::vector<std::map<int64_t, std::vector<std::pair<int64_t, float>>>> pending; // city -> target -> (run, temp)
+    std::vector<ErrorStats> perCity;
+    std::array<ErrorStats, kLeadBuckets> byLead{};
+    size_t waiting = 0;
+};
@@ -0,0 +1,55 @@
+// Consistent hashing of cities onto shard workers.
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// ConsistentHashRing class
+// Maps cities to ingest workers with virtual nodes, so adding or removing one of N workers
+// only moves about 1/N of the cities.
+class ConsistentHashRing {
+public:
+    explicit ConsistentHashRing(int virtualNodes = 160) : virtualNodes(virtualNodes) {}
+
+    void addWorker(int worker) {
+        for (int v = 0; v < virtualNodes; ++v) {
+            ring[hash("worker-" + std::to_string(worker) + "#" + std::to_string(v))] = worker;
+        }
+    }
+
+    void removeWorker(int worker) {
+        for (auto it = ring.begin(); it != ring.end();) {
+            it = it->second == worker ? ring.erase(it) : std::next(it);
+        }
+    }
+
+    // Returns -1 when no workers are registered.
+    int ownerOf(const std::string& city) const {
+        if (ring.empty()) return -1;
+        auto it = ring.lower_bound(hash(city));
+        return it == ring.end() ? ring.begin()->second : it->second;
+    }
+
+    std::map<int, std::vector<std::string>> assign(const std::vector<std::string>& cities) const {
+        std::map<int, std::vector<std::string>> assignment;
+        for (const auto& city : cities) assignment[ownerOf(city)].push_back(city);
+        return assignment;
+    }
+
+    // FNV-1a followed by a splitmix64 finalizer to spread similar names around the ring.
+    static uint64_t hash(const std::string& key) {
+        uint64_t h = 1469598103934665603ULL;
+        for (unsigned char c : key) h = (h ^ c) * 1099511628211ULL;
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+
+private:
+    int virtualNodes;
+    std::map<uint64_t, int> ring;
+};
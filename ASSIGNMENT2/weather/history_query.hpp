@@ -0,0 +1,178 @@
+// Historical summaries over rawData, pushed down to MongoDB aggregation when it pays.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "aggregation.hpp"
+#include "mongo_handler.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+
+// HistoricalSummaryQuery class
+// Summaries of stored rawData readings for a city (or every city) between two times, overall or
+// per UTC day. Large ranges are pushed down to MongoDB as an aggregation pipeline: $match on
+// name and dt (served by the {name, dt} index), then $group per condition (and day), so only one
+// small document per group comes back. Ranges of up to localLimit readings are fetched (dt,
+// temperature and condition only) and summarised here, which skips the per-query setup of the
+// aggregation framework. A count with that limit picks the path.
+class HistoricalSummaryQuery {
+public:
+    enum Mode { Auto, Pushdown, Local };
+
+    struct Config {
+        Mode mode = Auto;
+        int64_t localLimit = 5000; // Auto summarises up to this many matching readings locally
+    };
+
+    struct Group {
+        int64_t count = 0;
+        double sum = 0; // Kelvin
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+    };
+    using Groups = std::map<std::pair<int64_t, std::string>, Group>; // (day, condition)
+
+    struct Result {
+        int64_t count = 0;
+        WeatherAggregator::WeatherSummary summary{std::nan(""), std::nan(""), std::nan(""), ""};
+        std::map<std::string, int64_t> conditions;
+        bool pushedDown = false;
+
+        nlohmann::json toJson() const {
+            nlohmann::json doc = {{"count", count}, {"dominantCondition", summary.dominantCondition},
+                                  {"conditions", conditions}, {"pushedDown", pushedDown}};
+            if (count) {
+                doc["averageTemp"] = summary.averageTemp;
+                doc["minTemp"] = summary.minTemp;
+                doc["maxTemp"] = summary.maxTemp;
+            }
+            return doc;
+        }
+    };
+
+    explicit HistoricalSummaryQuery(MongoDBHandler* dbHandler) : dbHandler(dbHandler) {}
+
+    void setConfig(Config config) { this->config = config; }
+
+    // Summary of the readings with from <= dt <= to; an empty city means every city.
+    Result summarize(const std::string& city, int64_t from, int64_t to) {
+        Groups groups;
+        bool pushedDown = run(city, from, to, false, groups);
+        Result result = finish(groups.begin(), groups.end());
+        result.pushedDown = pushedDown;
+        return result;
+    }
+
+    // One summary per UTC day (dt / 86400) with readings in the range.
+    std::map<int64_t, Result> summarizeDays(const std::string& city, int64_t from, int64_t to) {
+        Groups groups;
+        bool pushedDown = run(city, from, to, true, groups);
+        std::map<int64_t, Result> days;
+        for (auto it = groups.begin(); it != groups.end();) {
+            auto next = groups.lower_bound({it->first.first + 1, ""});
+            Result& day = days[it->first.first] = finish(it, next);
+            day.pushedDown = pushedDown;
+            it = next;
+        }
+        return days;
+    }
+
+    static nlohmann::json matchFilter(const std::string& city, int64_t from, int64_t to) {
+        nlohmann::json filter = {{"dt", {{"$gte", from}, {"$lte", to}}}, {"main.temp", {{"$type", "number"}}}};
+        if (!city.empty()) filter["name"] = city;
+        return filter;
+    }
+
+    // $match then $group on condition (and day start); temperatures stay in Kelvin until finish().
+    static nlohmann::json pipeline(const std::string& city, int64_t from, int64_t to, bool byDay) {
+        nlohmann::json key = {{"c", {{"$arrayElemAt", nlohmann::json::array({"$weather.main", 0})}}}};
+        if (byDay) {
+            key["d"] = {{"$subtract", nlohmann::json::array({"$dt", {{"$mod", nlohmann::json::array({"$dt", 86400})}}})}};
+        }
+        nlohmann::json group = {{"_id", key},
+                                {"n", {{"$sum", 1}}},
+                                {"sum", {{"$sum", "$main.temp"}}},
+                                {"min", {{"$min", "$main.temp"}}},
+                                {"max", {{"$max", "$main.temp"}}}};
+        return nlohmann::json::array({{{"$match", matchFilter(city, from, to)}}, {{"$group", group}}});
+    }
+
+    // Folds a fetched reading ({dt, main.temp, weather[0].main}) into its group. matchFilter
+    // guarantees dt and main.temp; a missing or malformed condition counts as none, as in mergeGroup.
+    static void accumulate(const nlohmann::json& doc, bool byDay, Groups& groups) {
+        std::string condition;
+        auto weather = doc.find("weather");
+        if (weather != doc.end() && weather->is_array() && !weather->empty() && weather->front().is_object()) {
+            auto main = weather->front().find("main");
+            if (main != weather->front().end() && main->is_string()) condition = main->get<std::string>();
+        }
+        double kelvin = doc["main"]["temp"].get<double>();
+        Group& group = groups[{byDay ? doc["dt"].get<int64_t>() / 86400 : 0, condition}];
+        ++group.count;
+        group.sum += kelvin;
+        group.min = std::min(group.min, kelvin);
+        group.max = std::max(group.max, kelvin);
+    }
+
+    // Adds one $group output document to the groups.
+    static void mergeGroup(const nlohmann::json& doc, Groups& groups) {
+        const auto& id = doc["_id"];
+        std::string condition = id.contains("c") && id["c"].is_string() ? id["c"].get<std::string>() : "";
+        int64_t day = id.contains("d") ? static_cast<int64_t>(id["d"].get<double>()) / 86400 : 0;
+        Group& group = groups[{day, condition}];
+        group.count += doc["n"].get<int64_t>();
+        group.sum += doc["sum"].get<double>();
+        group.min = std::min(group.min, doc["min"].get<double>());
+        group.max = std::max(group.max, doc["max"].get<double>());
+    }
+
+    // Combines the condition groups in [begin, end) into a summary in Celsius. The dominant
+    // condition is the most frequent one, ties going to the first by name.
+    static Result finish(Groups::const_iterator begin, Groups::const_iterator end) {
+        Result result;
+        double sum = 0, min = std::numeric_limits<double>::infinity(), max = -min;
+        for (auto it = begin; it != end; ++it) {
+            const Group& group = it->second;
+            result.count += group.count;
+            sum += group.sum;
+            min = std::min(min, group.min);
+            max = std::max(max, group.max);
+            if (!it->first.second.empty()) result.conditions[it->first.second] += group.count;
+        }
+        int64_t best = 0;
+        for (const auto& entry : result.conditions) {
+            if (entry.second > best) {
+                best = entry.second;
+                result.summary.dominantCondition = entry.first;
+            }
+        }
+        if (result.count) {
+            result.summary.averageTemp = sum / static_cast<double>(result.count) - 273.15;
+            result.summary.minTemp = min - 273.15;
+            result.summary.maxTemp = max - 273.15;
+        }
+        return result;
+    }
+
+private:
+    // Fills groups through the pipeline or locally; returns whether the work was pushed down.
+    bool run(const std::string& city, int64_t from, int64_t to, bool byDay, Groups& groups) {
+        nlohmann::json filter = matchFilter(city, from, to);
+        bool pushDown = config.mode == Pushdown ||
+                        (config.mode == Auto && dbHandler->countWeatherData(filter, config.localLimit + 1) > config.localLimit);
+        if (pushDown) {
+            for (const auto& doc : dbHandler->aggregateWeatherData(pipeline(city, from, to, byDay))) mergeGroup(doc, groups);
+        } else {
+            nlohmann::json projection = {{"_id", 0}, {"dt", 1}, {"main.temp", 1}, {"weather.main", 1}};
+            dbHandler->forEachWeatherData(filter, projection,
+                                          [&](const nlohmann::json& doc) { accumulate(doc, byDay, groups); });
+        }
+        return pushDown;
+    }
+
+    MongoDBHandler* dbHandler;
+    Config config;
+};
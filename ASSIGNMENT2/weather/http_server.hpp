@@ -0,0 +1,358 @@
+// Minimal HTTP/1.1 server for the local endpoints and the benchmark mock.
+#pragma once
+
+#include <zlib.h>
+#include "../../common/async_logger.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// HttpServer class
+// Minimal blocking HTTP/1.1 server on 127.0.0.1 for local endpoints. Connections are
+// handed to a fixed pool of worker threads and kept alive until the client closes, the
+// connection has gone idleTimeout without completing a request, or, between requests,
+// another connection is waiting for a worker. Request headers are capped at kMaxHeaderBytes.
+class HttpServer {
+public:
+    static constexpr size_t kMaxHeaderBytes = 16 * 1024;
+    static constexpr size_t kMaxBodyBytes = 1024 * 1024;
+
+    struct Request {
+        std::string method;
+        std::string path;
+        std::string query;
+        std::string headers;
+        std::string body;
+    };
+
+    struct Response {
+        int status = 200;
+        std::string contentType = "text/plain";
+        std::string contentEncoding; // e.g. "gzip" when body is already encoded
+        std::string body;
+    };
+
+    using Handler = std::function<Response(const Request&)>;
+
+    HttpServer(uint16_t port, Handler handler, int workers = 4)
+        : requestedPort(port), handler(std::move(handler)), workerCount(workers) {}
+
+    ~HttpServer() { stop(); }
+
+    bool start() {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) return false;
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(requestedPort);
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listenFd, 128) < 0) {
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+        socklen_t len = sizeof(addr);
+        getsockname(listenFd, reinterpret_cast<sockaddr*>(&addr), &len);
+        boundPort = ntohs(addr.sin_port);
+        running = true;
+        for (int i = 0; i < workerCount; ++i) workers.emplace_back(&HttpServer::workerLoop, this);
+        acceptThread = std::thread(&HttpServer::acceptLoop, this);
+        return true;
+    }
+
+    void stop() {
+        if (!running.exchange(false)) return;
+        shutdown(listenFd, SHUT_RDWR);
+        close(listenFd);
+        acceptThread.join();
+        pendingReady.notify_all();
+        for (auto& worker : workers) worker.join();
+        workers.clear();
+        for (int fd : pending) close(fd);
+        pending.clear();
+    }
+
+    uint16_t port() const { return boundPort; }
+
+    // Time a connection may take to send its next complete request head (30 s by default).
+    void setIdleTimeout(std::chrono::seconds timeout) { idleTimeout = timeout; }
+
+    // Returns the value of name in a query string such as "q=Delhi&appid=x", or "" if absent.
+    static std::string queryParam(const std::string& query, const std::string& name) {
+        size_t pos = 0;
+        while (pos <= query.size()) {
+            size_t end = query.find('&', pos);
+            if (end == std::string::npos) end = query.size();
+            size_t eq = query.find('=', pos);
+            if (eq != std::string::npos && eq < end && query.compare(pos, eq - pos, name) == 0 && eq - pos == name.size()) {
+                return query.substr(eq + 1, end - eq - 1);
+            }
+            pos = end + 1;
+        }
+        return "";
+    }
+
+    static std::string urlDecode(const std::string& value) {
+        std::string out;
+        out.reserve(value.size());
+        for (size_t i = 0; i < value.size(); ++i) {
+            if (value[i] == '+') {
+                out += ' ';
+            } else if (value[i] == '%' && i + 2 < value.size() && std::isxdigit(static_cast<unsigned char>(value[i + 1])) &&
+                       std::isxdigit(static_cast<unsigned char>(value[i + 2]))) {
+                out += static_cast<char>(std::stoi(value.substr(i + 1, 2), nullptr, 16));
+                i += 2;
+            } else {
+                out += value[i];
+            }
+        }
+        return out;
+    }
+
+    // Whether value is well-formed UTF-8 (no overlong forms, surrogates or code points past U+10FFFF).
+    static bool validUtf8(const std::string& value) {
+        for (size_t i = 0; i < value.size();) {
+            unsigned char lead = static_cast<unsigned char>(value[i]);
+            size_t length = lead < 0x80 ? 1 : lead >= 0xC2 && lead < 0xE0 ? 2 : lead >= 0xE0 && lead < 0xF0 ? 3
+                          : lead >= 0xF0 && lead < 0xF5 ? 4 : 0;
+            if (length == 0 || i + length > value.size()) return false;
+            unsigned char second = static_cast<unsigned char>(value[i + (length > 1)]);
+            if ((lead == 0xE0 && second < 0xA0) || (lead == 0xED && second > 0x9F) || (lead == 0xF0 && second < 0x90) ||
+                (lead == 0xF4 && second > 0x8F)) {
+                return false;
+            }
+            for (size_t k = 1; k < length; ++k) {
+                if ((static_cast<unsigned char>(value[i + k]) & 0xC0) != 0x80) return false;
+            }
+            i += length;
+        }
+        return true;
+    }
+
+    // Value of the named request header with surrounding blanks removed, or "" if absent.
+    // Header names compare case-insensitively, as HTTP requires.
+    static std::string header(const Request& request, const std::string& name) {
+        const std::string& headers = request.headers;
+        for (size_t pos = 0; pos < headers.size();) {
+            size_t end = headers.find("\r\n", pos);
+            if (end == std::string::npos) end = headers.size();
+            size_t colon = headers.find(':', pos);
+            if (colon < end && colon - pos == name.size() &&
+                std::equal(name.begin(), name.end(), headers.begin() + static_cast<std::ptrdiff_t>(pos), sameLetter)) {
+                size_t first = headers.find_first_not_of(" \t", colon + 1);
+                size_t last = headers.find_last_not_of(" \t", end - 1);
+                return first < end ? headers.substr(first, last - first + 1) : "";
+            }
+            pos = end + 2;
+        }
+        return "";
+    }
+
+    // Whether the request's Accept-Encoding header lists encoding (e.g. "gzip").
+    static bool acceptsEncoding(const Request& request, const std::string& encoding) {
+        return containsToken(header(request, "Accept-Encoding"), encoding);
+    }
+
+    // Encodes body as a single gzip member (zlib, default level).
+    static std::string gzip(const std::string& body) {
+        z_stream stream{};
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("deflateInit2 failed");
+        }
+        std::string out(deflateBound(&stream, static_cast<uLong>(body.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(body.data()));
+        stream.avail_in = static_cast<uInt>(body.size());
+        stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        stream.avail_out = static_cast<uInt>(out.size());
+        int result = deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        if (result != Z_STREAM_END) throw std::runtime_error("gzip encoding failed");
+        return out;
+    }
+
+private:
+    void acceptLoop() {
+        while (running) {
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0) continue;
+            timeval timeout{1, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pending.push_back(fd);
+            pendingReady.notify_one();
+        }
+    }
+
+    void workerLoop() {
+        while (true) {
+            int fd;
+            {
+                std::unique_lock<std::mutex> lock(pendingMutex);
+                pendingReady.wait(lock, [this] { return !pending.empty() || !running; });
+                if (!running) return;
+                fd = pending.front();
+                pending.pop_front();
+            }
+            serveConnection(fd);
+            close(fd);
+        }
+    }
+
+    void serveConnection(int fd) {
+        std::string buffer;
+        char chunk[4096];
+        while (running) {
+            // recv wakes at least every second (SO_RCVTIMEO) to check the deadline and the queue
+            auto deadline = std::chrono::steady_clock::now() + idleTimeout;
+            size_t headerEnd;
+            while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+                if (buffer.size() > kMaxHeaderBytes) {
+                    sendError(fd, 431, "request header too large\n");
+                    return;
+                }
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n > 0) {
+                    buffer.append(chunk, static_cast<size_t>(n));
+                } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && running) {
+                    if (std::chrono::steady_clock::now() >= deadline) return;
+                    if (buffer.empty() && connectionsWaiting()) return; // Idle keep-alive: hand the worker over
+                    continue;
+                } else {
+                    return;
+                }
+            }
+            if (headerEnd > kMaxHeaderBytes) {
+                sendError(fd, 431, "request header too large\n");
+                return;
+            }
+
+            Request request;
+            size_t lineEnd = buffer.find("\r\n");
+            std::istringstream requestLine(buffer.substr(0, lineEnd));
+            std::string target;
+            requestLine >> request.method >> target;
+            if (request.method.empty() || target.empty()) {
+                sendError(fd, 400, "malformed request line\n");
+                return;
+            }
+            size_t queryStart = target.find('?');
+            request.path = target.substr(0, queryStart);
+            if (queryStart != std::string::npos) request.query = target.substr(queryStart + 1);
+            request.headers = buffer.substr(lineEnd + 2, headerEnd - lineEnd);
+            buffer.erase(0, headerEnd + 4);
+
+            // Read the body so the next request on the connection starts where this one ends
+            std::string length = header(request, "Content-Length");
+            size_t bodyBytes = 0;
+            if (!length.empty()) {
+                auto parsed = std::from_chars(length.data(), length.data() + length.size(), bodyBytes);
+                if (parsed.ec != std::errc() || parsed.ptr != length.data() + length.size()) {
+                    sendError(fd, 400, "malformed Content-Length\n");
+                    return;
+                }
+                if (bodyBytes > kMaxBodyBytes) {
+                    sendError(fd, 413, "request body too large\n");
+                    return;
+                }
+            }
+            while (buffer.size() < bodyBytes) {
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n > 0) {
+                    buffer.append(chunk, static_cast<size_t>(n));
+                } else if (!(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && running &&
+                             std::chrono::steady_clock::now() < deadline)) {
+                    return;
+                }
+            }
+            request.body = buffer.substr(0, bodyBytes);
+            buffer.erase(0, bodyBytes);
+
+            // A throwing handler must not take the worker thread, and with it the process, down
+            Response response;
+            try {
+                response = handler(request);
+            } catch (const std::invalid_argument& e) {
+                response = Response{400, "text/plain", "", std::string(e.what()) + "\n"};
+            } catch (const std::exception& e) {
+                LOG_ERROR("Handler failed for {}: {}", request.path, e.what());
+                response = Response{500, "text/plain", "", "internal error\n"};
+            }
+            std::string message = "HTTP/1.1 " + std::to_string(response.status) + (response.status < 400 ? " OK" : " Error") +
+                                  "\r\nContent-Type: " + response.contentType +
+                                  (response.contentEncoding.empty() ? "" : "\r\nContent-Encoding: " + response.contentEncoding) +
+                                  "\r\nContent-Length: " + std::to_string(response.body.size()) + "\r\n\r\n";
+            message += response.body;
+            if (!sendAll(fd, message)) return;
+            if (containsToken(header(request, "Connection"), "close")) return;
+        }
+    }
+
+    // Answers with status and closes: the rest of the request cannot be parsed.
+    static void sendError(int fd, int status, const std::string& body) {
+        sendAll(fd, "HTTP/1.1 " + std::to_string(status) + " Error\r\nContent-Type: text/plain\r\nConnection: close"
+                    "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+    }
+
+    static bool sameLetter(char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+    }
+
+    // Whether a header value such as "gzip, br" mentions token, in any case.
+    static bool containsToken(const std::string& value, const std::string& token) {
+        return std::search(value.begin(), value.end(), token.begin(), token.end(), sameLetter) != value.end();
+    }
+
+    bool connectionsWaiting() {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        return !pending.empty();
+    }
+
+    static bool sendAll(int fd, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    uint16_t requestedPort;
+    uint16_t boundPort = 0;
+    Handler handler;
+    int workerCount;
+    std::chrono::seconds idleTimeout{30};
+    int listenFd = -1;
+    std::atomic<bool> running{false};
+    std::thread acceptThread;
+    std::vector<std::thread> workers;
+    std::mutex pendingMutex;
+    std::condition_variable pendingReady;
+    std::deque<int> pending;
+};
@@ -0,0 +1,517 @@
+// The ingestion pipeline of one worker: fetch, window, detect, store and serve.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "../../common/async_logger.hpp"
+#include "metrics.hpp"
+#include "observation.hpp"
+#include "latest_store.hpp"
+#include "range_index.hpp"
+#include "json_stream.hpp"
+#include "fetch.hpp"
+#include "aggregation.hpp"
+#include "metric_aggregator.hpp"
+#include "binary_io.hpp"
+#include "trend_estimator.hpp"
+#include "alert_manager.hpp"
+#include "city_registry.hpp"
+#include "dedup.hpp"
+#include "storage_filter.hpp"
+#include "forecast_errors.hpp"
+#include "anomaly_detector.hpp"
+#include "rollups.hpp"
+#include "station_index.hpp"
+#include "columnar_exporter.hpp"
+#include "mongo_handler.hpp"
+#include "poll_planner.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+// IngestWorker class
+// Polls an owned set of cities and keeps their in-flight aggregation state. When the shard
+// assignment changes, state for lost cities is written to the handoff directory and picked
+// up by the new owner; observations are merged, so the order of handoff and polling does not matter.
+class IngestWorker {
+public:
+    IngestWorker(MongoDBHandler* dbHandler, const std::string& apiKey, double alertThreshold)
+        : dbHandler(dbHandler), apiKey(apiKey), alertThreshold(alertThreshold),
+          windowEngine([this](const std::string& city, int64_t day, const RollupStats& stats, bool late) {
+              onDayClosed(city, day, stats, late);
+          }) {
+        TrendEstimator::Config trend;
+        trend.threshold = alertThreshold;
+        trends.setConfig(trend);
+    }
+
+    void setCities(const std::vector<std::string>& owned, const std::string& handoffDir) {
+        std::set<std::string> next(owned.begin(), owned.end());
+        for (auto it = cityData.begin(); it != cityData.end();) {
+            if (next.count(it->first)) {
+                ++it;
+                continue;
+            }
+            if (!handoffDir.empty()) exportState(handoffDir, it->first, it->second);
+            std::vector<nlohmann::json> tail;
+            storageFilter.flushCity(cityRegistry.idOf(it->first), tail);
+            store(tail);
+            pendingImports.erase(it->first);
+            pollPlanner.remove(cityRegistry.idOf(it->first));
+            it = cityData.erase(it);
+        }
+        int64_t now = static_cast<int64_t>(std::time(nullptr));
+        for (const auto& city : owned) {
+            if (!cityData.count(city)) {
+                cityData[city];
+                if (!handoffDir.empty()) pendingImports.insert(city);
+            }
+            if (pollPlanner.settings().enabled) pollPlanner.add(cityRegistry.idOf(city), now);
+        }
+        cities = owned;
+        this->handoffDir = handoffDir;
+    }
+
+    // Fetches every owned city through the FetchScheduler; failed cities are retried within the
+    // cycle and otherwise picked up again on the next one.
+    // With adaptive polling only the cities the planner reports as due are fetched.
+    void runCycle() {
+        importPendingState();
+        bool adaptive = pollPlanner.settings().enabled;
+        std::vector<std::string> due;
+        if (adaptive) {
+            dueIds.clear();
+            pollPlanner.due(static_cast<int64_t>(std::time(nullptr)), dueIds);
+            for (uint32_t id : dueIds) due.push_back(cityRegistry.name(id));
+        }
+        lastCycle = fetchScheduler.run(
+            adaptive ? due : cities, apiKey,
+            [this, adaptive](const std::string& city, const FetchScheduler::Response& response) {
+                try {
+                    if (adaptive) {
+                        pollPlanner.onObservation(cityRegistry.idOf(city), static_cast<int64_t>(std::time(nullptr)),
+                                                  response.observation.dt, response.observation.tempC);
+                    }
+                    offer(city, toDocument(city, response));
+                    ++fetched;
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Ingest failed for {}: {}", city, e.what());
+                }
+            },
+            [this, adaptive](const std::string& city, const std::string& error) {
+                if (adaptive) pollPlanner.onFailure(cityRegistry.idOf(city), static_cast<int64_t>(std::time(nullptr)));
+                LOG_ERROR("Fetch failed for {}: {}", city, error);
+            });
+        flushRollups();
+    }
+
+    // The rawData document for a streamed response: the upstream payload's layout, limited to the
+    // fields the pipeline reads back (replay, exports, summaries and history queries).
+    static nlohmann::json toDocument(const std::string& city, const FetchScheduler::Response& response) {
+        const Observation& obs = response.observation;
+        const WeatherReading& reading = response.reading;
+        auto put = [](nlohmann::json& object, const char* key, double value) {
+            if (std::isfinite(value)) object[key] = value;
+        };
+        nlohmann::json main = nlohmann::json::object();
+        put(main, "temp", obs.tempC + 273.15); // Back to Kelvin, as upstream sends it
+        put(main, "feels_like", reading.feelsLikeC + 273.15);
+        put(main, "temp_min", reading.tempMinC + 273.15);
+        put(main, "temp_max", reading.tempMaxC + 273.15);
+        put(main, "pressure", reading.pressure);
+        put(main, "humidity", reading.humidity);
+        nlohmann::json weather = nlohmann::json::array();
+        weather.push_back({{"main", obs.condition}});
+        nlohmann::json doc = {{"dt", obs.dt}, {"timezone", obs.timezone}, {"id", response.cityId}, {"name", city},
+                              {"main", std::move(main)}, {"weather", std::move(weather)}};
+        if (obs.hasCoord) doc["coord"] = {{"lat", obs.lat}, {"lon", obs.lon}};
+        if (std::isfinite(reading.windSpeed)) doc["wind"] = {{"speed", reading.windSpeed}};
+        if (std::isfinite(reading.clouds)) doc["clouds"] = {{"all", reading.clouds}};
+        return doc;
+    }
+
+    // Switches runCycle from polling every city to polling the cities the planner says are due.
+    void setAdaptivePolling(AdaptivePollPlanner::Config config) {
+        pollPlanner.setConfig(config);
+        int64_t now = static_cast<int64_t>(std::time(nullptr));
+        for (const auto& city : cities) pollPlanner.add(cityRegistry.idOf(city), now);
+    }
+
+    void setPollQuota(double requestsPerHour) { pollPlanner.setQuota(requestsPerHour); }
+    // Unix time of the next adaptive poll (INT64_MAX when adaptive polling is off).
+    int64_t nextPollDue() { return pollPlanner.settings().enabled ? pollPlanner.nextDue() : std::numeric_limits<int64_t>::max(); }
+
+    void setFetchConfig(FetchScheduler::Config config) { fetchScheduler.setConfig(config); }
+    const FetchScheduler::CycleStats& lastCycleStats() const { return lastCycle; }
+    const CircuitBreaker& circuitBreaker() const { return fetchScheduler.circuitBreaker(); }
+
+    // Pulls the 5-day/3-hour forecast for every owned city through the FetchScheduler, stores each
+    // run in bulk and queues it for scoring against the observations that follow. The accuracy
+    // scored so far is stored alongside.
+    size_t runForecastCycle() {
+        int64_t now = static_cast<int64_t>(std::time(nullptr));
+        int64_t runTime = now - now % ForecastErrorTracker::kLeadStep;
+        size_t total = 0;
+        lastForecastCycle = fetchScheduler.runForecasts(
+            cities, apiKey, runTime,
+            [this, &total](const std::string& city, const std::vector<ForecastRecord>& records) {
+                try {
+                    if (dbHandler) dbHandler->storeForecasts(city, records);
+                } catch (const std::exception& e) {
+                    LOG_ERROR("Forecast store failed for {}: {}", city, e.what());
+                }
+                uint32_t id = cityRegistry.idOf(city);
+                for (const auto& record : records) forecastErrors.addForecast(id, record);
+                total += records.size();
+            },
+            [](const std::string& city, const std::string& error) { LOG_ERROR("Forecast fetch failed for {}: {}", city, error); });
+        if (dbHandler) {
+            std::vector<std::pair<std::string, ForecastErrorTracker::ErrorStats>> accuracy;
+            for (uint32_t id = 0; id < forecastErrors.cityCount(); ++id) {
+                ForecastErrorTracker::ErrorStats stats = forecastErrors.city(id);
+                if (stats.count) accuracy.emplace_back(cityRegistry.name(id), stats);
+            }
+            try {
+                dbHandler->storeForecastAccuracy(accuracy);
+            } catch (const std::exception& e) {
+                LOG_ERROR("Forecast accuracy store failed: {}", e.what());
+            }
+        }
+        return total;
+    }
+
+    const FetchScheduler::CycleStats& lastForecastCycleStats() const { return lastForecastCycle; }
+
+    const ForecastErrorTracker& forecastAccuracy() const { return forecastErrors; }
+
+    // Ingests a polled reading unless the same (city, dt) was already taken, then hands it
+    // to the storage filter, which decides what reaches rawData.
+    bool offer(const std::string& city, nlohmann::json data) {
+        uint32_t id = cityRegistry.idOf(city);
+        if (!deduplicator.accept(id, data.value("dt", int64_t{0}))) {
+            PipelineMetrics::add(PipelineMetrics::DuplicatesSkipped);
+            return false;
+        }
+        std::vector<nlohmann::json> toStore;
+        storageFilter.offer(id, Observation::fromJson(data), data, toStore);
+        store(toStore);
+        ingest(city, std::move(data));
+        return true;
+    }
+
+    // Writes the readings the storage filter is still holding back.
+    void flushStorage() {
+        std::vector<nlohmann::json> toStore;
+        storageFilter.flushAll(toStore);
+        store(toStore);
+    }
+
+    void setStorageFilter(StorageFilter::Config config) { storageFilter.setConfig(config); }
+
+    // Window, horizon and minimum fit for predicted-breach alerts (the threshold is the alert threshold).
+    void setTrendConfig(TrendEstimator::Config config) {
+        config.threshold = alertThreshold;
+        trends.setConfig(config);
+    }
+
+    // Gap detection, filling and interpolation for the per-city day windows.
+    void setGapConfig(WindowEngine::GapConfig config) { windowEngine.setGapConfig(config); }
+
+    // Documents that passed the storage filter; counted even without a database for benchmarks.
+    uint64_t documentsStored() const { return stored; }
+
+    // Runs one observation through every in-memory stage (no raw storage). A reading older than
+    // the city's newest (handed-off history) only feeds the history stages; the current-state
+    // views, the threshold alert and the trend keep following the newest reading.
+    void ingest(const std::string& city, nlohmann::json data) {
+        Observation obs = Observation::fromJson(data);
+        double currentTemp = obs.tempC;
+        int hour = AnomalyDetector::hourOfDay(obs.dt, obs.timezone);
+        int64_t& watermark = watermarks[city];
+        bool newest = obs.dt >= watermark;
+        watermark = std::max(watermark, obs.dt);
+        if (latestStore && newest) latestStore->publish(city, obs);
+        if (leaderboard && newest) leaderboard->update(cityRegistry.idOf(city), city, obs.tempC);
+        if (rangeIndex) rangeIndex->add(city, obs.dt, obs.tempC);
+        if (columnarExporter) columnarExporter->addObservation(city, obs, WeatherReading::fromJson(data));
+        // With adaptive polling a gap is judged against the city's current poll interval
+        windowEngine.add(city, obs, pollPlanner.settings().enabled ? pollPlanner.intervalOf(cityRegistry.idOf(city)) : 0);
+        if (obs.hasCoord) {
+            uint32_t station = stationIndex.upsertStation(city, obs.lat, obs.lon);
+            auto region = cityRegions.find(city);
+            if (region != cityRegions.end()) stationIndex.setRegion(station, region->second);
+            if (newest) stationIndex.updateTemp(station, obs.tempC);
+        }
+        cityData[city].push_back(std::move(data));
+        if (newest) {
+            alertManager.checkForAlert(currentTemp, alertThreshold);
+            TrendEstimator::Prediction trend = trends.update(cityRegistry.idOf(city), obs.dt, currentTemp);
+            if (trend.alert) alertManager.raisePredictedBreach(city, currentTemp, alertThreshold, trend.breachIn, trend.slopePerHour);
+        }
+        forecastErrors.onObservation(cityRegistry.idOf(city), obs.dt, currentTemp);
+        float zScore = anomalyDetector.update(cityRegistry.idOf(city), static_cast<float>(currentTemp), hour);
+        if (anomalyDetector.isAnomalous(zScore)) alertManager.raiseAnomaly(city, currentTemp, zScore);
+    }
+
+    // Re-ingests raw documents newer than each owned city's restored watermark.
+    size_t replay(const std::vector<nlohmann::json>& rawData) {
+        std::unordered_map<std::string, int64_t> restored = watermarks;
+        size_t replayed = 0;
+        for (const auto& data : rawData) {
+            std::string city = data.value("name", "");
+            if (!cityData.count(city)) continue;
+            auto watermark = restored.find(city);
+            int64_t dt = data.value("dt", int64_t{0});
+            if (watermark != restored.end() && dt <= watermark->second) continue;
+            if (!deduplicator.accept(cityRegistry.idOf(city), dt)) continue;
+            ingest(city, data);
+            ++replayed;
+        }
+        flushRollups();
+        return replayed;
+    }
+
+    // Oldest per-city watermark over the owned cities; replay has to start after it.
+    int64_t replayStartTime() const {
+        int64_t oldest = std::numeric_limits<int64_t>::max();
+        for (const auto& entry : cityData) {
+            auto watermark = watermarks.find(entry.first);
+            oldest = std::min(oldest, watermark == watermarks.end() ? 0 : watermark->second);
+        }
+        return oldest == std::numeric_limits<int64_t>::max() ? 0 : oldest;
+    }
+
+    // Checkpointed state: in-flight observations, open day windows (with their sketches) and
+    // the anomaly baselines and trend windows behind alerts. Rollups are already persisted as they change.
+    void saveState(BinaryWriter& out) const {
+        out.pod<uint64_t>(watermarks.size());
+        for (const auto& entry : watermarks) {
+            out.str(entry.first);
+            out.pod(entry.second);
+        }
+        cityRegistry.save(out);
+        deduplicator.save(out);
+        anomalyDetector.save(out);
+        trends.save(out);
+        windowEngine.save(out);
+        out.pod<uint64_t>(cityData.size());
+        for (const auto& entry : cityData) {
+            out.str(entry.first);
+            std::vector<uint8_t> packed = nlohmann::json::to_msgpack(nlohmann::json(entry.second));
+            out.podVector(packed);
+        }
+    }
+
+    // Restores saveState() output and republishes each city's newest observation to the query side.
+    // Buffered observations from before the current UTC day are dropped: that day's summary was
+    // either stored already or is no longer due, and keeping them would grow the buffer forever.
+    void loadState(BinaryReader& in) {
+        int64_t today = static_cast<int64_t>(std::time(nullptr)) / 86400;
+        watermarks.clear();
+        uint64_t watermarkCount = in.pod<uint64_t>();
+        for (uint64_t i = 0; i < watermarkCount; ++i) {
+            std::string city = in.str();
+            watermarks[city] = in.pod<int64_t>();
+        }
+        cityRegistry.load(in);
+        deduplicator.load(in);
+        anomalyDetector.load(in);
+        trends.load(in);
+        windowEngine.load(in);
+        uint64_t count = in.pod<uint64_t>();
+        for (uint64_t i = 0; i < count; ++i) {
+            std::string city = in.str();
+            nlohmann::json entries = nlohmann::json::from_msgpack(in.podVector<uint8_t>());
+            auto& data = cityData[city];
+            data.clear();
+            if (!entries.is_array() || entries.empty()) continue;
+            Observation obs = Observation::fromJson(entries.back());
+            if (latestStore) latestStore->publish(city, obs);
+            if (leaderboard) leaderboard->update(cityRegistry.idOf(city), city, obs.tempC);
+            for (auto& entry : entries) {
+                if (entry.value("dt", int64_t{0}) / 86400 == today) data.push_back(std::move(entry));
+            }
+        }
+    }
+
+    bool hasData() const {
+        for (const auto& entry : cityData) {
+            if (!entry.second.empty()) return true;
+        }
+        return false;
+    }
+
+    // Headline summary of the buffered observations. The average is time-weighted like the day
+    // rollups: each city's readings are integrated in dt order with this worker's gap settings
+    // and the results merged, so a burst of polls does not outweigh the rest of the day. Cities
+    // with a single reading cover no time; with none covered it falls back to the sample mean.
+    // Min, max and the dominant condition are taken over the readings.
+    WeatherAggregator::WeatherSummary summarize() {
+        ObservationBatch batch;
+        RollupStats weighted;
+        WindowEngine windows([&weighted](const std::string&, int64_t, const RollupStats& stats, bool late) {
+            if (!late) weighted.merge(stats);
+        });
+        windows.setGapConfig(windowEngine.gapSettings());
+        std::vector<Observation> readings;
+        for (const auto& entry : cityData) {
+            readings.clear();
+            for (const auto& data : entry.second) {
+                batch.add(data);
+                readings.push_back(Observation::fromJson(data));
+            }
+            batch.endCity();
+            std::sort(readings.begin(), readings.end(), [](const Observation& a, const Observation& b) { return a.dt < b.dt; });
+            for (const auto& obs : readings) windows.add(entry.first, obs);
+        }
+        windows.closeAll();
+        WeatherAggregator::WeatherSummary summary = aggregator.calculateSummary(batch);
+        if (weighted.count) summary.averageTemp = weighted.average();
+        return summary;
+    }
+
+    // Humidity, pressure and wind alongside temperature over the buffered observations.
+    DailyMetrics summarizeMetrics() const {
+        DailyMetrics metrics;
+        for (const auto& entry : cityData) {
+            for (const auto& data : entry.second) metrics.add(WeatherReading::fromJson(data));
+        }
+        return metrics;
+    }
+
+    void clearState() {
+        for (auto& entry : cityData) entry.second.clear();
+    }
+
+    uint64_t observationsFetched() const { return fetched; }
+
+    RollupStore& rollups() { return rollupStore; }
+    const StationIndex& stations() const { return stationIndex; }
+
+    void setRegion(const std::string& city, const std::string& region) {
+        cityRegions[city] = region;
+        rollupStore.setRegion(city, region);
+    }
+
+    // Optional read-optimized view of the latest observation per city for QueryApi.
+    void setLatestStore(LatestObservationStore* store) { latestStore = store; }
+
+    // Optional live hottest/coldest ranking, indexed by this worker's city ids.
+    void setLeaderboard(TemperatureLeaderboard* board) { leaderboard = board; }
+
+    // Optional per-city time series for range min/max/avg queries.
+    void setRangeIndex(RangeAggregateIndex* index) { rangeIndex = index; }
+
+    // Optional Parquet export of every ingested observation and closed city-day.
+    void setColumnarExporter(ColumnarExporter* exporter) { columnarExporter = exporter; }
+
+    static std::string handoffPath(const std::string& dir, const std::string& city) {
+        std::string name = city;
+        std::replace_if(name.begin(), name.end(), [](char c) { return !std::isalnum(static_cast<unsigned char>(c)); }, '_');
+        return dir + "/" + name + ".handoff.json";
+    }
+
+private:
+    void flushRollups() {
+        if (!dbHandler) return;
+        for (const auto& rollup : rollupStore.takeDirty()) dbHandler->storeRollup(rollup.first, *rollup.second);
+    }
+
+    void onDayClosed(const std::string& city, int64_t day, const RollupStats& stats, bool late) {
+        // A late reading arrives alone; the stored day is the merged one, not the reading.
+        const RollupStats* stored = &stats;
+        if (late) {
+            stored = &rollupStore.mergeIntoDay(city, day, stats);
+        } else {
+            rollupStore.addDay(city, day, stats);
+        }
+        if (dbHandler) dbHandler->storeCityDailySummary(city, day, *stored);
+        if (columnarExporter && !late) columnarExporter->addSummary(city, day, stats);
+    }
+
+    static void exportState(const std::string& dir, const std::string& city, const std::vector<nlohmann::json>& data) {
+        if (data.empty()) return;
+        std::string path = handoffPath(dir, city);
+        nlohmann::json existing = nlohmann::json::array();
+        std::ifstream previous(path);
+        if (previous) existing = nlohmann::json::parse(previous, nullptr, false);
+        if (!existing.is_array()) existing = nlohmann::json::array();
+        for (const auto& entry : data) existing.push_back(entry);
+        std::ofstream(path + ".tmp", std::ios::trunc) << existing.dump();
+        std::rename((path + ".tmp").c_str(), path.c_str());
+    }
+
+    void store(const std::vector<nlohmann::json>& documents) {
+        stored += documents.size();
+        if (!dbHandler) return;
+        for (const auto& document : documents) dbHandler->storeWeatherData(document);
+    }
+
+    // Claims a handoff file by renaming it first, so two workers never merge the same state.
+    void importPendingState() {
+        for (auto it = pendingImports.begin(); it != pendingImports.end();) {
+            std::string path = handoffPath(handoffDir, *it);
+            std::string claimed = path + ".claimed." + std::to_string(getpid());
+            if (std::rename(path.c_str(), claimed.c_str()) != 0) {
+                ++it;
+                continue;
+            }
+            std::ifstream file(claimed);
+            nlohmann::json state = nlohmann::json::parse(file, nullptr, false);
+            if (state.is_array()) {
+                uint32_t id = cityRegistry.idOf(*it);
+                for (auto& entry : state) {
+                    // The new owner may already have polled the same reading. The previous owner
+                    // stored these in rawData, so they only go through the in-memory stages.
+                    if (deduplicator.accept(id, entry.value("dt", int64_t{0}))) ingest(*it, std::move(entry));
+                }
+            }
+            std::remove(claimed.c_str());
+            it = pendingImports.erase(it);
+        }
+    }
+
+    MongoDBHandler* dbHandler;
+    std::string apiKey;
+    double alertThreshold;
+    WeatherAggregator aggregator;
+    AlertManager alertManager;
+    CityRegistry cityRegistry;
+    ObservationDeduplicator deduplicator;
+    StorageFilter storageFilter;
+    ForecastErrorTracker forecastErrors;
+    AnomalyDetector anomalyDetector;
+    TrendEstimator trends;
+    WindowEngine windowEngine;
+    RollupStore rollupStore;
+    StationIndex stationIndex;
+    std::unordered_map<std::string, std::string> cityRegions;
+    std::vector<std::string> cities;
+    std::unordered_map<std::string, std::vector<nlohmann::json>> cityData;
+    std::set<std::string> pendingImports;
+    std::string handoffDir;
+    uint64_t fetched = 0;
+    FetchScheduler fetchScheduler;
+    FetchScheduler::CycleStats lastCycle;
+    FetchScheduler::CycleStats lastForecastCycle;
+    AdaptivePollPlanner pollPlanner;
+    std::vector<uint32_t> dueIds;
+    uint64_t stored = 0;
+    std::unordered_map<std::string, int64_t> watermarks; // newest dt ingested per city
+    LatestObservationStore* latestStore = nullptr;
+    TemperatureLeaderboard* leaderboard = nullptr;
+    ColumnarExporter* columnarExporter = nullptr;
+    RangeAggregateIndex* rangeIndex = nullptr;
+};
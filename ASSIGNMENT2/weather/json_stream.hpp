@@ -0,0 +1,473 @@
+// Streaming JSON tokenizer and the observation and forecast parsers built on it.
+#pragma once
+
+#include "observation.hpp"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+// JsonPushParser class
+// Incremental, DOM-free JSON tokenizer: bytes are pushed in whatever chunks the transport
+// delivers and events go to a Handler as soon as each token completes. Only the token in
+// flight is buffered, so a payload is never held in full.
+class JsonPushParser {
+public:
+    struct Handler {
+        virtual ~Handler() = default;
+        virtual void startObject() {}
+        virtual void endObject() {}
+        virtual void startArray() {}
+        virtual void endArray() {}
+        virtual void key(const std::string&) {}
+        virtual void string(const std::string&) {}
+        virtual void number(double) {}
+        virtual void literal(char) {} // 't', 'f' or 'n'
+    };
+
+    explicit JsonPushParser(Handler& handler) : handler(handler) {}
+
+    // Returns false once the input is known to be malformed.
+    bool feed(const char* data, size_t size) {
+        for (size_t i = 0; i < size && !failed; ++i) {
+            // Copy plain runs of strings and numbers in one go
+            if (state == String || state == Number) {
+                size_t end = i;
+                if (state == String) {
+                    while (end < size && data[end] != '"' && data[end] != '\\') ++end;
+                } else {
+                    while (end < size && isNumberChar(data[end])) ++end;
+                }
+                token.append(data + i, end - i);
+                if (end == size) break;
+                i = end;
+            }
+            consume(data[i]);
+        }
+        return !failed;
+    }
+
+    // Completes a trailing bare number; true when exactly one whole value was parsed.
+    bool finish() {
+        if (state == Number || state == Literal) endScalar();
+        return !failed && state == Value && containers.empty() && sawValue;
+    }
+
+    void reset() {
+        state = Value;
+        containers.clear();
+        token.clear();
+        expectKey = false;
+        isKey = false;
+        sawValue = false;
+        failed = false;
+        highSurrogate = 0;
+    }
+
+private:
+    enum State { Value, String, Escape, Unicode, Surrogate, Number, Literal };
+
+    static bool isNumberChar(char c) {
+        return (c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-';
+    }
+
+    void consume(char c) {
+        switch (state) {
+        case String:
+            if (c == '"') {
+                state = Value;
+                if (isKey) {
+                    handler.key(token);
+                } else {
+                    handler.string(token);
+                    sawValue = true;
+                }
+            } else if (c == '\\') {
+                state = Escape;
+            } else {
+                token += c;
+            }
+            return;
+        case Escape: {
+            static const char from[] = "\"\\/bfnrt", to[] = "\"\\/\b\f\n\r\t";
+            const char* hit = std::strchr(from, c);
+            if (c == 'u') {
+                state = Unicode;
+                unicode.clear();
+            } else if (hit && c) {
+                token += to[hit - from];
+                state = String;
+            } else {
+                failed = true;
+            }
+            return;
+        }
+        case Unicode: {
+            if (!std::isxdigit(static_cast<unsigned char>(c))) {
+                failed = true;
+                return;
+            }
+            unicode += c;
+            if (unicode.size() < 4) return;
+            uint32_t code = static_cast<uint32_t>(std::stoul(unicode, nullptr, 16));
+            if (highSurrogate) {
+                if (code < 0xDC00 || code > 0xDFFF) {
+                    failed = true;
+                    return;
+                }
+                code = 0x10000 + ((highSurrogate - 0xD800) << 10) + (code - 0xDC00);
+                highSurrogate = 0;
+            } else if (code >= 0xD800 && code <= 0xDBFF) {
+                highSurrogate = code;
+                state = Surrogate;
+                return;
+            } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                failed = true; // Low surrogate without a high one
+                return;
+            }
+            appendUtf8(code);
+            state = String;
+            return;
+        }
+        case Surrogate: // A high surrogate must be followed by the \u escape of a low one
+            if (c == '\\' && !unicode.empty()) {
+                unicode.clear();
+            } else if (c == 'u' && unicode.empty()) {
+                state = Unicode;
+            } else {
+                failed = true;
+            }
+            return;
+        case Number:
+            if (isNumberChar(c)) {
+                token += c;
+                return;
+            }
+            endScalar();
+            break;
+        case Literal:
+            if (std::isalpha(static_cast<unsigned char>(c))) {
+                token += c;
+                return;
+            }
+            endScalar();
+            break;
+        case Value:
+            break;
+        }
+        if (failed) return;
+
+        switch (c) {
+        case ' ': case '\t': case '\n': case '\r': case ':':
+            return;
+        case ',':
+            expectKey = !containers.empty() && containers.back() == '{';
+            return;
+        case '{':
+            containers.push_back('{');
+            expectKey = true;
+            handler.startObject();
+            return;
+        case '[':
+            containers.push_back('[');
+            expectKey = false;
+            handler.startArray();
+            return;
+        case '}':
+        case ']':
+            if (containers.empty() || containers.back() != (c == '}' ? '{' : '[')) {
+                failed = true;
+                return;
+            }
+            containers.pop_back();
+            c == '}' ? handler.endObject() : handler.endArray();
+            sawValue = true;
+            return;
+        case '"':
+            state = String;
+            isKey = expectKey;
+            expectKey = false;
+            token.clear();
+            return;
+        default:
+            token.assign(1, c);
+            if (c == '-' || std::isdigit(static_cast<unsigned char>(c))) {
+                state = Number;
+            } else if (c == 't' || c == 'f' || c == 'n') {
+                state = Literal;
+            } else {
+                failed = true;
+            }
+        }
+    }
+
+    void endScalar() {
+        if (state == Number) {
+            double value = 0;
+            auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+            failed = result.ec != std::errc() || result.ptr != token.data() + token.size();
+            if (!failed) handler.number(value);
+        } else {
+            failed = token != "true" && token != "false" && token != "null";
+            if (!failed) handler.literal(token[0]);
+        }
+        state = Value;
+        sawValue = true;
+    }
+
+    void appendUtf8(uint32_t code) {
+        if (code < 0x80) {
+            token += static_cast<char>(code);
+        } else if (code < 0x800) {
+            token += static_cast<char>(0xC0 | (code >> 6));
+            token += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            token += static_cast<char>(0xE0 | (code >> 12));
+            token += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            token += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            token += static_cast<char>(0xF0 | (code >> 18));
+            token += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            token += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            token += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    Handler& handler;
+    State state = Value;
+    std::vector<char> containers;
+    std::string token;
+    std::string unicode;
+    uint32_t highSurrogate = 0; // Waiting for its low surrogate
+    bool expectKey = false;
+    bool isKey = false;
+    bool sawValue = false;
+    bool failed = false;
+};
+
+// ForecastRecord: one entry of a 5-day/3-hour forecast, as issued by a forecast run.
+struct ForecastRecord {
+    int64_t runTime = 0;    // When the forecast was fetched, floored to the 3-hour issue cycle
+    int64_t targetTime = 0; // The "dt" the forecast is for
+    double tempC = 0;
+    double humidity = 0;
+    char condition[16] = {};
+};
+
+// ForecastStreamParser: picks list[].dt, list[].main.temp/humidity and list[].weather[0].main
+// out of a forecast payload as it streams in, and emits a record as each list entry closes.
+class ForecastStreamParser : private JsonPushParser::Handler {
+public:
+    using RecordHandler = std::function<void(const ForecastRecord&)>;
+
+    ForecastStreamParser(int64_t runTime, RecordHandler onRecord)
+        : runTime(runTime), onRecord(std::move(onRecord)), parser(*this) {}
+
+    // Starts a new payload for another forecast run, keeping the buffers.
+    void reset(int64_t nextRunTime) {
+        parser.reset();
+        runTime = nextRunTime;
+        frames.clear();
+        pendingKey.clear();
+        emitted = 0;
+    }
+
+    bool feed(const char* data, size_t size) { return parser.feed(data, size); }
+    bool finish() { return parser.finish(); }
+    size_t records() const { return emitted; }
+
+private:
+    // Container frames: the key they hang off and, for arrays, how many elements were seen.
+    struct Frame {
+        std::string key;
+        bool array;
+        int elements;
+    };
+
+    void open(bool array) {
+        if (!frames.empty() && frames.back().array) frames.back().elements++;
+        frames.push_back({pendingKey, array, 0});
+        pendingKey.clear();
+    }
+
+    // An entry object sits directly in the top-level "list" array.
+    bool inEntryObject() const { return frames.size() == 3 && frames[1].key == "list"; }
+    bool inEntry() const { return frames.size() >= 3 && frames[1].key == "list"; }
+
+    void startObject() override {
+        open(false);
+        if (inEntryObject()) current = ForecastRecord{runTime};
+    }
+    void startArray() override { open(true); }
+    void endArray() override { frames.pop_back(); }
+    void endObject() override {
+        if (inEntryObject()) {
+            onRecord(current);
+            ++emitted;
+        }
+        frames.pop_back();
+    }
+    void key(const std::string& name) override { pendingKey = name; }
+
+    void number(double value) override {
+        if (!inEntry()) return;
+        if (frames.size() == 3 && pendingKey == "dt") current.targetTime = static_cast<int64_t>(value);
+        if (frames.size() == 4 && frames[3].key == "main") {
+            if (pendingKey == "temp") current.tempC = value - 273.15;
+            if (pendingKey == "humidity") current.humidity = value;
+        }
+        pendingKey.clear();
+    }
+
+    void string(const std::string& value) override {
+        // list[i].weather[0].main
+        if (inEntry() && frames.size() == 5 && frames[3].key == "weather" && frames[3].elements == 1 && pendingKey == "main") {
+            std::strncpy(current.condition, value.c_str(), sizeof(current.condition) - 1);
+        }
+        pendingKey.clear();
+    }
+
+    void literal(char) override { pendingKey.clear(); }
+
+    int64_t runTime;
+    RecordHandler onRecord;
+    JsonPushParser parser;
+    std::vector<Frame> frames;
+    std::string pendingKey;
+    ForecastRecord current;
+    size_t emitted = 0;
+};
+
+// ObservationStreamParser: fills a caller-owned Observation (and optionally a WeatherReading)
+// from a current weather payload as it streams in. Keys and container frames live in fixed
+// arrays and the tokenizer keeps its buffers between payloads, so once warmed up parsing
+// allocates nothing.
+class ObservationStreamParser : private JsonPushParser::Handler {
+public:
+    ObservationStreamParser() : parser(*this) {}
+
+    void reset(Observation& target, WeatherReading* readingTarget = nullptr) {
+        parser.reset();
+        slot = &target;
+        *slot = Observation{};
+        reading = readingTarget;
+        if (reading) {
+            double missing = std::numeric_limits<double>::quiet_NaN();
+            *reading = {missing, missing, missing, missing, missing, missing, missing, missing};
+        }
+        cityId = 0;
+        depth = 0;
+        pendingKey[0] = '\0';
+        fields = 0;
+    }
+
+    // Upstream city id (top-level "id"), 0 if the payload had none.
+    int64_t id() const { return cityId; }
+
+    bool feed(const char* data, size_t size) { return parser.feed(data, size); }
+
+    // True when the payload was well-formed and carried dt and main.temp.
+    bool finish() { return parser.finish() && (fields & (kDt | kTemp)) == (kDt | kTemp); }
+
+private:
+    static constexpr int kMaxDepth = 8;
+    static constexpr size_t kKeyLength = 16;
+    enum Field { kDt = 1, kTemp = 2 };
+
+    struct Frame {
+        char key[kKeyLength];
+        bool array;
+        int elements;
+    };
+
+    bool keyIs(const char* name) const { return std::strcmp(pendingKey, name) == 0; }
+    bool frameIs(int index, const char* name) const { return depth > index && std::strcmp(frames[index].key, name) == 0; }
+
+    void open(bool array) {
+        if (depth > 0 && frames[depth - 1].array) frames[depth - 1].elements++;
+        if (depth < kMaxDepth) {
+            std::memcpy(frames[depth].key, pendingKey, kKeyLength);
+            frames[depth].array = array;
+            frames[depth].elements = 0;
+        }
+        ++depth;
+        pendingKey[0] = '\0';
+    }
+
+    void startObject() override { open(false); }
+    void startArray() override { open(true); }
+    void endObject() override { --depth; }
+    void endArray() override { --depth; }
+
+    void key(const std::string& name) override {
+        size_t length = std::min(name.size(), kKeyLength - 1);
+        std::memcpy(pendingKey, name.data(), length);
+        pendingKey[length] = '\0';
+    }
+
+    void setReading(double WeatherReading::*field, double value) {
+        if (reading) reading->*field = value;
+    }
+
+    void number(double value) override {
+        if (depth == 1 && keyIs("dt")) {
+            slot->dt = static_cast<int64_t>(value);
+            fields |= kDt;
+        } else if (depth == 1 && keyIs("timezone")) {
+            slot->timezone = static_cast<int64_t>(value);
+        } else if (depth == 1 && keyIs("id")) {
+            cityId = static_cast<int64_t>(value);
+        } else if (depth == 2 && frameIs(1, "main")) {
+            if (keyIs("temp")) {
+                slot->tempC = value - 273.15; // Convert from Kelvin to Celsius
+                fields |= kTemp;
+                setReading(&WeatherReading::tempC, slot->tempC);
+            } else if (keyIs("humidity")) {
+                slot->humidity = value;
+                setReading(&WeatherReading::humidity, value);
+            } else if (keyIs("feels_like")) {
+                setReading(&WeatherReading::feelsLikeC, value - 273.15);
+            } else if (keyIs("temp_min")) {
+                setReading(&WeatherReading::tempMinC, value - 273.15);
+            } else if (keyIs("temp_max")) {
+                setReading(&WeatherReading::tempMaxC, value - 273.15);
+            } else if (keyIs("pressure")) {
+                setReading(&WeatherReading::pressure, value);
+            }
+        } else if (depth == 2 && frameIs(1, "wind") && keyIs("speed")) {
+            setReading(&WeatherReading::windSpeed, value);
+        } else if (depth == 2 && frameIs(1, "clouds") && keyIs("all")) {
+            setReading(&WeatherReading::clouds, value);
+        } else if (depth == 2 && frameIs(1, "coord") && (keyIs("lat") || keyIs("lon"))) {
+            (keyIs("lat") ? slot->lat : slot->lon) = value;
+            slot->hasCoord = true;
+        }
+        pendingKey[0] = '\0';
+    }
+
+    void string(const std::string& value) override {
+        // weather[0].main
+        if (depth == 3 && frameIs(1, "weather") && frames[1].elements == 1 && keyIs("main")) {
+            std::strncpy(slot->condition, value.c_str(), sizeof(slot->condition) - 1);
+        }
+        pendingKey[0] = '\0';
+    }
+
+    void literal(char) override { pendingKey[0] = '\0'; }
+
+    JsonPushParser parser;
+    Observation* slot = nullptr;
+    WeatherReading* reading = nullptr;
+    int64_t cityId = 0;
+    Frame frames[kMaxDepth] = {};
+    int depth = 0;
+    char pendingKey[kKeyLength] = {};
+    int fields = 0;
+};
@@ -0,0 +1,347 @@
+// Seqlock-published serving state: latest observation per city and the temperature leaderboard.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "observation.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// SeqlockCell: single-writer cell for a trivially copyable T. The value is copied word by word
+// through relaxed atomics, so concurrent reads are well-defined; the sequence number tells the
+// reader whether its copy was torn, in which case it retries. The writer never waits.
+template <class T>
+struct alignas(64) SeqlockCell {
+    static constexpr size_t kWords = (sizeof(T) + 7) / 8;
+
+    std::atomic<uint64_t> seq{0};
+    std::array<std::atomic<uint64_t>, kWords> words{};
+
+    void store(const T& value) {
+        uint64_t buffer[kWords] = {};
+        std::memcpy(buffer, &value, sizeof(T));
+        uint64_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kWords; ++i) words[i].store(buffer[i], std::memory_order_relaxed);
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    // Writer-side read of its own last store.
+    void load(T& value) const {
+        uint64_t buffer[kWords];
+        for (size_t i = 0; i < kWords; ++i) buffer[i] = words[i].load(std::memory_order_relaxed);
+        std::memcpy(&value, buffer, sizeof(T));
+    }
+
+    void read(T& value) const {
+        uint64_t buffer[kWords];
+        while (true) {
+            uint64_t before = seq.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            for (size_t i = 0; i < kWords; ++i) buffer[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == before) break;
+        }
+        std::memcpy(&value, buffer, sizeof(T));
+    }
+};
+
+// LatestObservationStore class
+// Latest observation and current UTC-day summary per city for dashboards. Each slot is guarded
+// by a seqlock: the single ingest writer never waits, and readers retry if they raced a write.
+// The name index is published RCU-style (copy on insert, atomic pointer swap), so lookups never
+// wait for an insert. The swap and each lookup's load go through std::atomic_load/atomic_store on
+// a shared_ptr, which libstdc++ implements with a small pool of spinlocks held for just the
+// pointer copy; the store is therefore not lock-free, only free of long waits. Every write also
+// refreshes a precomputed JSON fragment for the slot.
+class LatestObservationStore {
+public:
+    struct Record {
+        int64_t dt;
+        int64_t day;
+        float temp;
+        float humidity;
+        float dayMin;
+        float dayMax;
+        double daySum;
+        uint32_t dayCount;
+        uint16_t jsonLength;
+        char condition[16];
+        char json[256];
+    };
+
+    explicit LatestObservationStore(size_t capacity)
+        : capacity(capacity), slots(new Slot[capacity]), index(std::make_shared<const Index>()) {}
+
+    // Writer side; returns false when the store is full or the name is too long to fragment.
+    bool publish(const std::string& city, const Observation& obs) {
+        auto current = std::atomic_load(&index);
+        auto it = current->find(city);
+        uint32_t id;
+        if (it != current->end()) {
+            id = it->second;
+        } else {
+            if (current->size() >= capacity || city.size() > kMaxNameLength) return false;
+            id = static_cast<uint32_t>(current->size());
+            quotedNames.push_back(nlohmann::json(city).dump());
+            auto next = std::make_shared<Index>(*current);
+            next->emplace(city, id);
+            std::atomic_store(&index, std::shared_ptr<const Index>(std::move(next)));
+        }
+
+        Slot& slot = slots[id];
+        Record record;
+        slot.load(record); // sole writer: no concurrent modification to race with
+        int64_t day = obs.dt / 86400;
+        if (slot.seq.load(std::memory_order_relaxed) == 0 || record.day != day) {
+            record.day = day;
+            record.dayCount = 0;
+            record.daySum = 0;
+            record.dayMin = 1e9f;
+            record.dayMax = -1e9f;
+        }
+        record.dt = obs.dt;
+        record.temp = static_cast<float>(obs.tempC);
+        record.humidity = static_cast<float>(obs.humidity);
+        record.dayMin = std::min(record.dayMin, record.temp);
+        record.dayMax = std::max(record.dayMax, record.temp);
+        record.daySum += obs.tempC;
+        ++record.dayCount;
+        std::memcpy(record.condition, obs.condition, sizeof(record.condition));
+        int length = std::snprintf(record.json, sizeof(record.json),
+                                   "{\"city\":%s,\"dt\":%lld,\"temp\":%.2f,\"humidity\":%.0f,\"condition\":%s,"
+                                   "\"day\":{\"count\":%u,\"avg\":%.2f,\"min\":%.2f,\"max\":%.2f}}",
+                                   quotedNames[id].c_str(), static_cast<long long>(record.dt), record.temp,
+                                   record.humidity, quotedCondition(record.condition).c_str(), record.dayCount,
+                                   record.daySum / record.dayCount, record.dayMin, record.dayMax);
+        record.jsonLength = static_cast<uint16_t>(std::min<int>(length, sizeof(record.json) - 1));
+        slot.store(record);
+        return true;
+    }
+
+    // Reader side; safe to call from any thread and never waits for the writer.
+    bool read(const std::string& city, Record& out) const {
+        auto current = std::atomic_load(&index);
+        auto it = current->find(city);
+        if (it == current->end()) return false;
+        slots[it->second].read(out);
+        return true;
+    }
+
+    // Batched lookup: appends {"results":[...],"missing":[...]} built from precomputed fragments.
+    void appendBatchJson(const std::vector<std::string>& cities, std::string& out) const {
+        auto current = std::atomic_load(&index);
+        Record record;
+        std::string missing;
+        out += "{\"results\":[";
+        bool first = true;
+        for (const auto& city : cities) {
+            auto it = current->find(city);
+            if (it == current->end()) {
+                // Names come from the request: invalid UTF-8 is replaced rather than thrown on
+                missing += missing.empty() ? "" : ",";
+                missing += nlohmann::json(city).dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+                continue;
+            }
+            slots[it->second].read(record);
+            if (!first) out += ',';
+            out.append(record.json, record.jsonLength);
+            first = false;
+        }
+        out += "],\"missing\":[" + missing + "]}";
+    }
+
+    std::vector<std::string> cityNames() const {
+        auto current = std::atomic_load(&index);
+        std::vector<std::string> names(current->size());
+        for (const auto& entry : *current) names[entry.second] = entry.first;
+        return names;
+    }
+
+private:
+    using Index = std::unordered_map<std::string, uint32_t>;
+    using Slot = SeqlockCell<Record>;
+    static constexpr size_t kMaxNameLength = 96;
+    static constexpr size_t kMaxQuotedConditions = 64;
+
+    // The condition comes from upstream, so it is escaped like the city names. Only a handful of
+    // conditions exist: they are quoted once and found again by a linear scan.
+    const std::string& quotedCondition(const char (&condition)[16]) {
+        std::string raw(condition, strnlen(condition, sizeof(condition))); // Fits the small-string buffer
+        for (const auto& entry : quotedConditions) {
+            if (entry.first == raw) return entry.second;
+        }
+        if (quotedConditions.size() == kMaxQuotedConditions) {
+            scratchCondition = nlohmann::json(raw).dump();
+            return scratchCondition;
+        }
+        quotedConditions.emplace_back(raw, nlohmann::json(raw).dump());
+        return quotedConditions.back().second;
+    }
+
+    size_t capacity;
+    std::unique_ptr<Slot[]> slots;
+    std::shared_ptr<const Index> index;
+    std::vector<std::string> quotedNames; // writer only
+    std::vector<std::pair<std::string, std::string>> quotedConditions; // writer only: (raw, quoted)
+    std::string scratchCondition;
+};
+
+// TemperatureLeaderboard class
+// Live hottest/coldest ranking over each city's latest temperature. The writer keeps an ordered
+// set (O(log n) per observation) and a Fenwick tree over 0.01 °C buckets; readers get the
+// top-K lists from seqlock snapshots, republished only when an update touches the top K, and
+// rank queries from the Fenwick tree's atomic counters, so the query side never locks.
+class TemperatureLeaderboard {
+public:
+    static constexpr int kMaxK = 64;
+    static constexpr int kMinCenti = -10000; // -100 °C
+    static constexpr int kMaxCenti = 7000;   // +70 °C
+
+    struct Entry {
+        int32_t centiDegrees;
+        uint32_t city;
+        char name[28];
+    };
+
+    struct Snapshot {
+        uint32_t size;
+        Entry entries[kMaxK];
+    };
+
+    explicit TemperatureLeaderboard(size_t capacity) : latest(capacity), buckets(kMaxCenti - kMinCenti + 2) {
+        for (auto& b : buckets) b.store(0, std::memory_order_relaxed);
+        for (auto& t : latest) t.store(kAbsent, std::memory_order_relaxed);
+        Snapshot empty{};
+        hottest.store(empty);
+        coldest.store(empty);
+    }
+
+    // Writer side. Cities beyond the capacity are ignored.
+    void update(uint32_t city, const std::string& name, double tempC) {
+        if (city >= latest.size()) return;
+        if (names.size() <= city) names.resize(city + 1);
+        if (names[city].empty()) {
+            // Cut on a code point boundary so the stored name stays valid UTF-8
+            size_t length = std::min(name.size(), sizeof(Entry::name) - 1);
+            while (length < name.size() && length > 0 && (static_cast<unsigned char>(name[length]) & 0xC0) == 0x80) --length;
+            names[city] = name.substr(0, length);
+        }
+        int32_t centi = static_cast<int32_t>(std::lround(std::min(std::max(tempC, kMinCenti / 100.0), kMaxCenti / 100.0) * 100));
+
+        bool touchesHot = false, touchesCold = false;
+        int32_t previous = latest[city].load(std::memory_order_relaxed);
+        if (previous != kAbsent) {
+            if (previous == centi) return;
+            touchesHot = inTop(previous, city, true);
+            touchesCold = inTop(previous, city, false);
+            order.erase({previous, city});
+            fenwickAdd(bucketOf(previous), -1);
+        }
+        latest[city].store(centi, std::memory_order_relaxed);
+        order.insert({centi, city});
+        fenwickAdd(bucketOf(centi), 1);
+        count.store(static_cast<uint32_t>(order.size()), std::memory_order_relaxed);
+
+        touchesHot = touchesHot || inTop(centi, city, true);
+        touchesCold = touchesCold || inTop(centi, city, false);
+        if (touchesHot) publish(true);
+        if (touchesCold) publish(false);
+    }
+
+    // Reader side: up to k (<= kMaxK) entries, hottest or coldest first.
+    std::vector<Entry> top(int k, bool hot) const {
+        Snapshot snapshot;
+        (hot ? hottest : coldest).read(snapshot);
+        k = std::min<int>(k, static_cast<int>(snapshot.size));
+        return std::vector<Entry>(snapshot.entries, snapshot.entries + std::max(k, 0));
+    }
+
+    // 1-based rank of a temperature among the latest per-city temperatures (1 = hottest).
+    uint32_t rankOfTemperature(double tempC) const {
+        int32_t centi = static_cast<int32_t>(std::lround(tempC * 100));
+        return count.load(std::memory_order_relaxed) - fenwickPrefix(bucketOf(centi)) + 1;
+    }
+
+    // Rank of a city's latest temperature (ties share the best rank); 0 if unknown.
+    uint32_t rankOfCity(uint32_t city) const {
+        if (city >= latest.size()) return 0;
+        int32_t centi = latest[city].load(std::memory_order_relaxed);
+        return centi == kAbsent ? 0 : rankOfTemperature(centi / 100.0);
+    }
+
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    using Key = std::pair<int32_t, uint32_t>;
+    static constexpr int32_t kAbsent = std::numeric_limits<int32_t>::min();
+
+    static int bucketOf(int32_t centi) {
+        return std::min(std::max(centi, kMinCenti), kMaxCenti) - kMinCenti + 1; // 1-based for the Fenwick tree
+    }
+
+    // True if (centi, city) is, or would be, within the last published top kMaxK. The boundary
+    // can only move when the top changes, which always republishes, so the cached one is exact.
+    bool inTop(int32_t centi, uint32_t city, bool hot) const {
+        if (order.size() <= static_cast<size_t>(kMaxK)) return true;
+        Key key{centi, city};
+        return hot ? !(key < hotBoundary) : !(coldBoundary < key);
+    }
+
+    void publish(bool hot) {
+        Snapshot snapshot{};
+        auto fill = [&](auto first, auto last) {
+            for (; first != last && snapshot.size < static_cast<uint32_t>(kMaxK); ++first) {
+                Entry& entry = snapshot.entries[snapshot.size++];
+                entry.centiDegrees = first->first;
+                entry.city = first->second;
+                std::strncpy(entry.name, names[first->second].c_str(), sizeof(entry.name) - 1);
+            }
+        };
+        if (hot) {
+            fill(order.rbegin(), order.rend());
+            hottest.store(snapshot);
+        } else {
+            fill(order.begin(), order.end());
+            coldest.store(snapshot);
+        }
+        const Entry& last = snapshot.entries[snapshot.size - 1];
+        (hot ? hotBoundary : coldBoundary) = Key{last.centiDegrees, last.city};
+    }
+
+    void fenwickAdd(int index, int32_t delta) {
+        for (; index < static_cast<int>(buckets.size()); index += index & -index) {
+            buckets[index].store(buckets[index].load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+        }
+    }
+
+    // Number of cities in buckets 1..index.
+    uint32_t fenwickPrefix(int index) const {
+        int32_t sum = 0;
+        for (; index > 0; index -= index & -index) sum += buckets[index].load(std::memory_order_relaxed);
+        return static_cast<uint32_t>(std::max(sum, 0));
+    }
+
+    std::vector<std::atomic<int32_t>> latest;
+    std::vector<std::atomic<int32_t>> buckets;
+    std::set<Key> order;
+    Key hotBoundary{};
+    Key coldBoundary{};
+    std::vector<std::string> names;
+    std::atomic<uint32_t> count{0};
+    SeqlockCell<Snapshot> hottest;
+    SeqlockCell<Snapshot> coldest;
+};
@@ -0,0 +1,192 @@
+// Compile-time generated per-metric statistics for the daily summary.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <bsoncxx/builder/stream/document.hpp>
+#include "observation.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Metric descriptors for MetricAggregator: the document key prefix and how to read the value.
+namespace metric {
+struct Temperature { static constexpr const char* key = "temp"; static double read(const WeatherReading& r) { return r.tempC; } };
+struct FeelsLike { static constexpr const char* key = "feelsLike"; static double read(const WeatherReading& r) { return r.feelsLikeC; } };
+struct TempMin { static constexpr const char* key = "tempMin"; static double read(const WeatherReading& r) { return r.tempMinC; } };
+struct TempMax { static constexpr const char* key = "tempMax"; static double read(const WeatherReading& r) { return r.tempMaxC; } };
+struct Pressure { static constexpr const char* key = "pressure"; static double read(const WeatherReading& r) { return r.pressure; } };
+struct Humidity { static constexpr const char* key = "humidity"; static double read(const WeatherReading& r) { return r.humidity; } };
+struct WindSpeed { static constexpr const char* key = "windSpeed"; static double read(const WeatherReading& r) { return r.windSpeed; } };
+struct Clouds { static constexpr const char* key = "clouds"; static double read(const WeatherReading& r) { return r.clouds; } };
+} // namespace metric
+
+// Statistics for MetricAggregator. Each keeps its own state, can be merged with a partial
+// from another shard, and names the suffix of its document field. value() is not finite
+// until the statistic has seen a sample.
+namespace stats {
+struct Count {
+    static constexpr const char* suffix = "Count";
+    uint64_t n = 0;
+    void add(double) { ++n; }
+    void merge(const Count& other) { n += other.n; }
+    double value() const { return static_cast<double>(n); }
+};
+
+struct Mean {
+    static constexpr const char* suffix = "Avg";
+    uint64_t n = 0;
+    double sum = 0;
+    void add(double v) { ++n, sum += v; }
+    void merge(const Mean& other) { n += other.n, sum += other.sum; }
+    double value() const { return n ? sum / static_cast<double>(n) : std::numeric_limits<double>::quiet_NaN(); }
+};
+
+struct Min {
+    static constexpr const char* suffix = "Min";
+    double v = std::numeric_limits<double>::infinity();
+    void add(double x) { v = std::min(v, x); }
+    void merge(const Min& other) { v = std::min(v, other.v); }
+    double value() const { return v; }
+};
+
+struct Max {
+    static constexpr const char* suffix = "Max";
+    double v = -std::numeric_limits<double>::infinity();
+    void add(double x) { v = std::max(v, x); }
+    void merge(const Max& other) { v = std::max(v, other.v); }
+    double value() const { return v; }
+};
+
+// Population variance (Welford update, Chan merge)
+struct Variance {
+    static constexpr const char* suffix = "Var";
+    uint64_t n = 0;
+    double mean = 0;
+    double m2 = 0;
+    void add(double x) {
+        ++n;
+        double delta = x - mean;
+        mean += delta / static_cast<double>(n);
+        m2 += delta * (x - mean);
+    }
+    void merge(const Variance& other) {
+        if (other.n == 0) return;
+        uint64_t total = n + other.n;
+        double delta = other.mean - mean;
+        mean += delta * static_cast<double>(other.n) / static_cast<double>(total);
+        m2 += other.m2 + delta * delta * static_cast<double>(n) * static_cast<double>(other.n) / static_cast<double>(total);
+        n = total;
+    }
+    double value() const { return n ? m2 / static_cast<double>(n) : std::numeric_limits<double>::quiet_NaN(); }
+};
+} // namespace stats
+
+template <class... Ts>
+struct TypeList {};
+
+// MetricAggregator class template
+// Aggregates a compile-time list of metrics, each with the same compile-time list of statistics.
+// State is one std::tuple of statistics per metric in a flat array, and add(), merge() and the
+// document fields ("tempAvg", "humidityMax", ...) are expanded per metric and statistic by
+// fold expressions, so there is no runtime dispatch or map lookup.
+template <class Metrics, class Stats>
+class MetricAggregator;
+
+template <class... Metrics, class... Stats>
+class MetricAggregator<TypeList<Metrics...>, TypeList<Stats...>> {
+public:
+    static constexpr size_t kMetrics = sizeof...(Metrics);
+
+    template <class Source>
+    void add(const Source& source) {
+        addAll(source, std::index_sequence_for<Metrics...>{});
+    }
+
+    void merge(const MetricAggregator& other) {
+        for (size_t m = 0; m < kMetrics; ++m) mergeCell(cells[m], other.cells[m], std::index_sequence_for<Stats...>{});
+    }
+
+    template <class Metric, class Stat>
+    double get() const {
+        static_assert(indexOf<Metric>() < kMetrics, "metric is not aggregated");
+        return std::get<Stat>(cells[indexOf<Metric>()]).value();
+    }
+
+    // Calls f(key, value) for every metric and statistic, metric-major, skipping metrics that
+    // had no samples.
+    template <class F>
+    void forEachField(F&& f) const {
+        visitMetrics(f, std::index_sequence_for<Metrics...>{});
+    }
+
+    // Appends every field to a BSON document, e.g. the daily summary.
+    void appendTo(bsoncxx::builder::stream::document& document) const {
+        forEachField([&document](const std::string& key, double value) { document << key << value; });
+    }
+
+    nlohmann::json toJson() const {
+        nlohmann::json out = nlohmann::json::object();
+        forEachField([&out](const std::string& key, double value) { out[key] = value; });
+        return out;
+    }
+
+private:
+    using Cell = std::tuple<Stats...>;
+
+    template <class Metric>
+    static constexpr size_t indexOf() {
+        constexpr bool matches[] = {std::is_same<Metric, Metrics>::value...};
+        for (size_t i = 0; i < kMetrics; ++i) {
+            if (matches[i]) return i;
+        }
+        return kMetrics;
+    }
+
+    template <class Source, size_t... I>
+    void addAll(const Source& source, std::index_sequence<I...>) {
+        (addValue(cells[I], Metrics::read(source)), ...);
+    }
+
+    static void addValue(Cell& cell, double value) {
+        if (std::isnan(value)) return; // Field missing from this observation
+        std::apply([value](auto&... stats) { (stats.add(value), ...); }, cell);
+    }
+
+    template <size_t... S>
+    static void mergeCell(Cell& into, const Cell& from, std::index_sequence<S...>) {
+        (std::get<S>(into).merge(std::get<S>(from)), ...);
+    }
+
+    template <class F, size_t... I>
+    void visitMetrics(F& f, std::index_sequence<I...>) const {
+        (visitStats<Metrics>(f, cells[I]), ...);
+    }
+
+    template <class Metric, class F>
+    static void visitStats(F& f, const Cell& cell) {
+        auto emit = [&f](const std::string& key, double value) {
+            if (std::isfinite(value)) f(key, value);
+        };
+        (emit(fieldKey<Metric, Stats>(), std::get<Stats>(cell).value()), ...);
+    }
+
+    // Built once per metric/statistic pair
+    template <class Metric, class Stat>
+    static const std::string& fieldKey() {
+        static const std::string key = std::string(Metric::key) + Stat::suffix;
+        return key;
+    }
+
+    std::array<Cell, kMetrics> cells{};
+};
+
+// Daily summary fields beyond temperature and condition
+using DailyMetrics = MetricAggregator<TypeList<metric::Temperature, metric::Humidity, metric::Pressure, metric::WindSpeed>,
+                                      TypeList<stats::Mean, stats::Min, stats::Max>>;
@@ -0,0 +1,174 @@
+// Pipeline instrumentation: latency histograms, per-stage counters and scoped stage timers.
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// LatencyHistogram class
+// HDR-style log-linear histogram over nanoseconds: each power of two is split into
+// 16 linear sub-buckets, so any recorded value is off by at most ~6%.
+// Written by a single thread, read concurrently by the exporter.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kBuckets = 64 * kSubBuckets;
+
+    void record(uint64_t ns) {
+        bump(counts[bucketIndex(ns)], 1);
+        bump(total, 1);
+        bump(sumNs, ns);
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sumNs.load(std::memory_order_relaxed); }
+    uint64_t bucketCount(int index) const { return counts[index].load(std::memory_order_relaxed); }
+
+    void mergeInto(LatencyHistogram& other) const {
+        for (int i = 0; i < kBuckets; ++i) {
+            uint64_t c = bucketCount(i);
+            if (c) other.counts[i].fetch_add(c, std::memory_order_relaxed);
+        }
+        other.total.fetch_add(count(), std::memory_order_relaxed);
+        other.sumNs.fetch_add(sum(), std::memory_order_relaxed);
+    }
+
+    // Upper bound (ns) of the bucket holding the q-th quantile.
+    uint64_t percentile(double q) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(n - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += bucketCount(i);
+            if (seen >= rank) return bucketUpperBound(i);
+        }
+        return bucketUpperBound(kBuckets - 1);
+    }
+
+    static int bucketIndex(uint64_t v) {
+        if (v < kSubBuckets) return static_cast<int>(v);
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - kSubBucketBits;
+        return (shift + 1) * kSubBuckets + static_cast<int>((v >> shift) & (kSubBuckets - 1));
+    }
+
+    static uint64_t bucketUpperBound(int index) {
+        if (index < kSubBuckets) return static_cast<uint64_t>(index);
+        int shift = index / kSubBuckets - 1;
+        uint64_t base = static_cast<uint64_t>(kSubBuckets + index % kSubBuckets) << shift;
+        return base + ((uint64_t{1} << shift) - 1);
+    }
+
+private:
+    // Single writer: a relaxed load/store pair avoids a locked read-modify-write.
+    static void bump(std::atomic<uint64_t>& cell, uint64_t by) {
+        cell.store(cell.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, kBuckets> counts{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sumNs{0};
+};
+
+// PipelineMetrics class
+// Per-thread shards of stage histograms and counters; the exporter sums them on read.
+class PipelineMetrics {
+public:
+    enum Stage { DnsLookup, Connect, HttpTransfer, Parse, MongoInsert, Aggregate, AlertCheck, CheckpointPause, StageCount };
+    enum Counter { BytesReceived, FetchErrors, Retries, FastFailed, Hedges, MongoErrors, DuplicatesSkipped, CounterCount };
+
+    struct Shard {
+        std::array<LatencyHistogram, StageCount> stages;
+        std::array<std::atomic<uint64_t>, CounterCount> counters{};
+    };
+
+    static const char* stageName(int stage) {
+        static const char* names[] = {"dns", "connect", "http", "parse", "mongo_insert", "aggregate", "alert_check",
+                                      "checkpoint_pause"};
+        return names[stage];
+    }
+
+    static const char* counterName(int counter) {
+        static const char* names[] = {"bytes_received", "fetch_errors", "retries", "fetch_fast_failed", "fetch_hedges",
+                                      "mongo_errors", "duplicates_skipped"};
+        return names[counter];
+    }
+
+    static bool enabled() { return enabledFlag().load(std::memory_order_relaxed); }
+    static void setEnabled(bool on) { enabledFlag().store(on, std::memory_order_relaxed); }
+
+    static void recordStage(Stage stage, uint64_t ns) {
+        if (enabled()) localShard().stages[stage].record(ns);
+    }
+
+    static void add(Counter counter, uint64_t by = 1) {
+        if (!enabled()) return;
+        auto& cell = localShard().counters[counter];
+        cell.store(cell.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    // Sums every thread's shard into out.
+    static void collect(Shard& out) {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        for (const auto& shard : registry()) {
+            for (int s = 0; s < StageCount; ++s) shard->stages[s].mergeInto(out.stages[s]);
+            for (int c = 0; c < CounterCount; ++c) {
+                out.counters[c].fetch_add(shard->counters[c].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    static std::atomic<bool>& enabledFlag() {
+        static std::atomic<bool> flag{true};
+        return flag;
+    }
+
+    static std::mutex& registryMutex() {
+        static std::mutex m;
+        return m;
+    }
+
+    // Shards outlive their threads so counts from finished workers are still exported.
+    static std::vector<std::shared_ptr<Shard>>& registry() {
+        static std::vector<std::shared_ptr<Shard>> shards;
+        return shards;
+    }
+
+    static Shard& localShard() {
+        thread_local Shard* shard = nullptr;
+        if (!shard) {
+            auto owned = std::make_shared<Shard>();
+            std::lock_guard<std::mutex> lock(registryMutex());
+            registry().push_back(owned);
+            shard = owned.get();
+        }
+        return *shard;
+    }
+};
+
+// ScopedStageTimer: records the lifetime of the scope into a pipeline stage histogram
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(PipelineMetrics::Stage s) : stage(s), active(PipelineMetrics::enabled()) {
+        if (active) start = std::chrono::steady_clock::now();
+    }
+
+    ~ScopedStageTimer() {
+        if (active) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            PipelineMetrics::recordStage(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    }
+
+private:
+    PipelineMetrics::Stage stage;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,113 @@
+// Prometheus text export of PipelineMetrics, over HTTP and to a file.
+#pragma once
+
+#include "metrics.hpp"
+#include "http_server.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// MetricsExporter class
+// Renders PipelineMetrics in Prometheus text format, served over HTTP and/or dumped to a file.
+class MetricsExporter {
+public:
+    static std::string renderPrometheus() {
+        static const double bucketBoundsSeconds[] = {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+                                                      0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+        PipelineMetrics::Shard totals;
+        PipelineMetrics::collect(totals);
+
+        std::ostringstream out;
+        out << "# TYPE weather_stage_latency_seconds histogram\n";
+        for (int s = 0; s < PipelineMetrics::StageCount; ++s) {
+            const auto& hist = totals.stages[s];
+            const char* stage = PipelineMetrics::stageName(s);
+            uint64_t cumulative = 0;
+            int bucket = 0;
+            for (double bound : bucketBoundsSeconds) {
+                uint64_t boundNs = static_cast<uint64_t>(bound * 1e9);
+                for (; bucket < LatencyHistogram::kBuckets && LatencyHistogram::bucketUpperBound(bucket) <= boundNs; ++bucket) {
+                    cumulative += hist.bucketCount(bucket);
+                }
+                out << "weather_stage_latency_seconds_bucket{stage=\"" << stage << "\",le=\"" << bound << "\"} " << cumulative << "\n";
+            }
+            out << "weather_stage_latency_seconds_bucket{stage=\"" << stage << "\",le=\"+Inf\"} " << hist.count() << "\n"
+                << "weather_stage_latency_seconds_sum{stage=\"" << stage << "\"} " << hist.sum() / 1e9 << "\n"
+                << "weather_stage_latency_seconds_count{stage=\"" << stage << "\"} " << hist.count() << "\n";
+        }
+
+        out << "# TYPE weather_stage_latency_quantile_seconds gauge\n";
+        for (int s = 0; s < PipelineMetrics::StageCount; ++s) {
+            for (double q : {0.5, 0.99, 0.999}) {
+                out << "weather_stage_latency_quantile_seconds{stage=\"" << PipelineMetrics::stageName(s)
+                    << "\",quantile=\"" << q << "\"} " << totals.stages[s].percentile(q) / 1e9 << "\n";
+            }
+        }
+
+        for (int c = 0; c < PipelineMetrics::CounterCount; ++c) {
+            const char* name = PipelineMetrics::counterName(c);
+            out << "# TYPE weather_" << name << "_total counter\n"
+                << "weather_" << name << "_total " << totals.counters[c].load(std::memory_order_relaxed) << "\n";
+        }
+        return out.str();
+    }
+
+    bool serve(uint16_t port) {
+        server = std::make_unique<HttpServer>(port, [](const HttpServer::Request& request) {
+            HttpServer::Response response;
+            if (request.path != "/metrics") {
+                response.status = 404;
+                return response;
+            }
+            response.contentType = "text/plain; version=0.0.4";
+            response.body = renderPrometheus();
+            return response;
+        }, 1);
+        return server->start();
+    }
+
+    // Writes to a temporary file and renames it so readers never see a partial dump.
+    static bool dumpToFile(const std::string& path) {
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::trunc);
+            if (!file) return false;
+            file << renderPrometheus();
+        }
+        return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+    void startPeriodicDump(const std::string& path, std::chrono::seconds interval) {
+        dumping = true;
+        dumpThread = std::thread([this, path, interval] {
+            std::unique_lock<std::mutex> lock(dumpMutex);
+            while (!dumpStop.wait_for(lock, interval, [this] { return !dumping; })) {
+                dumpToFile(path);
+            }
+        });
+    }
+
+    ~MetricsExporter() {
+        {
+            std::lock_guard<std::mutex> lock(dumpMutex);
+            dumping = false;
+        }
+        dumpStop.notify_all();
+        if (dumpThread.joinable()) dumpThread.join();
+    }
+
+private:
+    std::unique_ptr<HttpServer> server;
+    std::thread dumpThread;
+    std::mutex dumpMutex;
+    std::condition_variable dumpStop;
+    bool dumping = false;
+};
@@ -0,0 +1,123 @@
+// Local stand-in for the OpenWeatherMap API, used by benchmarks.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "http_server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Function to build an OpenWeatherMap-shaped current weather payload for the mock server and benchmarks
+inline std::string makeSamplePayload(const std::string& city, double tempKelvin, int64_t dt) {
+    static const char* conditions[] = {"Clear", "Clouds", "Rain", "Haze"};
+    nlohmann::json payload = {
+        {"coord", {{"lon", 77.2}, {"lat", 28.6}}},
+        {"weather", {{{"id", 800}, {"main", conditions[dt % 4]}, {"description", "sample"}}}},
+        {"main", {{"temp", tempKelvin}, {"feels_like", tempKelvin}, {"pressure", 1008}, {"humidity", 40}}},
+        {"wind", {{"speed", 3.1}, {"deg", 270}}},
+        {"dt", dt},
+        {"id", std::hash<std::string>{}(city) % 10000000},
+        {"name", city}};
+    return payload.dump();
+}
+
+// Function to build an OpenWeatherMap-shaped 5-day/3-hour forecast payload (40 entries from runTime)
+inline std::string makeSampleForecast(const std::string& city, double baseKelvin, int64_t runTime) {
+    static const char* conditions[] = {"Clear", "Clouds", "Rain", "Haze"};
+    nlohmann::json list = nlohmann::json::array();
+    for (int i = 0; i < 40; ++i) {
+        int64_t target = runTime + (i + 1) * 3 * 3600;
+        double temp = baseKelvin + 6.0 * std::sin(static_cast<double>(target % 86400) / 86400.0 * 2 * M_PI);
+        list.push_back({{"dt", target},
+                        {"main", {{"temp", temp}, {"feels_like", temp}, {"temp_min", temp - 1}, {"temp_max", temp + 1},
+                                  {"pressure", 1008}, {"humidity", 40 + i % 20}}},
+                        {"weather", {{{"id", 800}, {"main", conditions[(target / 3600) % 4]}, {"description", "sample"},
+                                      {"icon", "01d"}}}},
+                        {"clouds", {{"all", 0}}},
+                        {"wind", {{"speed", 3.1}, {"deg", 270}}},
+                        {"visibility", 10000},
+                        {"pop", 0},
+                        {"dt_txt", "2024-01-01 00:00:00"}});
+    }
+    nlohmann::json payload = {{"cod", "200"}, {"message", 0}, {"cnt", 40}, {"list", list},
+                              {"city", {{"id", std::hash<std::string>{}(city) % 10000000}, {"name", city},
+                                        {"coord", {{"lat", 28.6}, {"lon", 77.2}}}, {"timezone", 19800}}}};
+    return payload.dump();
+}
+
+// MockWeatherServer class
+// Local stand-in for the OpenWeatherMap current weather and forecast endpoints, used by benchmarks.
+class MockWeatherServer {
+public:
+    explicit MockWeatherServer(uint16_t port = 0, int workers = 16)
+        : server(port, [this](const HttpServer::Request& request) { return handle(request); }, workers) {}
+
+    bool start() { return server.start(); }
+    std::string baseUrl() const { return "http://127.0.0.1:" + std::to_string(server.port()); }
+    uint64_t requestsServed() const { return served.load(std::memory_order_relaxed); }
+    uint64_t failuresInjected() const { return injected.load(std::memory_order_relaxed); }
+
+    // Fraction of valid requests answered with 503, chosen by hashing a request counter.
+    void setFailureRate(double rate) { failurePerMillion.store(static_cast<uint32_t>(rate * 1e6), std::memory_order_relaxed); }
+    // Delay before every answer, standing in for WAN round trips. With paretoAlpha > 0 the delay is
+    // Pareto distributed with `delay` as its minimum (heavy tail; smaller alpha, heavier), capped at 1000x.
+    void setLatency(std::chrono::microseconds delay, double paretoAlpha = 0) {
+        latencyUs.store(delay.count(), std::memory_order_relaxed);
+        latencyAlpha.store(paretoAlpha, std::memory_order_relaxed);
+    }
+
+private:
+    HttpServer::Response handle(const HttpServer::Request& request) {
+        HttpServer::Response response;
+        std::string city = HttpServer::queryParam(request.query, "q");
+        bool forecast = request.path == "/data/2.5/forecast";
+        if ((request.path != "/data/2.5/weather" && !forecast) || city.empty()) {
+            response.status = 404;
+            response.body = R"({"cod":"404","message":"city not found"})";
+            return response;
+        }
+        uint64_t x = requestCounter.fetch_add(1, std::memory_order_relaxed) * 0x9e3779b97f4a7c15ULL; // splitmix64
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        if (int64_t delay = latencyUs.load(std::memory_order_relaxed)) {
+            double alpha = latencyAlpha.load(std::memory_order_relaxed);
+            double u = static_cast<double>((x >> 11) + 1) / 9007199254740993.0; // (0, 1], independent of the failure draw
+            double scale = alpha > 0 ? std::min(std::pow(u, -1.0 / alpha), 1000.0) : 1.0;
+            std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(delay * scale)));
+        }
+        if (x % 1000000 < failurePerMillion.load(std::memory_order_relaxed)) {
+            injected.fetch_add(1, std::memory_order_relaxed);
+            response.status = 503;
+            response.body = R"({"cod":"503","message":"injected failure"})";
+            return response;
+        }
+        served.fetch_add(1, std::memory_order_relaxed);
+        // Each city gets a stable base temperature with a slow daily swing.
+        int64_t now = static_cast<int64_t>(std::time(nullptr));
+        double base = 270.0 + static_cast<double>(std::hash<std::string>{}(city) % 40);
+        double swing = 6.0 * std::sin(static_cast<double>(now % 86400) / 86400.0 * 2 * M_PI);
+        response.contentType = "application/json";
+        response.body = forecast ? makeSampleForecast(city, base, now - now % (3 * 3600))
+                                 : makeSamplePayload(city, base + swing, now - now % 600);
+        if (HttpServer::acceptsEncoding(request, "gzip")) { // Like the real API, compress when asked
+            response.body = HttpServer::gzip(response.body);
+            response.contentEncoding = "gzip";
+        }
+        return response;
+    }
+
+    std::atomic<uint64_t> served{0};
+    std::atomic<uint64_t> injected{0};
+    std::atomic<uint64_t> requestCounter{0};
+    std::atomic<uint32_t> failurePerMillion{0};
+    std::atomic<int64_t> latencyUs{0};
+    std::atomic<double> latencyAlpha{0};
+    HttpServer server;
+};
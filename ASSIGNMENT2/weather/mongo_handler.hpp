@@ -0,0 +1,243 @@
+// MongoDB storage of raw observations, summaries, forecasts and rollups.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/instance.hpp>
+#include <mongocxx/uri.hpp>
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/model/replace_one.hpp>
+#include <mongocxx/pipeline.hpp>
+#include <mongocxx/options/aggregate.hpp>
+#include <mongocxx/options/bulk_write.hpp>
+#include <mongocxx/options/count.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/options/index.hpp>
+#include <mongocxx/options/replace.hpp>
+#include <bsoncxx/json.hpp>
+#include <bsoncxx/builder/stream/document.hpp>
+#include "../../common/async_logger.hpp"
+#include "metrics.hpp"
+#include "json_stream.hpp"
+#include "aggregation.hpp"
+#include "metric_aggregator.hpp"
+#include "forecast_errors.hpp"
+#include "rollups.hpp"
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// MongoDBHandler class
+class MongoDBHandler {
+public:
+    explicit MongoDBHandler(const std::string& database = "weatherDB") {
+        mongocxx::instance instance{};
+        client = mongocxx::client{mongocxx::uri{"mongodb://localhost:27017"}};
+        db = client[database];
+        mongocxx::options::index unique;
+        unique.unique(true);
+        createReadingIndex(unique);
+        db["rawData"].create_index(bsoncxx::from_json(R"({"name": 1, "dt": 1})")); // Historical summary queries
+        db["rawData"].create_index(bsoncxx::from_json(R"({"dt": 1})"));            // Replay and all-city ranges
+        db["forecasts"].create_index(bsoncxx::from_json(R"({"city": 1, "run": 1, "target": 1})"), unique);
+    }
+
+    // Upserted by (city id, dt), so a reading stored twice still yields one document.
+    void storeWeatherData(const nlohmann::json& data) {
+        ScopedStageTimer timer(PipelineMetrics::MongoInsert);
+        auto collection = db["rawData"];
+        nlohmann::json filter = {{"id", data.value("id", int64_t{0})}, {"dt", data.value("dt", int64_t{0})}};
+        bsoncxx::document::value doc_value = bsoncxx::from_json(data.dump());
+        collection.replace_one(bsoncxx::from_json(filter.dump()), doc_value.view(), mongocxx::options::replace{}.upsert(true));
+    }
+
+    // Shard workers each summarise only their own cities, so their documents carry the worker id;
+    // a day's figures for all cities come from merging the documents with the same day.
+    void storeDailySummary(const WeatherAggregator::WeatherSummary& summary, const DailyMetrics* metrics = nullptr,
+                           int64_t day = -1, int worker = -1) {
+        ScopedStageTimer timer(PipelineMetrics::MongoInsert);
+        auto collection = db["dailySummaries"];
+        bsoncxx::builder::stream::document document{};
+        if (day >= 0) document << "day" << day;
+        if (worker >= 0) document << "worker" << worker;
+        document << "averageTemp" << summary.averageTemp
+                 << "maxTemp" << summary.maxTemp
+                 << "minTemp" << summary.minTemp
+                 << "dominantCondition" << summary.dominantCondition;
+        if (metrics) metrics->appendTo(document);
+        collection.insert_one(document.view());
+    }
+
+    // One unordered bulk write per forecast run; re-fetching a run overwrites it in place.
+    void storeForecasts(const std::string& city, const std::vector<ForecastRecord>& records) {
+        if (records.empty()) return;
+        ScopedStageTimer timer(PipelineMetrics::MongoInsert);
+        auto collection = db["forecasts"];
+        mongocxx::options::bulk_write options;
+        options.ordered(false);
+        auto bulk = collection.create_bulk_write(options);
+        for (const auto& record : records) {
+            nlohmann::json key = {{"city", city}, {"run", record.runTime}, {"target", record.targetTime}};
+            nlohmann::json doc = key;
+            doc["temp"] = record.tempC;
+            doc["humidity"] = record.humidity;
+            doc["condition"] = record.condition;
+            mongocxx::model::replace_one upsert{bsoncxx::from_json(key.dump()), bsoncxx::from_json(doc.dump())};
+            upsert.upsert(true);
+            bulk.append(upsert);
+        }
+        bulk.execute();
+    }
+
+    // Unordered bulk upsert of raw observations, keyed like storeWeatherData.
+    void storeWeatherDataBatch(const std::vector<nlohmann::json>& documents) {
+        if (documents.empty()) return;
+        ScopedStageTimer timer(PipelineMetrics::MongoInsert);
+        mongocxx::options::bulk_write options;
+        options.ordered(false);
+        auto bulk = db["rawData"].create_bulk_write(options);
+        for (const auto& data : documents) {
+            nlohmann::json key = {{"id", data.value("id", int64_t{0})}, {"dt", data.value("dt", int64_t{0})}};
+            mongocxx::model::replace_one upsert{bsoncxx::from_json(key.dump()), bsoncxx::from_json(data.dump())};
+            upsert.upsert(true);
+            bulk.append(upsert);
+        }
+        bulk.execute();
+    }
+
+    // Number of raw observations matching filter, counting no further than limit.
+    int64_t countWeatherData(const nlohmann::json& filter, int64_t limit) {
+        mongocxx::options::count options;
+        options.limit(limit);
+        return db["rawData"].count_documents(bsoncxx::from_json(filter.dump()), options);
+    }
+
+    // Streams the projected raw observations matching filter to onDocument.
+    void forEachWeatherData(const nlohmann::json& filter, const nlohmann::json& projection,
+                            const std::function<void(const nlohmann::json&)>& onDocument) {
+        mongocxx::options::find options;
+        options.projection(bsoncxx::from_json(projection.dump()));
+        auto cursor = db["rawData"].find(bsoncxx::from_json(filter.dump()), options);
+        for (const auto& doc : cursor) onDocument(nlohmann::json::parse(bsoncxx::to_json(doc)));
+    }
+
+    // Runs an aggregation pipeline, given as a JSON array of stages, over rawData.
+    std::vector<nlohmann::json> aggregateWeatherData(const nlohmann::json& stages) {
+        mongocxx::pipeline pipeline;
+        for (const auto& stage : stages) pipeline.append_stage(bsoncxx::from_json(stage.dump()));
+        std::vector<nlohmann::json> documents;
+        mongocxx::options::aggregate options;
+        options.allow_disk_use(true);
+        auto cursor = db["rawData"].aggregate(pipeline, options);
+        for (const auto& doc : cursor) documents.push_back(nlohmann::json::parse(bsoncxx::to_json(doc)));
+        return documents;
+    }
+
+    // Whether the server answers a ping.
+    bool reachable() {
+        try {
+            db.run_command(bsoncxx::from_json(R"({"ping": 1})"));
+            return true;
+        } catch (const std::exception& e) {
+            LOG_WARN("MongoDB unreachable: {}", e.what());
+            return false;
+        }
+    }
+
+    // Removes repeated (id, dt) readings from rawData, keeping the first of each; returns how many went.
+    int64_t removeDuplicateReadings() {
+        nlohmann::json stages = nlohmann::json::array(
+            {{{"$group", {{"_id", {{"id", "$id"}, {"dt", "$dt"}}}, {"keep", {{"$first", "$_id"}}}, {"n", {{"$sum", 1}}}}}},
+             {{"$match", {{"n", {{"$gt", 1}}}}}}});
+        int64_t removed = 0;
+        for (const auto& group : aggregateWeatherData(stages)) {
+            nlohmann::json filter = {{"id", group["_id"]["id"]}, {"dt", group["_id"]["dt"]}, {"_id", {{"$ne", group["keep"]}}}};
+            auto result = db["rawData"].delete_many(bsoncxx::from_json(filter.dump()));
+            if (result) removed += result->deleted_count();
+        }
+        return removed;
+    }
+
+    // Raw observations newer than dt, oldest first, for replay after a restore.
+    std::vector<nlohmann::json> loadWeatherDataSince(int64_t dt) {
+        auto collection = db["rawData"];
+        mongocxx::options::find options;
+        options.sort(bsoncxx::from_json(R"({"dt": 1})"));
+        std::vector<nlohmann::json> documents;
+        auto cursor = collection.find(bsoncxx::from_json(nlohmann::json{{"dt", {{"$gt", dt}}}}.dump()), options);
+        for (const auto& doc : cursor) documents.push_back(nlohmann::json::parse(bsoncxx::to_json(doc)));
+        return documents;
+    }
+
+    void storeCityDailySummary(const std::string& city, int64_t day, const RollupStats& stats) {
+        ScopedStageTimer timer(PipelineMetrics::MongoInsert);
+        auto collection = db["cityDailySummaries"];
+        nlohmann::json doc = stats.toJson();
+        doc["city"] = city;
+        doc["day"] = day;
+        collection.replace_one(bsoncxx::from_json(nlohmann::json{{"city", city}, {"day", day}}.dump()),
+                               bsoncxx::from_json(doc.dump()), mongocxx::options::replace{}.upsert(true));
+    }
+
+    // Running forecast error per city, upserted next to the forecasts it scores.
+    void storeForecastAccuracy(const std::vector<std::pair<std::string, ForecastErrorTracker::ErrorStats>>& cities) {
+        if (cities.empty()) return;
+        ScopedStageTimer timer(PipelineMetrics::MongoInsert);
+        mongocxx::options::bulk_write options;
+        options.ordered(false);
+        auto bulk = db["forecastAccuracy"].create_bulk_write(options);
+        int64_t updated = static_cast<int64_t>(std::time(nullptr));
+        for (const auto& entry : cities) {
+            nlohmann::json key = {{"city", entry.first}};
+            nlohmann::json doc = entry.second.toJson();
+            doc["city"] = entry.first;
+            doc["updated"] = updated;
+            mongocxx::model::replace_one upsert{bsoncxx::from_json(key.dump()), bsoncxx::from_json(doc.dump())};
+            upsert.upsert(true);
+            bulk.append(upsert);
+        }
+        bulk.execute();
+    }
+
+    // Rollups are upserted by (scope, period, index), so corrections overwrite in place.
+    void storeRollup(const RollupStore::Key& key, const RollupStats& stats) {
+        ScopedStageTimer timer(PipelineMetrics::MongoInsert);
+        auto collection = db["rollups"];
+        nlohmann::json filter = {{"scope", std::get<0>(key)}, {"period", RollupStore::periodName(std::get<1>(key))},
+                                 {"index", std::get<2>(key)}};
+        nlohmann::json doc = stats.toJson();
+        doc.update(filter);
+        collection.replace_one(bsoncxx::from_json(filter.dump()), bsoncxx::from_json(doc.dump()),
+                               mongocxx::options::replace{}.upsert(true));
+    }
+
+private:
+    // The unique (id, dt) index. rawData written before it existed (plain inserts) can hold repeated
+    // readings, which make the build fail; those are removed once and the build retried.
+    void createReadingIndex(const mongocxx::options::index& unique) {
+        auto keys = bsoncxx::from_json(R"({"id": 1, "dt": 1})");
+        try {
+            db["rawData"].create_index(keys.view(), unique);
+            return;
+        } catch (const std::exception& e) {
+            LOG_WARN("Unique (id, dt) index on rawData failed ({}); removing repeated readings", e.what());
+        }
+        try {
+            int64_t removed = removeDuplicateReadings();
+            db["rawData"].create_index(keys.view(), unique);
+            LOG_INFO("Removed {} repeated readings from rawData and created its unique (id, dt) index", removed);
+        } catch (const std::exception& e) {
+            LOG_ERROR("rawData has no unique (id, dt) index ({}). Readings are still upserted by (id, dt); remove "
+                      "the repeated readings stored by older versions and restart to create it",
+                      e.what());
+        }
+    }
+
+    mongocxx::client client;
+    mongocxx::database db;
+};
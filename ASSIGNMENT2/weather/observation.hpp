@@ -0,0 +1,64 @@
+// Fixed-layout records of one current weather reading shared by the in-memory stages.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+
+// Observation: the fields of one current weather reading used by the in-memory stages
+struct Observation {
+    int64_t dt = 0;
+    int64_t timezone = 0;
+    double tempC = 0;
+    double humidity = 0;
+    double lat = 0;
+    double lon = 0;
+    bool hasCoord = false;
+    char condition[16] = {};
+
+    static Observation fromJson(const nlohmann::json& data) {
+        Observation obs;
+        obs.dt = data["dt"].get<int64_t>();
+        auto coord = data.find("coord");
+        if (coord != data.end()) {
+            obs.lat = coord->value("lat", 0.0);
+            obs.lon = coord->value("lon", 0.0);
+            obs.hasCoord = true;
+        }
+        obs.timezone = data.value("timezone", int64_t{0});
+        obs.tempC = data["main"]["temp"].get<double>() - 273.15; // Convert from Kelvin to Celsius
+        obs.humidity = data["main"].value("humidity", 0.0);
+        std::string condition = data["weather"][0]["main"].get<std::string>();
+        std::strncpy(obs.condition, condition.c_str(), sizeof(obs.condition) - 1);
+        return obs;
+    }
+};
+
+// WeatherReading: the numeric fields of one current-weather payload, in °C, hPa, %, m/s.
+// Fields missing from the payload are NaN and skipped by MetricAggregator.
+struct WeatherReading {
+    double tempC;
+    double feelsLikeC;
+    double tempMinC;
+    double tempMaxC;
+    double pressure;
+    double humidity;
+    double windSpeed;
+    double clouds;
+
+    static WeatherReading fromJson(const nlohmann::json& data) {
+        auto number = [](const nlohmann::json& object, const char* key, double offset = 0) {
+            auto it = object.find(key);
+            return it != object.end() && it->is_number() ? it->get<double>() + offset : std::numeric_limits<double>::quiet_NaN();
+        };
+        static const nlohmann::json empty = nlohmann::json::object();
+        const auto& main = data.contains("main") ? data["main"] : empty;
+        const auto& wind = data.contains("wind") ? data["wind"] : empty;
+        const auto& clouds = data.contains("clouds") ? data["clouds"] : empty;
+        return {number(main, "temp", -273.15), number(main, "feels_like", -273.15), number(main, "temp_min", -273.15),
+                number(main, "temp_max", -273.15), number(main, "pressure"), number(main, "humidity"),
+                number(wind, "speed"), number(clouds, "all")};
+    }
+};
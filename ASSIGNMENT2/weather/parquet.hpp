@@ -0,0 +1,418 @@
+// Minimal Parquet file writer (Thrift compact metadata, PLAIN pages, optional gzip).
+#pragma once
+
+#include "http_server.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ThriftCompactWriter: just enough of the Thrift compact protocol for Parquet metadata.
+// Fields of a struct have to be written in increasing id order.
+class ThriftCompactWriter {
+public:
+    enum : uint8_t { True = 1, False = 2, I32 = 5, I64 = 6, Binary = 8, List = 9, Struct = 12 };
+
+    void i32(int16_t id, int32_t value) { field(id, I32), varint(zigzag(value)); }
+    void i64(int16_t id, int64_t value) { field(id, I64), varint(zigzag(value)); }
+    void binary(int16_t id, const std::string& value) { field(id, Binary), bytes(value); }
+    void boolean(int16_t id, bool value) { field(id, value ? True : False); }
+
+    void beginStruct(int16_t id) {
+        field(id, Struct);
+        lastIds.push_back(0);
+    }
+
+    // Ends a struct field or a struct list element.
+    void endStruct() {
+        out.push_back(0);
+        lastIds.pop_back();
+    }
+
+    void beginList(int16_t id, uint8_t elementType, size_t size) {
+        field(id, List);
+        if (size < 15) {
+            out.push_back(static_cast<char>(size << 4 | elementType));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | elementType));
+            varint(size);
+        }
+    }
+
+    // List elements
+    void beginElement() { lastIds.push_back(0); }
+    void element(int32_t value) { varint(zigzag(value)); }
+    void element(const std::string& value) { bytes(value); }
+
+    // Ends the top-level struct and returns the encoding.
+    std::string finish() {
+        out.push_back(0);
+        return std::move(out);
+    }
+
+    static void varint(std::string& out, uint64_t value) {
+        for (; value >= 0x80; value >>= 7) out.push_back(static_cast<char>(value | 0x80));
+        out.push_back(static_cast<char>(value));
+    }
+
+private:
+    static uint64_t zigzag(int64_t value) { return static_cast<uint64_t>(value) << 1 ^ static_cast<uint64_t>(value >> 63); }
+    void varint(uint64_t value) { varint(out, value); }
+
+    void bytes(const std::string& value) {
+        varint(value.size());
+        out += value;
+    }
+
+    void field(int16_t id, uint8_t type) {
+        int delta = id - lastIds.back();
+        if (delta > 0 && delta <= 15) {
+            out.push_back(static_cast<char>(delta << 4 | type));
+        } else {
+            out.push_back(static_cast<char>(type));
+            varint(zigzag(id));
+        }
+        lastIds.back() = id;
+    }
+
+    std::string out;
+    std::vector<int16_t> lastIds{0};
+};
+
+// ParquetWriter class
+// Writes a Parquet file with a flat schema of required columns, one row group per flush().
+// String columns are dictionary-encoded per column chunk, every chunk carries min/max statistics
+// and pages are optionally gzip-compressed. The file is written as <path>.inprogress and renamed
+// to path by close(), once the footer is in place.
+class ParquetWriter {
+public:
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Parquet values are little-endian");
+
+    enum class Type { Int64, Double, String, Date }; // Date: days since the epoch
+    struct Column {
+        std::string name;
+        Type type;
+    };
+
+    ParquetWriter(std::string path, std::vector<Column> columns, bool compress)
+        : path(std::move(path)), columns(std::move(columns)), chunks(this->columns.size()), compress(compress) {
+        file = std::fopen((this->path + ".inprogress").c_str(), "wb");
+        if (file) std::setvbuf(file, nullptr, _IOFBF, 1 << 20);
+        write("PAR1", 4);
+    }
+
+    ~ParquetWriter() { close(); }
+
+    ParquetWriter(const ParquetWriter&) = delete;
+    ParquetWriter& operator=(const ParquetWriter&) = delete;
+
+    // One value per column, in schema order, makes a row.
+    void add(size_t column, int64_t value) { chunks[column].ints.push_back(value); }
+    void add(size_t column, double value) { chunks[column].doubles.push_back(value); }
+
+    void add(size_t column, const std::string& value) {
+        Chunk& chunk = chunks[column];
+        auto it = chunk.codeOf.find(value);
+        if (it == chunk.codeOf.end()) {
+            it = chunk.codeOf.emplace(value, static_cast<uint32_t>(chunk.dictionary.size())).first;
+            chunk.dictionary.push_back(value);
+        }
+        chunk.codes.push_back(it->second);
+    }
+
+    size_t bufferedRows() const { return chunks.empty() ? 0 : rowsIn(0); }
+
+    // Writes the buffered rows as one row group.
+    bool flush() {
+        size_t rows = bufferedRows();
+        if (rows == 0 || !file) return ok();
+        RowGroup group;
+        group.rows = static_cast<int64_t>(rows);
+        group.offset = offset;
+        for (size_t c = 0; c < columns.size(); ++c) {
+            if (rowsIn(c) != rows) throw std::logic_error("ParquetWriter: column " + columns[c].name + " has a different row count");
+            group.chunks.push_back(writeChunk(c));
+            group.bytes += group.chunks.back().uncompressed;
+            group.compressedBytes += group.chunks.back().compressed;
+            chunks[c] = Chunk();
+        }
+        totalRows += group.rows;
+        rowGroups.push_back(std::move(group));
+        return ok();
+    }
+
+    // Flushes, writes the footer and renames the file into place.
+    bool close() {
+        if (!file) return false;
+        flush();
+        std::string footer = footerMetadata();
+        uint32_t length = static_cast<uint32_t>(footer.size());
+        write(footer.data(), footer.size());
+        write(&length, sizeof(length));
+        write("PAR1", 4);
+        bool written = good && std::fclose(file) == 0;
+        file = nullptr;
+        std::string tmpPath = path + ".inprogress";
+        return written && std::rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+    bool ok() const { return file && good; }
+    uint64_t bytesWritten() const { return offset; }
+    size_t rowGroupCount() const { return rowGroups.size(); }
+    const std::string& filePath() const { return path; }
+
+private:
+    enum : int32_t { Plain = 0, Rle = 3, RleDictionary = 8 };
+    enum : int32_t { DataPage = 0, DictionaryPage = 2 };
+    enum : int32_t { PhysicalInt32 = 1, PhysicalInt64 = 2, PhysicalDouble = 5, PhysicalByteArray = 6 };
+    enum : int32_t { Uncompressed = 0, Gzip = 2 };
+
+    struct Chunk {
+        std::vector<int64_t> ints; // Int64 and Date
+        std::vector<double> doubles;
+        std::vector<uint32_t> codes; // String: index into dictionary
+        std::vector<std::string> dictionary;
+        std::unordered_map<std::string, uint32_t> codeOf;
+    };
+
+    struct ChunkMeta {
+        int64_t offset = 0;
+        int64_t dictionaryOffset = -1;
+        int64_t dataOffset = 0;
+        int64_t values = 0;
+        int64_t uncompressed = 0;
+        int64_t compressed = 0;
+        std::string min; // plain-encoded, empty if every value was NaN
+        std::string max;
+    };
+
+    struct RowGroup {
+        std::vector<ChunkMeta> chunks;
+        int64_t rows = 0;
+        int64_t offset = 0;
+        int64_t bytes = 0;
+        int64_t compressedBytes = 0;
+    };
+
+    size_t rowsIn(size_t column) const {
+        const Chunk& chunk = chunks[column];
+        switch (columns[column].type) {
+        case Type::Double: return chunk.doubles.size();
+        case Type::String: return chunk.codes.size();
+        default: return chunk.ints.size();
+        }
+    }
+
+    static int32_t physicalType(Type type) {
+        switch (type) {
+        case Type::Int64: return PhysicalInt64;
+        case Type::Double: return PhysicalDouble;
+        case Type::String: return PhysicalByteArray;
+        default: return PhysicalInt32;
+        }
+    }
+
+    template <class T>
+    static std::string plain(T value) {
+        return std::string(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    ChunkMeta writeChunk(size_t column) {
+        const Chunk& chunk = chunks[column];
+        ChunkMeta meta;
+        meta.offset = offset;
+        meta.values = static_cast<int64_t>(rowsIn(column));
+        std::string data;
+        int32_t encoding = Plain;
+        switch (columns[column].type) {
+        case Type::Int64: {
+            data.assign(reinterpret_cast<const char*>(chunk.ints.data()), chunk.ints.size() * sizeof(int64_t));
+            auto range = std::minmax_element(chunk.ints.begin(), chunk.ints.end());
+            meta.min = plain(*range.first);
+            meta.max = plain(*range.second);
+            break;
+        }
+        case Type::Date: {
+            for (int64_t day : chunk.ints) data += plain(static_cast<int32_t>(day));
+            auto range = std::minmax_element(chunk.ints.begin(), chunk.ints.end());
+            meta.min = plain(static_cast<int32_t>(*range.first));
+            meta.max = plain(static_cast<int32_t>(*range.second));
+            break;
+        }
+        case Type::Double: {
+            data.assign(reinterpret_cast<const char*>(chunk.doubles.data()), chunk.doubles.size() * sizeof(double));
+            double lo = std::numeric_limits<double>::infinity(), hi = -lo;
+            for (double v : chunk.doubles) {
+                if (std::isnan(v)) continue; // Missing field; NaN is left out of the statistics
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+            }
+            if (lo <= hi) meta.min = plain(lo), meta.max = plain(hi);
+            break;
+        }
+        case Type::String: {
+            std::string dictionary;
+            for (const auto& value : chunk.dictionary) dictionary += plain(static_cast<uint32_t>(value.size())) + value;
+            meta.dictionaryOffset = offset;
+            writePage(DictionaryPage, dictionary, static_cast<int32_t>(chunk.dictionary.size()), Plain, meta);
+            auto range = std::minmax_element(chunk.dictionary.begin(), chunk.dictionary.end());
+            meta.min = *range.first;
+            meta.max = *range.second;
+            int bitWidth = 1;
+            while ((uint64_t{1} << bitWidth) < chunk.dictionary.size()) ++bitWidth;
+            data.push_back(static_cast<char>(bitWidth));
+            encodeHybrid(chunk.codes, bitWidth, data);
+            encoding = RleDictionary;
+            break;
+        }
+        }
+        meta.dataOffset = offset;
+        writePage(DataPage, data, static_cast<int32_t>(meta.values), encoding, meta);
+        return meta;
+    }
+
+    void writePage(int32_t pageType, const std::string& raw, int32_t values, int32_t encoding, ChunkMeta& meta) {
+        std::string body = compress ? HttpServer::gzip(raw) : raw;
+        ThriftCompactWriter header;
+        header.i32(1, pageType);
+        header.i32(2, static_cast<int32_t>(raw.size()));
+        header.i32(3, static_cast<int32_t>(body.size()));
+        header.beginStruct(pageType == DictionaryPage ? 7 : 5);
+        header.i32(1, values);
+        header.i32(2, encoding);
+        if (pageType == DataPage) {
+            header.i32(3, Rle); // No definition or repetition levels: every column is required
+            header.i32(4, Rle);
+        }
+        header.endStruct();
+        std::string encodedHeader = header.finish();
+        write(encodedHeader.data(), encodedHeader.size());
+        write(body.data(), body.size());
+        meta.uncompressed += static_cast<int64_t>(encodedHeader.size() + raw.size());
+        meta.compressed += static_cast<int64_t>(encodedHeader.size() + body.size());
+    }
+
+    // RLE/bit-packed hybrid: runs of 8+ equal codes become RLE runs, the rest is bit-packed in
+    // groups of 8.
+    static void encodeHybrid(const std::vector<uint32_t>& codes, int bitWidth, std::string& out) {
+        std::vector<uint32_t> pending;
+        auto flushPacked = [&] {
+            if (pending.empty()) return;
+            size_t groups = (pending.size() + 7) / 8;
+            pending.resize(groups * 8, 0);
+            ThriftCompactWriter::varint(out, groups << 1 | 1);
+            uint64_t bits = 0;
+            int used = 0;
+            for (uint32_t code : pending) {
+                bits |= static_cast<uint64_t>(code) << used;
+                for (used += bitWidth; used >= 8; used -= 8, bits >>= 8) out.push_back(static_cast<char>(bits & 0xFF));
+            }
+            pending.clear();
+        };
+        for (size_t i = 0; i < codes.size();) {
+            size_t run = 1;
+            while (i + run < codes.size() && codes[i + run] == codes[i]) ++run;
+            size_t fill = (8 - pending.size() % 8) % 8; // A bit-packed run must end on a group of 8
+            if (run >= fill + 8) {
+                pending.insert(pending.end(), fill, codes[i]);
+                flushPacked();
+                ThriftCompactWriter::varint(out, (run - fill) << 1);
+                for (int b = 0; b < (bitWidth + 7) / 8; ++b) out.push_back(static_cast<char>(codes[i] >> (8 * b) & 0xFF));
+            } else {
+                pending.insert(pending.end(), run, codes[i]);
+            }
+            i += run;
+        }
+        flushPacked();
+    }
+
+    std::string footerMetadata() const {
+        ThriftCompactWriter meta;
+        meta.i32(1, 1);
+        meta.beginList(2, ThriftCompactWriter::Struct, columns.size() + 1);
+        meta.beginElement();
+        meta.binary(4, "schema");
+        meta.i32(5, static_cast<int32_t>(columns.size()));
+        meta.endStruct();
+        for (const auto& column : columns) {
+            meta.beginElement();
+            meta.i32(1, physicalType(column.type));
+            meta.i32(3, 0); // REQUIRED
+            meta.binary(4, column.name);
+            if (column.type == Type::String) meta.i32(6, 0); // UTF8
+            if (column.type == Type::Date) meta.i32(6, 6);   // DATE
+            meta.endStruct();
+        }
+        meta.i64(3, totalRows);
+        meta.beginList(4, ThriftCompactWriter::Struct, rowGroups.size());
+        for (const auto& group : rowGroups) {
+            meta.beginElement();
+            meta.beginList(1, ThriftCompactWriter::Struct, group.chunks.size());
+            for (size_t c = 0; c < group.chunks.size(); ++c) {
+                const ChunkMeta& chunk = group.chunks[c];
+                bool dictionary = chunk.dictionaryOffset >= 0;
+                meta.beginElement();
+                meta.i64(2, chunk.offset);
+                meta.beginStruct(3);
+                meta.i32(1, physicalType(columns[c].type));
+                meta.beginList(2, ThriftCompactWriter::I32, dictionary ? 3 : 2);
+                meta.element(Plain);
+                meta.element(Rle);
+                if (dictionary) meta.element(RleDictionary);
+                meta.beginList(3, ThriftCompactWriter::Binary, 1);
+                meta.element(columns[c].name);
+                meta.i32(4, compress ? Gzip : Uncompressed);
+                meta.i64(5, chunk.values);
+                meta.i64(6, chunk.uncompressed);
+                meta.i64(7, chunk.compressed);
+                meta.i64(9, chunk.dataOffset);
+                if (dictionary) meta.i64(11, chunk.dictionaryOffset);
+                meta.beginStruct(12);
+                meta.i64(3, 0); // null_count
+                if (!chunk.max.empty() || columns[c].type == Type::String) {
+                    meta.binary(5, chunk.max);
+                    meta.binary(6, chunk.min);
+                }
+                meta.endStruct();
+                meta.endStruct();
+                meta.endStruct();
+            }
+            meta.i64(2, group.bytes);
+            meta.i64(3, group.rows);
+            meta.i64(5, group.offset);
+            meta.i64(6, group.compressedBytes);
+            meta.endStruct();
+        }
+        meta.binary(6, "weather-monitor version 1.0.0");
+        meta.beginList(7, ThriftCompactWriter::Struct, columns.size()); // TYPE_ORDER for every column
+        for (size_t c = 0; c < columns.size(); ++c) {
+            meta.beginElement();
+            meta.beginStruct(1);
+            meta.endStruct();
+            meta.endStruct();
+        }
+        return meta.finish();
+    }
+
+    void write(const void* data, size_t size) {
+        good = good && file && std::fwrite(data, 1, size, file) == size;
+        offset += static_cast<int64_t>(size);
+    }
+
+    std::string path;
+    std::vector<Column> columns;
+    std::vector<Chunk> chunks;
+    bool compress;
+    std::FILE* file = nullptr;
+    bool good = true;
+    int64_t offset = 0;
+    int64_t totalRows = 0;
+    std::vector<RowGroup> rowGroups;
+};
@@ -0,0 +1,194 @@
+// Adaptive per-city poll scheduling within a request budget.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// AdaptivePollPlanner class
+// Chooses when to poll each city instead of polling everything at one rate. A city's interval is
+// the shorter of the time its recent rate of change needs to drift by `tolerance` and a fraction
+// of the time it needs to reach the alert threshold, clamped to [minInterval, maxInterval]. Polls
+// are aligned just after the city's next upstream `dt` update, since polling between updates
+// only returns the same reading. All intervals are then scaled so that together they spend the
+// quota (never beyond maxInterval), and a token bucket makes the quota a hard cap. Times are unix seconds.
+class AdaptivePollPlanner {
+public:
+    struct Config {
+        bool enabled = false;
+        int64_t minInterval = 60;
+        int64_t maxInterval = 1800;
+        double requestsPerHour = 3600;  // Quota shared by every city this planner owns; 0 = unlimited
+        double alertThreshold = 35.0;   // °C, as checked by AlertManager
+        double tolerance = 0.5;         // °C of drift allowed between polls
+        double breachFraction = 0.5;    // Poll at this fraction of the projected time to breach
+    };
+
+    AdaptivePollPlanner() = default;
+    explicit AdaptivePollPlanner(Config config) : config(config) {}
+
+    void setConfig(Config next) { config = next; }
+    const Config& settings() const { return config; }
+    void setQuota(double requestsPerHour) { config.requestsPerHour = requestsPerHour; }
+
+    // Starts tracking a city; it is due immediately.
+    void add(uint32_t city, int64_t now) {
+        if (city >= states.size()) states.resize(city + 1);
+        CityState& state = states[city];
+        if (state.active) return;
+        state = CityState{};
+        state.active = true;
+        state.desired = static_cast<double>(config.minInterval);
+        demand += 3600.0 / state.desired;
+        state.nextPoll = now;
+        queue.emplace(now, city);
+    }
+
+    void remove(uint32_t city) {
+        if (city >= states.size() || !states[city].active) return;
+        demand -= 3600.0 / states[city].desired;
+        states[city].active = false;
+    }
+
+    // Appends the cities due at `now`, earliest first, as far as the quota allows. Each must be
+    // answered with onObservation or onFailure; until then it is parked at maxInterval.
+    void due(int64_t now, std::vector<uint32_t>& out) {
+        bool limited = config.requestsPerHour > 0;
+        if (limited) refill(now);
+        while (!queue.empty() && queue.top().first <= now && (!limited || tokens >= 1.0)) {
+            uint32_t city = queue.top().second;
+            int64_t at = queue.top().first;
+            queue.pop();
+            CityState& state = states[city];
+            if (!state.active || state.nextPoll != at) continue; // Rescheduled since
+            if (limited) tokens -= 1.0;
+            out.push_back(city);
+            state.nextPoll = now + config.maxInterval;
+            queue.emplace(state.nextPoll, city);
+        }
+    }
+
+    void onObservation(uint32_t city, int64_t now, int64_t dt, double tempC) {
+        if (city >= states.size() || !states[city].active) return;
+        CityState& state = states[city];
+        if (dt > state.lastDt) {
+            if (state.lastDt > 0) {
+                double gap = static_cast<double>(dt - state.lastDt);
+                // Polls may skip updates, so a gap spanning several of them counts as that many steps
+                double step = state.cadence > 0 ? gap / std::max(1.0, std::round(gap / state.cadence)) : gap;
+                state.cadence = state.cadence > 0 ? state.cadence + kAlpha * (step - state.cadence) : step;
+                double rate = std::fabs(tempC - state.lastTemp) / gap;
+                state.rate = state.hasRate ? state.rate + kAlpha * (rate - state.rate) : rate;
+                state.hasRate = true;
+            }
+            // Publication lag: a fresh reading bounds it from above, so keep the smallest bound and
+            // shave a little off to probe whether the update could be picked up sooner
+            double lag = static_cast<double>(std::max<int64_t>(now - dt, 0));
+            state.lag = 0.95 * (state.lastDt == 0 ? lag : std::min(lag, state.lag));
+            state.lastDt = dt;
+            state.lastTemp = tempC;
+            state.stalePolls = 0;
+        } else {
+            // Polled after the expected update but it was not there yet: the lag is at least this long
+            double expected = static_cast<double>(state.lastDt) + state.cadence;
+            if (state.cadence > 0 && static_cast<double>(now) >= expected) {
+                state.lag = std::max(state.lag, static_cast<double>(now) - expected + 10);
+            }
+            ++state.stalePolls;
+        }
+        double desired = desiredInterval(state);
+        demand += 3600.0 / desired - 3600.0 / state.desired;
+        state.desired = desired;
+        schedule(city, now);
+    }
+
+    // The fetch failed; try again after the minimum interval.
+    void onFailure(uint32_t city, int64_t now) {
+        if (city >= states.size() || !states[city].active) return;
+        states[city].nextPoll = now + config.minInterval;
+        queue.emplace(states[city].nextPoll, city);
+    }
+
+    // Earliest scheduled poll, or INT64_MAX when nothing is tracked.
+    int64_t nextDue() {
+        while (!queue.empty() && (!states[queue.top().second].active || states[queue.top().second].nextPoll != queue.top().first)) {
+            queue.pop();
+        }
+        return queue.empty() ? std::numeric_limits<int64_t>::max() : queue.top().first;
+    }
+
+    // Factor all intervals are scaled by so that together they spend the quota: above 1 when the
+    // cities ask for more, below 1 when there is budget to spare.
+    double stretch() const { return config.requestsPerHour > 0 && demand > 0 ? demand / config.requestsPerHour : 1.0; }
+
+    int64_t intervalOf(uint32_t city) const {
+        if (city >= states.size()) return 0;
+        return static_cast<int64_t>(std::min(states[city].desired * stretch(), static_cast<double>(config.maxInterval)));
+    }
+
+private:
+    static constexpr double kAlpha = 0.3;
+
+    struct CityState {
+        bool active = false;
+        bool hasRate = false;
+        int64_t nextPoll = 0;
+        int64_t lastDt = 0;
+        double lastTemp = 0;
+        double cadence = 0; // Seconds between upstream updates, 0 until two were seen
+        double lag = 0;     // Seconds from dt until the reading was first fetched
+        double rate = 0;    // |°C per second|
+        double desired = 0; // Interval before the quota stretch
+        int stalePolls = 0;
+    };
+
+    double desiredInterval(const CityState& state) const {
+        double interval = static_cast<double>(config.maxInterval);
+        if (!state.hasRate) {
+            interval = static_cast<double>(config.minInterval); // Learn cadence and rate quickly
+        } else if (state.rate > 0) {
+            interval = std::min(interval, config.tolerance / state.rate);
+            double margin = config.alertThreshold - state.lastTemp;
+            interval = std::min(interval, margin > 0 ? config.breachFraction * margin / state.rate : 0.0);
+        }
+        if (state.cadence > 0) interval = std::max(interval, state.cadence); // No new data comes any sooner
+        return std::min(std::max(interval, static_cast<double>(config.minInterval)), static_cast<double>(config.maxInterval));
+    }
+
+    void schedule(uint32_t city, int64_t now) {
+        CityState& state = states[city];
+        double interval = std::min(state.desired * stretch(), static_cast<double>(config.maxInterval));
+        int64_t next = now + static_cast<int64_t>(interval);
+        if (state.cadence > 0) {
+            double published = static_cast<double>(state.lastDt) + state.lag; // When the last update became visible
+            if (published + state.cadence <= static_cast<double>(now)) {
+                // The next update is overdue; check back soon, backing off while it stays late
+                next = now + (config.minInterval << std::min(std::max(state.stalePolls - 1, 0), 3));
+            } else {
+                // Land just after the last update due by now + interval (at least the next one)
+                double steps = std::max(1.0, std::floor((static_cast<double>(now) + interval - published) / state.cadence));
+                next = static_cast<int64_t>(published + steps * state.cadence) + 1;
+            }
+        }
+        state.nextPoll = std::max(next, now + config.minInterval);
+        queue.emplace(state.nextPoll, city);
+    }
+
+    void refill(int64_t now) {
+        double capacity = std::max(1.0, config.requestsPerHour / 12); // Five minutes of burst
+        tokens = lastRefill == 0 ? capacity
+                                 : std::min(capacity, tokens + static_cast<double>(now - lastRefill) * config.requestsPerHour / 3600.0);
+        lastRefill = now;
+    }
+
+    Config config;
+    std::vector<CityState> states;
+    std::priority_queue<std::pair<int64_t, uint32_t>, std::vector<std::pair<int64_t, uint32_t>>, std::greater<>> queue;
+    double demand = 0; // Requests per hour the desired intervals add up to
+    double tokens = 0;
+    int64_t lastRefill = 0;
+};
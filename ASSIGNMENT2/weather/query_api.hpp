@@ -0,0 +1,94 @@
+// Local HTTP/JSON query endpoint: /latest, /top and /range.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "http_server.hpp"
+#include "latest_store.hpp"
+#include "range_index.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// QueryApi class
+// Local HTTP/JSON endpoint over LatestObservationStore, TemperatureLeaderboard and RangeAggregateIndex:
+//   GET /latest?cities=Delhi,Mumbai   batched lookup (all cities when the parameter is omitted)
+//   GET /top?order=hot&k=20           hottest (or order=cold: coldest) cities right now
+//   GET /range?city=Delhi&from=1700000000&to=1700086400   count/avg/min/max/sum between two Unix times
+class QueryApi {
+public:
+    QueryApi(const LatestObservationStore& store, uint16_t port, int workers = 4,
+             const TemperatureLeaderboard* leaderboard = nullptr, const RangeAggregateIndex* ranges = nullptr)
+        : store(store), leaderboard(leaderboard), ranges(ranges),
+          server(port, [this](const HttpServer::Request& request) { return handle(request); }, workers) {}
+
+    bool start() { return server.start(); }
+    uint16_t port() const { return server.port(); }
+
+private:
+    HttpServer::Response handle(const HttpServer::Request& request) const {
+        HttpServer::Response response;
+        if (request.path == "/top" && leaderboard) {
+            bool hot = HttpServer::queryParam(request.query, "order") != "cold";
+            std::string k = HttpServer::queryParam(request.query, "k");
+            auto entries = leaderboard->top(k.empty() ? 20 : std::atoi(k.c_str()), hot);
+            nlohmann::json cities = nlohmann::json::array();
+            for (size_t i = 0; i < entries.size(); ++i) {
+                cities.push_back({{"rank", i + 1}, {"city", entries[i].name}, {"temp", entries[i].centiDegrees / 100.0}});
+            }
+            response.contentType = "application/json";
+            response.body = nlohmann::json{{"order", hot ? "hot" : "cold"}, {"cities", std::move(cities)}}.dump();
+            return response;
+        }
+        if (request.path == "/range" && ranges) {
+            std::string city = HttpServer::urlDecode(HttpServer::queryParam(request.query, "city"));
+            if (!HttpServer::validUtf8(city)) throw std::invalid_argument("city is not valid UTF-8");
+            std::string from = HttpServer::queryParam(request.query, "from");
+            std::string to = HttpServer::queryParam(request.query, "to");
+            int64_t fromDt = from.empty() ? 0 : std::atoll(from.c_str());
+            int64_t toDt = to.empty() ? std::numeric_limits<int64_t>::max() : std::atoll(to.c_str());
+            RangeAggregateIndex::Result range = ranges->query(city, fromDt, toDt);
+            nlohmann::json body = {{"city", city}, {"from", fromDt}, {"to", toDt}, {"count", range.count}};
+            // Readings before coveredFrom are not held (not ingested yet, or past the retention horizon)
+            body["coveredFrom"] = range.coveredFrom ? nlohmann::json(range.coveredFrom) : nlohmann::json(nullptr);
+            if (range.count) {
+                body["avg"] = range.average();
+                body["min"] = range.min;
+                body["max"] = range.max;
+                body["sum"] = range.sum;
+            }
+            response.contentType = "application/json";
+            response.body = body.dump();
+            return response;
+        }
+        if (request.path != "/latest") {
+            response.status = 404;
+            return response;
+        }
+        std::vector<std::string> cities;
+        std::string list = HttpServer::urlDecode(HttpServer::queryParam(request.query, "cities"));
+        if (list.empty()) {
+            cities = store.cityNames();
+        } else {
+            std::stringstream stream(list);
+            std::string city;
+            while (std::getline(stream, city, ',')) {
+                if (!city.empty()) cities.push_back(city);
+            }
+        }
+        response.contentType = "application/json";
+        response.body.reserve(cities.size() * 192 + 32);
+        store.appendBatchJson(cities, response.body);
+        return response;
+    }
+
+    const LatestObservationStore& store;
+    const TemperatureLeaderboard* leaderboard;
+    const RangeAggregateIndex* ranges;
+    HttpServer server;
+};
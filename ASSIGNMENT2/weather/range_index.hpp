@@ -0,0 +1,278 @@
+// Per-city time-range aggregates over retained temperature readings.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// RangeAggregateIndex class
+// Per-city temperature series in leaves of about 32 readings with pre-aggregated blocks (a leaf,
+// 32 leaves, 32 of those, and so on) for min, max, sum and count over any time range: binary
+// searches find the leaves at either end, then at most 31 units per level are combined at each
+// end, O(log n) in total. A late reading is inserted into its leaf and folded into that leaf's
+// blocks; a leaf that reaches 64 readings splits, which rebuilds the blocks in O(n / 32).
+// A reading takes 8 bytes (time offset and float); leaves and blocks add about 1.5 bytes.
+// Readings older than the retention horizon are dropped once they make up a fifth of a city's
+// series, by rebuilding it, so memory stays bounded at O(1) amortized cost per append.
+// Appends hold the writer lock briefly; queries share it.
+class RangeAggregateIndex {
+public:
+    static constexpr size_t kFanout = 32;
+    static constexpr int64_t kDefaultRetention = 30 * 86400;
+
+    struct Result {
+        uint64_t count = 0;
+        double sum = 0;
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        int64_t coveredFrom = 0; // dt of the city's oldest retained reading, 0 if it has none
+
+        double average() const { return count ? sum / static_cast<double>(count) : 0; }
+    };
+
+    // retention: seconds of readings kept behind each city's newest one; 0 keeps everything.
+    explicit RangeAggregateIndex(int64_t retention = kDefaultRetention) : retention(retention) {}
+
+    void add(const std::string& city, int64_t dt, double tempC) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        series[city].add(dt, static_cast<float>(tempC), retention);
+    }
+
+    // Aggregate over the readings with from <= dt <= to.
+    Result query(const std::string& city, int64_t from, int64_t to) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = series.find(city);
+        if (it == series.end()) return Result();
+        Result result = it->second.query(from, to);
+        result.coveredFrom = it->second.oldest();
+        return result;
+    }
+
+    uint64_t readings() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        uint64_t total = 0;
+        for (const auto& entry : series) total += entry.second.size;
+        return total;
+    }
+
+    uint64_t memoryBytes() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        uint64_t total = 0;
+        for (const auto& entry : series) total += entry.second.memoryBytes();
+        return total;
+    }
+
+private:
+    // Late readings up to this far before a city's oldest one are placed without shifting its offsets
+    static constexpr int64_t kBaseSlack = 7 * 86400;
+
+    struct Reading {
+        uint32_t offset; // Seconds after the series' base
+        float tempC;
+    };
+
+    struct Block {
+        float min;
+        float max;
+        double sum;
+        uint32_t count;
+    };
+
+    // Readings are kept in leaves of consecutive readings: kFanout long when they arrive in order,
+    // up to 2 * kFanout once late ones are inserted. levels[0] holds a block per leaf and levels[k]
+    // one per kFanout^k leaves, up to a top level of at most kFanout blocks.
+    struct Series {
+        int64_t base = 0; // dt of offset 0
+        size_t size = 0;
+        std::vector<std::vector<Reading>> leaves;
+        std::vector<uint32_t> ends; // Last offset of each leaf, searched without touching the leaves
+        std::vector<std::vector<Block>> levels;
+
+        void add(int64_t dt, float tempC, int64_t retention) {
+            if (retention > 0 && size && dt < newest() - retention) return; // Already past the horizon
+            if (!size || dt < base) rebase(dt - kBaseSlack);
+            Reading reading{static_cast<uint32_t>(dt - base), tempC};
+            ++size;
+            if (leaves.empty() || reading.offset >= leaves.back().back().offset) {
+                if (leaves.empty() || leaves.back().size() >= kFanout) {
+                    leaves.emplace_back();
+                    leaves.back().reserve(kFanout);
+                    ends.push_back(0);
+                }
+                leaves.back().push_back(reading);
+                ends.back() = reading.offset;
+                foldIn(leaves.size() - 1, tempC);
+                if (retention > 0 && newest() - oldest() > retention + retention / 4) expire(newest() - retention);
+                return;
+            }
+            // Out of order: insert into the leaf it falls in; only that leaf's blocks change
+            size_t leaf = static_cast<size_t>(std::upper_bound(ends.begin(), ends.end(), reading.offset) - ends.begin());
+            auto& readings = leaves[leaf];
+            readings.insert(std::upper_bound(readings.begin(), readings.end(), reading.offset, [](uint32_t offset, const Reading& r) { return offset < r.offset; }),
+                            reading);
+            foldIn(leaf, tempC);
+            if (readings.size() > 2 * kFanout) split(leaf);
+        }
+
+        int64_t oldest() const { return size ? base + leaves.front().front().offset : 0; }
+        int64_t newest() const { return size ? base + leaves.back().back().offset : 0; }
+
+        // Drops the readings before cutoff, rebases the offsets on the oldest kept one and rebuilds the blocks.
+        void expire(int64_t cutoff) {
+            uint32_t offset = static_cast<uint32_t>(cutoff - base);
+            auto whole = leaves.begin() + (std::lower_bound(ends.begin(), ends.end(), offset) - ends.begin());
+            for (auto it = leaves.begin(); it != whole; ++it) size -= it->size();
+            leaves.erase(leaves.begin(), whole);
+            auto& first = leaves.front();
+            auto keep = std::lower_bound(first.begin(), first.end(), offset, [](const Reading& r, uint32_t o) { return r.offset < o; });
+            size -= static_cast<size_t>(keep - first.begin());
+            first.erase(first.begin(), keep);
+            rebase(oldest() - kBaseSlack);
+            rebuild();
+        }
+
+        // Moves every offset onto a new base.
+        void rebase(int64_t next) {
+            for (auto& leaf : leaves) {
+                for (auto& reading : leaf) reading.offset = static_cast<uint32_t>(base + reading.offset - next);
+            }
+            for (auto& end : ends) end = static_cast<uint32_t>(base + end - next);
+            base = next;
+        }
+
+        // Folds a reading added to leaf into the blocks above it, adding blocks and levels as leaves are added.
+        void foldIn(size_t leaf, float tempC) {
+            size_t span = 1; // Leaves per block at level k
+            for (size_t k = 0; k < levels.size() || k == 0 || leaves.size() > span; ++k, span *= kFanout) {
+                if (k == levels.size()) {
+                    levels.push_back(combineLevel(k)); // Already includes the reading
+                    continue;
+                }
+                auto& blocks = levels[k];
+                size_t b = leaf / span;
+                if (b == blocks.size()) {
+                    blocks.push_back({tempC, tempC, tempC, 1});
+                } else {
+                    blocks[b].min = std::min(blocks[b].min, tempC);
+                    blocks[b].max = std::max(blocks[b].max, tempC);
+                    blocks[b].sum += tempC;
+                    ++blocks[b].count;
+                }
+            }
+        }
+
+        // Moves the upper half of an overfull leaf into a new one. The leaves after it move up one
+        // place, so the levels are rebuilt, in O(n / kFanout), at most once per kFanout late readings.
+        void split(size_t leaf) {
+            std::vector<Reading> upper(leaves[leaf].begin() + kFanout, leaves[leaf].end());
+            leaves[leaf].resize(kFanout);
+            leaves.insert(leaves.begin() + static_cast<std::ptrdiff_t>(leaf + 1), std::move(upper));
+            rebuild();
+        }
+
+        void rebuild() {
+            ends.clear();
+            for (const auto& leaf : leaves) ends.push_back(leaf.back().offset);
+            levels.clear();
+            for (size_t k = 0, span = 1; !leaves.empty() && (k == 0 || leaves.size() > span); ++k, span *= kFanout) {
+                levels.push_back(combineLevel(k));
+            }
+        }
+
+        // Blocks of level k, each combining kFanout blocks of the level below (one leaf for k = 0).
+        std::vector<Block> combineLevel(size_t k) const {
+            std::vector<Block> blocks;
+            size_t units = k == 0 ? leaves.size() : levels[k - 1].size();
+            size_t step = k == 0 ? 1 : kFanout;
+            for (size_t first = 0; first < units; first += step) {
+                Result result;
+                if (k == 0) {
+                    foldReadings(leaves[first].begin(), leaves[first].end(), result);
+                } else {
+                    foldBlocks(k - 1, first, std::min(units, first + step), result);
+                }
+                blocks.push_back({static_cast<float>(result.min), static_cast<float>(result.max), result.sum,
+                                  static_cast<uint32_t>(result.count)});
+            }
+            return blocks;
+        }
+
+        template <class It>
+        static void foldReadings(It first, It last, Result& result) {
+            for (; first != last; ++first) {
+                result.min = std::min(result.min, static_cast<double>(first->tempC));
+                result.max = std::max(result.max, static_cast<double>(first->tempC));
+                result.sum += first->tempC;
+                ++result.count;
+            }
+        }
+
+        void foldBlocks(size_t k, size_t first, size_t last, Result& result) const {
+            for (size_t b = first; b < last; ++b) {
+                const Block& block = levels[k][b];
+                result.min = std::min(result.min, static_cast<double>(block.min));
+                result.max = std::max(result.max, static_cast<double>(block.max));
+                result.sum += block.sum;
+                result.count += block.count;
+            }
+        }
+
+        Result query(int64_t from, int64_t to) const {
+            Result result;
+            if (!size || to < from || to < base) return result;
+            auto clamp = [this](int64_t dt) {
+                return static_cast<uint32_t>(std::min<int64_t>(std::max<int64_t>(dt - base, 0), std::numeric_limits<uint32_t>::max()));
+            };
+            uint32_t lo = clamp(from), hi = clamp(to);
+            auto byOffset = [](const Reading& r, uint32_t offset) { return r.offset < offset; };
+            auto foldLeaf = [&](const std::vector<Reading>& leaf) {
+                foldReadings(std::lower_bound(leaf.begin(), leaf.end(), lo, byOffset),
+                             std::upper_bound(leaf.begin(), leaf.end(), hi, [](uint32_t offset, const Reading& r) { return offset < r.offset; }),
+                             result);
+            };
+            // Leaf first is the first to reach lo and leaf last - 1 the first to pass hi (or the
+            // last leaf); the leaves in between lie wholly inside the range
+            size_t first = static_cast<size_t>(std::lower_bound(ends.begin(), ends.end(), lo) - ends.begin());
+            size_t last = std::min(leaves.size(), static_cast<size_t>(std::upper_bound(ends.begin(), ends.end(), hi) - ends.begin()) + 1);
+            if (first >= last) return result;
+            foldLeaf(leaves[first]);
+            if (last - first == 1) return result;
+            foldLeaf(leaves[last - 1]);
+            // Peel the unaligned ends off at each level, then move up to the next block size
+            size_t a = first + 1, b = last - 1, span = 1;
+            for (size_t k = 0; a < b; ++k) {
+                if (k + 1 == levels.size()) {
+                    foldBlocks(k, a / span, b / span, result);
+                    break;
+                }
+                size_t next = span * kFanout;
+                size_t left = std::min(b, (a + next - 1) / next * next);
+                foldBlocks(k, a / span, left / span, result);
+                size_t right = std::max(left, b / next * next);
+                foldBlocks(k, right / span, b / span, result);
+                a = left;
+                b = right;
+                span = next;
+            }
+            return result;
+        }
+
+        uint64_t memoryBytes() const {
+            uint64_t bytes = leaves.capacity() * sizeof(std::vector<Reading>) + ends.capacity() * sizeof(uint32_t);
+            for (const auto& leaf : leaves) bytes += leaf.capacity() * sizeof(Reading);
+            for (const auto& blocks : levels) bytes += blocks.capacity() * sizeof(Block);
+            return bytes;
+        }
+    };
+
+    int64_t retention;
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, Series> series;
+};
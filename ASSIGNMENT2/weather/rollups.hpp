@@ -0,0 +1,556 @@
+// Calendar helpers, mergeable rollup statistics, day windows and the week/month/year rollup store.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "observation.hpp"
+#include "binary_io.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Function to convert days since 1970-01-01 to a civil date (proleptic Gregorian)
+inline void civilFromDays(int64_t days, int& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned doe = static_cast<unsigned>(days - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = static_cast<int>(yoe + era * 400 + (month <= 2));
+}
+
+// Function to convert a civil date to days since 1970-01-01
+inline int64_t daysFromCivil(int year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yoe = static_cast<unsigned>(year - era * 400);
+    unsigned doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// RollupStats: mergeable temperature statistics for a day or any longer period. Count, sum,
+// condition counts and the 0.5 °C histogram sketch can also be subtracted, which lets late
+// corrections be applied as deltas; min and max cannot and are recomputed from children.
+// weightedSum/coveredSeconds hold the temperature integrated over the time between readings,
+// so average() weights each reading by the time it represents rather than by how often it
+// happened to be polled.
+struct RollupStats {
+    static constexpr double kSketchBinWidth = 0.5;
+
+    uint64_t count = 0;
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    std::map<std::string, uint64_t> conditions;
+    std::vector<std::pair<int16_t, uint32_t>> sketch; // sorted (bin, count)
+    double weightedSum = 0;    // °C·s between consecutive readings
+    double coveredSeconds = 0; // Time bridged by weightedSum
+    uint64_t gaps = 0;         // Steps longer than the expected poll interval
+    uint64_t missedPolls = 0;  // Expected polls missing in those gaps
+    uint64_t filled = 0;       // Interpolated readings counted in place of missed polls
+
+    void add(double tempC, const std::string& condition) {
+        ++count;
+        sum += tempC;
+        min = std::min(min, tempC);
+        max = std::max(max, tempC);
+        ++conditions[condition];
+        int16_t bin = static_cast<int16_t>(std::floor(tempC / kSketchBinWidth));
+        auto it = std::lower_bound(sketch.begin(), sketch.end(), std::make_pair(bin, uint32_t{0}));
+        if (it != sketch.end() && it->first == bin) {
+            ++it->second;
+        } else {
+            sketch.insert(it, {bin, 1});
+        }
+    }
+
+    void merge(const RollupStats& other) {
+        count += other.count;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        for (const auto& entry : other.conditions) conditions[entry.first] += entry.second;
+        mergeSketch(other.sketch, 1);
+        weightedSum += other.weightedSum;
+        coveredSeconds += other.coveredSeconds;
+        gaps += other.gaps;
+        missedPolls += other.missedPolls;
+        filled += other.filled;
+    }
+
+    // Adds the span [from, to] with interpolated temperatures fromC and toC at its ends.
+    void addSpan(int64_t from, int64_t to, double fromC, double toC) {
+        double seconds = static_cast<double>(to - from);
+        weightedSum += (fromC + toC) / 2 * seconds;
+        coveredSeconds += seconds;
+    }
+
+    // Replaces the contribution of removed by added for every subtractable field.
+    void applyDelta(const RollupStats& removed, const RollupStats& added) {
+        count = count - removed.count + added.count;
+        sum = sum - removed.sum + added.sum;
+        for (const auto& entry : removed.conditions) {
+            auto it = conditions.find(entry.first);
+            if (it != conditions.end() && (it->second -= std::min(it->second, entry.second)) == 0) conditions.erase(it);
+        }
+        for (const auto& entry : added.conditions) conditions[entry.first] += entry.second;
+        mergeSketch(removed.sketch, -1);
+        mergeSketch(added.sketch, 1);
+        weightedSum = weightedSum - removed.weightedSum + added.weightedSum;
+        coveredSeconds = coveredSeconds - removed.coveredSeconds + added.coveredSeconds;
+        gaps = gaps - removed.gaps + added.gaps;
+        missedPolls = missedPolls - removed.missedPolls + added.missedPolls;
+        filled = filled - removed.filled + added.filled;
+    }
+
+    // Time-weighted mean; the sample mean while no time between readings is covered.
+    double average() const { return coveredSeconds > 0 ? weightedSum / coveredSeconds : sampleAverage(); }
+    double sampleAverage() const { return count ? sum / static_cast<double>(count) : 0; }
+
+    std::string dominantCondition() const {
+        auto it = std::max_element(conditions.begin(), conditions.end(),
+                                   [](const auto& a, const auto& b) { return a.second < b.second; });
+        return it == conditions.end() ? "" : it->first;
+    }
+
+    // Approximate quantile from the sketch (midpoint of the bin holding the rank).
+    double quantile(double q) const {
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count ? count - 1 : 0)) + 1;
+        uint64_t seen = 0;
+        for (const auto& bin : sketch) {
+            seen += bin.second;
+            if (seen >= rank) return (bin.first + 0.5) * kSketchBinWidth;
+        }
+        return 0;
+    }
+
+    void save(BinaryWriter& out) const {
+        out.pod(count);
+        out.pod(sum);
+        out.pod(min);
+        out.pod(max);
+        out.pod<uint32_t>(static_cast<uint32_t>(conditions.size()));
+        for (const auto& entry : conditions) {
+            out.str(entry.first);
+            out.pod(entry.second);
+        }
+        out.podVector(sketch);
+        out.pod(weightedSum);
+        out.pod(coveredSeconds);
+        out.pod(gaps);
+        out.pod(missedPolls);
+        out.pod(filled);
+    }
+
+    void load(BinaryReader& in) {
+        count = in.pod<uint64_t>();
+        sum = in.pod<double>();
+        min = in.pod<double>();
+        max = in.pod<double>();
+        conditions.clear();
+        uint32_t conditionCount = in.pod<uint32_t>();
+        for (uint32_t i = 0; i < conditionCount; ++i) {
+            std::string condition = in.str();
+            conditions[condition] = in.pod<uint64_t>();
+        }
+        sketch = in.podVector<std::pair<int16_t, uint32_t>>();
+        weightedSum = in.pod<double>();
+        coveredSeconds = in.pod<double>();
+        gaps = in.pod<uint64_t>();
+        missedPolls = in.pod<uint64_t>();
+        filled = in.pod<uint64_t>();
+    }
+
+    nlohmann::json toJson() const {
+        nlohmann::json doc = {{"count", count}, {"averageTemp", average()}, {"sampleAverageTemp", sampleAverage()},
+                              {"minTemp", min}, {"maxTemp", max}, {"medianTemp", quantile(0.5)},
+                              {"dominantCondition", dominantCondition()}, {"conditions", conditions},
+                              {"coveredSeconds", coveredSeconds}, {"gaps", gaps}, {"missedPolls", missedPolls},
+                              {"filledPolls", filled}};
+        return doc;
+    }
+
+private:
+    void mergeSketch(const std::vector<std::pair<int16_t, uint32_t>>& other, int sign) {
+        std::vector<std::pair<int16_t, uint32_t>> merged;
+        merged.reserve(sketch.size() + other.size());
+        auto a = sketch.cbegin();
+        auto b = other.begin();
+        while (a != sketch.end() || b != other.end()) {
+            if (b == other.end() || (a != sketch.end() && a->first < b->first)) {
+                merged.push_back(*a++);
+            } else if (a == sketch.end() || b->first < a->first) {
+                if (sign > 0) merged.push_back(*b);
+                ++b;
+            } else {
+                uint32_t value = sign > 0 ? a->second + b->second : a->second - std::min(a->second, b->second);
+                if (value) merged.emplace_back(a->first, value);
+                ++a;
+                ++b;
+            }
+        }
+        sketch.swap(merged);
+    }
+};
+
+// WindowEngine class
+// Accumulates each city's observations for the open UTC day and reports the day when the first
+// observation of a later day arrives. Observations for an already closed day are reported on
+// their own as late data.
+// The time between consecutive readings is integrated into the day it falls in (split at
+// midnight), interpolating linearly or holding the previous reading. A step longer than the
+// expected poll interval is counted as a gap and can be filled with interpolated readings;
+// outages longer than maxGap are neither filled nor integrated.
+class WindowEngine {
+public:
+    using DayClosedHandler = std::function<void(const std::string& city, int64_t day, const RollupStats& stats, bool late)>;
+
+    enum Interpolation { Linear, Previous };
+
+    struct GapConfig {
+        int64_t expectedInterval = 0; // Seconds between readings; 0 turns gap detection off
+        double tolerance = 1.5;       // A step longer than tolerance × expectedInterval is a gap
+        bool fill = false;            // Count interpolated readings for the missed polls
+        Interpolation interpolation = Linear;
+        int64_t maxGap = 6 * 3600;
+    };
+
+    explicit WindowEngine(DayClosedHandler onDayClosed) : onDayClosed(std::move(onDayClosed)) {}
+
+    void setGapConfig(GapConfig config) { gapConfig = config; }
+    const GapConfig& gapSettings() const { return gapConfig; }
+
+    // expectedInterval overrides the configured one for this reading, e.g. an adaptive poll interval.
+    void add(const std::string& city, const Observation& obs, int64_t expectedInterval = 0) {
+        int64_t day = obs.dt / 86400;
+        OpenDay& open = openDays[city];
+        if (open.stats.count && day < open.day) {
+            RollupStats late;
+            late.add(obs.tempC, obs.condition);
+            onDayClosed(city, day, late, true);
+            return;
+        }
+        RollupStats next;
+        bool newDay = open.stats.count && day > open.day;
+        if (open.stats.count && obs.dt > open.lastDt) {
+            bridge(open, obs, expectedInterval ? expectedInterval : gapConfig.expectedInterval, newDay ? next : open.stats, next);
+        }
+        if (newDay) {
+            onDayClosed(city, open.day, open.stats, false);
+            open.stats = std::move(next);
+        }
+        open.day = day;
+        open.stats.add(obs.tempC, obs.condition);
+        if (obs.dt >= open.lastDt) {
+            open.lastDt = obs.dt;
+            open.lastTemp = obs.tempC;
+            std::memcpy(open.lastCondition, obs.condition, sizeof(open.lastCondition));
+        }
+    }
+
+    // Closes every open day, e.g. before shutdown.
+    void closeAll() {
+        for (auto& entry : openDays) {
+            if (entry.second.stats.count) onDayClosed(entry.first, entry.second.day, entry.second.stats, false);
+        }
+        openDays.clear();
+    }
+
+    void save(BinaryWriter& out) const {
+        out.pod<uint64_t>(openDays.size());
+        for (const auto& entry : openDays) {
+            out.str(entry.first);
+            out.pod(entry.second.day);
+            entry.second.stats.save(out);
+            out.pod(entry.second.lastDt);
+            out.pod(entry.second.lastTemp);
+            out.pod(entry.second.lastCondition);
+        }
+    }
+
+    void load(BinaryReader& in) {
+        openDays.clear();
+        uint64_t count = in.pod<uint64_t>();
+        for (uint64_t i = 0; i < count; ++i) {
+            OpenDay& open = openDays[in.str()];
+            open.day = in.pod<int64_t>();
+            open.stats.load(in);
+            open.lastDt = in.pod<int64_t>();
+            open.lastTemp = in.pod<double>();
+            std::memcpy(open.lastCondition, in.pod<std::array<char, 16>>().data(), sizeof(open.lastCondition));
+        }
+    }
+
+private:
+    struct OpenDay {
+        int64_t day = 0;
+        RollupStats stats;
+        int64_t lastDt = 0; // Newest reading, where the next span starts
+        double lastTemp = 0;
+        char lastCondition[16] = {};
+    };
+
+    // Integrates the span from the previous reading to obs and handles a gap in it. The part
+    // before midnight goes to the open day's stats; the rest to `next`, the stats of obs's day.
+    // Gap counts go to `into`, the stats obs is added to.
+    void bridge(OpenDay& open, const Observation& obs, int64_t expectedInterval, RollupStats& into, RollupStats& next) {
+        int64_t from = open.lastDt;
+        int64_t to = obs.dt;
+        int64_t step = to - from;
+        double fromC = open.lastTemp;
+        double toC = obs.tempC;
+        bool linear = gapConfig.interpolation == Linear;
+        auto valueAt = [&](int64_t t) {
+            return linear ? fromC + (toC - fromC) * static_cast<double>(t - from) / static_cast<double>(step) : fromC;
+        };
+        int64_t missed = 0;
+        if (expectedInterval > 0 && static_cast<double>(step) > gapConfig.tolerance * static_cast<double>(expectedInterval)) {
+            missed = std::max<int64_t>(1, std::llround(static_cast<double>(step) / static_cast<double>(expectedInterval)) - 1);
+            ++into.gaps;
+            into.missedPolls += static_cast<uint64_t>(missed);
+        }
+        if (step > gapConfig.maxGap) return; // Outage: leave it empty
+
+        int64_t midnight = (open.day + 1) * 86400;
+        int64_t nextStart = obs.dt / 86400 * 86400; // Days in between have no readings and are not reported
+        auto addSpan = [&](RollupStats& stats, int64_t a, int64_t b) {
+            if (b > a) stats.addSpan(a, b, valueAt(a), valueAt(b));
+        };
+        addSpan(open.stats, from, std::min(to, midnight));
+        if (to > midnight) addSpan(next, std::max(from, nextStart), to);
+
+        if (!gapConfig.fill) return;
+        for (int64_t k = 1; k <= missed; ++k) {
+            int64_t t = from + step * k / (missed + 1);
+            RollupStats* stats = t < midnight ? &open.stats : t >= nextStart ? &next : nullptr;
+            if (!stats) continue;
+            stats->add(valueAt(t), open.lastCondition);
+            ++stats->filled;
+        }
+    }
+
+    GapConfig gapConfig;
+    DayClosedHandler onDayClosed;
+    std::unordered_map<std::string, OpenDay> openDays;
+};
+
+// RollupStore class
+// Weekly (ISO, Monday-based), monthly and yearly rollups per city and per region, maintained
+// incrementally by merging closed daily summaries; nothing is recomputed from raw data.
+// A correction to a closed day is applied to its ancestors as a delta, and min/max are
+// recomputed only for the rollups whose extreme came from the corrected day, from their
+// direct children (days for weeks/months, months for years, member cities for regions).
+class RollupStore {
+public:
+    enum Period { Week, Month, Year };
+    using Key = std::tuple<std::string, int, int64_t>; // scope ("city:..." / "region:..."), period, index
+
+    void setRegion(const std::string& city, const std::string& region) {
+        regions[city] = region;
+        regionMembers[region].insert(city);
+    }
+
+    // Adds a closed day; a day that is already known is treated as a correction.
+    void addDay(const std::string& city, int64_t day, const RollupStats& stats) {
+        auto& days = dailies[city];
+        auto existing = days.find(day);
+        if (existing != days.end()) {
+            correctDay(city, day, stats);
+            return;
+        }
+        days.emplace(day, stats);
+        for (const auto& scope : scopesOf(city)) {
+            for (int period : {Week, Month, Year}) {
+                Key key{scope, period, periodIndex(static_cast<Period>(period), day)};
+                rollups[key].merge(stats);
+                dirty.insert(key);
+            }
+        }
+    }
+
+    // Late observations for a closed day are folded into it as a correction; returns the merged day.
+    const RollupStats& mergeIntoDay(const std::string& city, int64_t day, const RollupStats& extra) {
+        auto& days = dailies[city];
+        auto existing = days.find(day);
+        if (existing == days.end()) {
+            addDay(city, day, extra);
+        } else {
+            RollupStats merged = existing->second;
+            merged.merge(extra);
+            correctDay(city, day, merged);
+        }
+        return days[day];
+    }
+
+    void correctDay(const std::string& city, int64_t day, const RollupStats& corrected) {
+        RollupStats previous = dailies[city][day];
+        dailies[city][day] = corrected;
+        // City rollups first, so region recomputation sees the corrected city values; within a
+        // scope, months before years because years recompute from months.
+        for (const auto& scope : scopesOf(city)) {
+            for (int period : {Week, Month, Year}) {
+                Key key{scope, period, periodIndex(static_cast<Period>(period), day)};
+                RollupStats& rollup = rollups[key];
+                rollup.applyDelta(previous, corrected);
+                bool minLost = previous.min <= rollup.min && corrected.min > previous.min;
+                bool maxLost = previous.max >= rollup.max && corrected.max < previous.max;
+                rollup.min = std::min(rollup.min, corrected.min);
+                rollup.max = std::max(rollup.max, corrected.max);
+                if (minLost || maxLost) recomputeExtremes(key, rollup);
+                dirty.insert(key);
+            }
+        }
+    }
+
+    // Combines the largest whole periods inside [fromDay, toDay]: years, then months, then
+    // weeks, then single days.
+    RollupStats query(const std::string& scope, int64_t fromDay, int64_t toDay) const {
+        RollupStats result;
+        int64_t day = fromDay;
+        while (day <= toDay) {
+            int year;
+            unsigned month, dom;
+            civilFromDays(day, year, month, dom);
+            int64_t yearEnd = daysFromCivil(year + 1, 1, 1) - 1;
+            int64_t monthEnd = (month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, month + 1, 1)) - 1;
+            if (month == 1 && dom == 1 && yearEnd <= toDay) {
+                mergeRollup(result, Key{scope, Year, year});
+                day = yearEnd + 1;
+            } else if (dom == 1 && monthEnd <= toDay) {
+                mergeRollup(result, Key{scope, Month, periodIndex(Month, day)});
+                day = monthEnd + 1;
+            } else if (weekday(day) == 0 && day + 6 <= toDay) {
+                mergeRollup(result, Key{scope, Week, periodIndex(Week, day)});
+                day += 7;
+            } else {
+                mergeDay(result, scope, day);
+                ++day;
+            }
+        }
+        return result;
+    }
+
+    const RollupStats* find(const Key& key) const {
+        auto it = rollups.find(key);
+        return it == rollups.end() ? nullptr : &it->second;
+    }
+
+    // Returns and clears the rollups changed since the last call, for persistence.
+    std::vector<std::pair<Key, const RollupStats*>> takeDirty() {
+        std::vector<std::pair<Key, const RollupStats*>> changed;
+        for (const auto& key : dirty) changed.emplace_back(key, &rollups.at(key));
+        dirty.clear();
+        return changed;
+    }
+
+    static std::string cityScope(const std::string& city) { return "city:" + city; }
+    static std::string regionScope(const std::string& region) { return "region:" + region; }
+
+    static const char* periodName(int period) {
+        static const char* names[] = {"week", "month", "year"};
+        return names[period];
+    }
+
+    // Monday = 0 (1970-01-01 was a Thursday).
+    static int weekday(int64_t day) { return static_cast<int>(((day + 3) % 7 + 7) % 7); }
+
+    // Week w starts on day 7w - 3 (the Monday 1970-01-05 starts week 1).
+    static int64_t periodIndex(Period period, int64_t day) {
+        if (period == Week) return (day - weekday(day) + 3) / 7;
+        int year;
+        unsigned month, dom;
+        civilFromDays(day, year, month, dom);
+        return period == Month ? int64_t{year} * 12 + (month - 1) : year;
+    }
+
+private:
+    std::vector<std::string> scopesOf(const std::string& city) const {
+        std::vector<std::string> scopes{cityScope(city)};
+        auto it = regions.find(city);
+        if (it != regions.end()) scopes.push_back(regionScope(it->second));
+        return scopes;
+    }
+
+    void recomputeExtremes(const Key& key, RollupStats& rollup) const {
+        rollup.min = std::numeric_limits<double>::infinity();
+        rollup.max = -std::numeric_limits<double>::infinity();
+        auto take = [&rollup](const RollupStats& child) {
+            rollup.min = std::min(rollup.min, child.min);
+            rollup.max = std::max(rollup.max, child.max);
+        };
+        const std::string& scope = std::get<0>(key);
+        int period = std::get<1>(key);
+        int64_t index = std::get<2>(key);
+        if (scope.compare(0, 7, "region:") == 0) {
+            auto members = regionMembers.find(scope.substr(7));
+            if (members == regionMembers.end()) return;
+            for (const auto& city : members->second) {
+                auto child = rollups.find(Key{cityScope(city), period, index});
+                if (child != rollups.end()) take(child->second);
+            }
+            return;
+        }
+        if (period == Year) {
+            for (int month = 0; month < 12; ++month) {
+                auto child = rollups.find(Key{scope, Month, index * 12 + month});
+                if (child != rollups.end()) take(child->second);
+            }
+            return;
+        }
+        auto days = dailies.find(scope.substr(5));
+        if (days == dailies.end()) return;
+        int64_t first, last;
+        if (period == Week) {
+            first = index * 7 - 3;
+            last = first + 6;
+        } else {
+            int year = static_cast<int>(index / 12);
+            unsigned month = static_cast<unsigned>(index % 12) + 1;
+            first = daysFromCivil(year, month, 1);
+            last = (month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, month + 1, 1)) - 1;
+        }
+        for (auto it = days->second.lower_bound(first); it != days->second.end() && it->first <= last; ++it) take(it->second);
+    }
+
+    void mergeRollup(RollupStats& result, const Key& key) const {
+        auto it = rollups.find(key);
+        if (it != rollups.end()) result.merge(it->second);
+    }
+
+    void mergeDay(RollupStats& result, const std::string& scope, int64_t day) const {
+        auto mergeCityDay = [&](const std::string& city) {
+            auto days = dailies.find(city);
+            if (days == dailies.end()) return;
+            auto it = days->second.find(day);
+            if (it != days->second.end()) result.merge(it->second);
+        };
+        if (scope.compare(0, 7, "region:") == 0) {
+            auto members = regionMembers.find(scope.substr(7));
+            if (members != regionMembers.end()) {
+                for (const auto& city : members->second) mergeCityDay(city);
+            }
+        } else {
+            mergeCityDay(scope.substr(5));
+        }
+    }
+
+    std::unordered_map<std::string, std::string> regions;
+    std::unordered_map<std::string, std::set<std::string>> regionMembers;
+    std::unordered_map<std::string, std::map<int64_t, RollupStats>> dailies;
+    std::map<Key, RollupStats> rollups;
+    std::set<Key> dirty;
+};
@@ -0,0 +1,110 @@
+// Assignment of cities to shard workers and supervision of local workers.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "../../common/async_logger.hpp"
+#include "hash_ring.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ShardCoordinator class
+// Owns the hash ring and publishes the city assignment to <shardDir>/assignment.json. Workers
+// may be local processes or hosts sharing the directory; the coordinator spawns local ones.
+class ShardCoordinator {
+public:
+    ShardCoordinator(std::vector<std::string> cities, std::string shardDir)
+        : cities(std::move(cities)), shardDir(std::move(shardDir)) {
+        mkdir(this->shardDir.c_str(), 0755);
+    }
+
+    // Each membership change republishes the assignment and returns how many cities moved.
+    size_t addWorker(int worker) {
+        ring.addWorker(worker);
+        members.insert(worker);
+        return publish();
+    }
+
+    size_t removeWorker(int worker) {
+        ring.removeWorker(worker);
+        members.erase(worker);
+        return publish();
+    }
+
+    // Spawns workers as child processes of exePath and replaces any that exit.
+    void run(int workerCount, const std::string& exePath) {
+        for (int id = 0; id < workerCount; ++id) {
+            addWorker(id);
+            spawn(id, exePath);
+        }
+        while (true) {
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            if (pid < 0) break;
+            auto it = children.find(pid);
+            if (it == children.end()) continue;
+            int id = it->second;
+            children.erase(it);
+            size_t moved = removeWorker(id);
+            LOG_WARN("Worker {} exited; rebalanced {} cities", id, moved);
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            moved = addWorker(id);
+            LOG_INFO("Worker {} restarted; rebalanced {} cities", id, moved);
+            spawn(id, exePath);
+        }
+    }
+
+    static std::string assignmentPath(const std::string& shardDir) { return shardDir + "/assignment.json"; }
+
+private:
+    size_t publish() {
+        std::unordered_map<std::string, int> next;
+        nlohmann::json workers = nlohmann::json::object();
+        for (int member : members) workers[std::to_string(member)] = nlohmann::json::array();
+        size_t moved = 0;
+        for (const auto& city : cities) {
+            int owner = ring.ownerOf(city);
+            next[city] = owner;
+            if (owner >= 0) workers[std::to_string(owner)].push_back(city);
+            auto previous = owners.find(city);
+            if (previous != owners.end() && previous->second != owner) ++moved;
+        }
+        owners = std::move(next);
+        ++epoch;
+        std::string path = assignmentPath(shardDir);
+        std::ofstream(path + ".tmp", std::ios::trunc) << nlohmann::json{{"epoch", epoch}, {"workers", workers}}.dump();
+        std::rename((path + ".tmp").c_str(), path.c_str());
+        return moved;
+    }
+
+    void spawn(int id, const std::string& exePath) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::string idArg = std::to_string(id);
+            execl(exePath.c_str(), exePath.c_str(), "--worker", idArg.c_str(), shardDir.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        if (pid > 0) children[pid] = id;
+    }
+
+    std::vector<std::string> cities;
+    std::string shardDir;
+    ConsistentHashRing ring;
+    std::set<int> members;
+    std::unordered_map<std::string, int> owners;
+    std::map<pid_t, int> children;
+    int64_t epoch = 0;
+};
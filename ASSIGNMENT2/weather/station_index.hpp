@@ -0,0 +1,251 @@
+// Spatial index of stations for radius, nearest and region aggregates.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// StationIndex class
+// Uniform 0.5° lat/lon grid over stations holding each station's latest temperature.
+// Stations are stored as unit vectors, so the radius test is a chord-length comparison;
+// updates are O(1) and region sums are maintained incrementally.
+class StationIndex {
+public:
+    struct Aggregate {
+        uint32_t count = 0;
+        double sum = 0;
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+
+        void add(double t) {
+            ++count;
+            sum += t;
+            min = std::min(min, t);
+            max = std::max(max, t);
+        }
+        double average() const { return count ? sum / count : 0; }
+    };
+
+    static constexpr double kEarthRadiusKm = 6371.0;
+    static constexpr double kCellDegrees = 0.5;
+
+    // Adds a station or moves it if its coordinates changed; returns its id.
+    uint32_t upsertStation(const std::string& name, double lat, double lon) {
+        auto it = ids.find(name);
+        uint32_t id;
+        if (it == ids.end()) {
+            id = static_cast<uint32_t>(names.size());
+            ids.emplace(name, id);
+            names.push_back(name);
+            x.push_back(0);
+            y.push_back(0);
+            z.push_back(0);
+            lats.push_back(lat);
+            lons.push_back(lon);
+            temps.push_back(0);
+            hasTemp.push_back(0);
+            regionOf.push_back(-1);
+            cellOf.push_back(cellKey(lat, lon));
+            cells[cellOf[id]].push_back(id);
+        } else {
+            id = it->second;
+            uint64_t cell = cellKey(lat, lon);
+            if (cell != cellOf[id]) {
+                auto& members = cells[cellOf[id]];
+                members.erase(std::find(members.begin(), members.end(), id));
+                cells[cell].push_back(id);
+                cellOf[id] = cell;
+            }
+            lats[id] = lat;
+            lons[id] = lon;
+        }
+        toUnit(lat, lon, x[id], y[id], z[id]);
+        return id;
+    }
+
+    void setRegion(uint32_t station, const std::string& region) {
+        auto it = regionIds.find(region);
+        int regionId;
+        if (it == regionIds.end()) {
+            regionId = static_cast<int>(regionNames.size());
+            regionIds.emplace(region, regionId);
+            regionNames.push_back(region);
+            regionSums.emplace_back();
+            regionMembers.emplace_back();
+        } else {
+            regionId = it->second;
+        }
+        if (regionOf[station] == regionId) return;
+        if (regionOf[station] >= 0) {
+            auto& members = regionMembers[regionOf[station]];
+            members.erase(std::find(members.begin(), members.end(), station));
+            if (hasTemp[station]) adjustRegion(regionOf[station], -temps[station], -1);
+        }
+        regionOf[station] = regionId;
+        regionMembers[regionId].push_back(station);
+        if (hasTemp[station]) adjustRegion(regionId, temps[station], 1);
+    }
+
+    void updateTemp(uint32_t station, double tempC) {
+        if (regionOf[station] >= 0) {
+            if (hasTemp[station]) adjustRegion(regionOf[station], tempC - temps[station], 0);
+            else adjustRegion(regionOf[station], tempC, 1);
+        }
+        temps[station] = tempC;
+        hasTemp[station] = 1;
+    }
+
+    // Latest temperatures of stations within radiusKm of (lat, lon).
+    Aggregate radiusAggregate(double lat, double lon, double radiusKm) const {
+        Aggregate result;
+        double cx, cy, cz;
+        toUnit(lat, lon, cx, cy, cz);
+        double chord = 2 * std::sin(std::min(radiusKm / kEarthRadiusKm, M_PI) / 2);
+        double maxChordSq = chord * chord;
+        forCellsNear(lat, lon, radiusKm, [&](const std::vector<uint32_t>& members) {
+            for (uint32_t id : members) {
+                if (!hasTemp[id]) continue;
+                double dx = x[id] - cx, dy = y[id] - cy, dz = z[id] - cz;
+                if (dx * dx + dy * dy + dz * dz <= maxChordSq) result.add(temps[id]);
+            }
+        });
+        return result;
+    }
+
+    Aggregate boxAggregate(double minLat, double maxLat, double minLon, double maxLon) const {
+        Aggregate result;
+        for (int row = latCell(minLat); row <= latCell(maxLat); ++row) {
+            int lonCells = static_cast<int>(360 / kCellDegrees);
+            int first = lonCell(minLon), last = lonCell(maxLon);
+            int span = (last - first + lonCells) % lonCells;
+            for (int step = 0; step <= span; ++step) {
+                auto cell = cells.find(packCell(row, (first + step) % lonCells));
+                if (cell == cells.end()) continue;
+                for (uint32_t id : cell->second) {
+                    bool inLon = minLon <= maxLon ? (lons[id] >= minLon && lons[id] <= maxLon) : (lons[id] >= minLon || lons[id] <= maxLon);
+                    if (hasTemp[id] && lats[id] >= minLat && lats[id] <= maxLat && inLon) result.add(temps[id]);
+                }
+            }
+        }
+        return result;
+    }
+
+    // Per-region summary: count and average are maintained incrementally, min/max are scanned.
+    Aggregate regionAggregate(const std::string& region) const {
+        Aggregate result;
+        auto it = regionIds.find(region);
+        if (it == regionIds.end()) return result;
+        result.count = regionSums[it->second].count;
+        result.sum = regionSums[it->second].sum;
+        for (uint32_t id : regionMembers[it->second]) {
+            if (!hasTemp[id]) continue;
+            result.min = std::min(result.min, temps[id]);
+            result.max = std::max(result.max, temps[id]);
+        }
+        return result;
+    }
+
+    // Nearest station by great-circle distance, searching outward ring by ring; -1 if empty.
+    int64_t nearest(double lat, double lon, double* distanceKm = nullptr) const {
+        if (names.empty()) return -1;
+        double cx, cy, cz;
+        toUnit(lat, lon, cx, cy, cz);
+        int64_t best = -1;
+        double bestChordSq = std::numeric_limits<double>::infinity();
+        int row0 = latCell(lat), col0 = lonCell(lon);
+        int rows = static_cast<int>(180 / kCellDegrees), cols = static_cast<int>(360 / kCellDegrees);
+        for (int ring = 0; ring <= std::max(rows, cols); ++ring) {
+            for (int row = row0 - ring; row <= row0 + ring; ++row) {
+                if (row < 0 || row >= rows) continue;
+                for (int col = col0 - ring; col <= col0 + ring; ++col) {
+                    if (std::abs(row - row0) != ring && std::abs(col - col0) != ring) continue;
+                    auto cell = cells.find(packCell(row, ((col % cols) + cols) % cols));
+                    if (cell == cells.end()) continue;
+                    for (uint32_t id : cell->second) {
+                        double dx = x[id] - cx, dy = y[id] - cy, dz = z[id] - cz;
+                        double d = dx * dx + dy * dy + dz * dz;
+                        if (d < bestChordSq) {
+                            bestChordSq = d;
+                            best = id;
+                        }
+                    }
+                }
+            }
+            // Any station outside this ring is at least ring cells of latitude away.
+            if (best >= 0) {
+                double ringKm = ring * kCellDegrees * M_PI / 180 * kEarthRadiusKm;
+                double bestKm = 2 * std::asin(std::min(1.0, std::sqrt(bestChordSq) / 2)) * kEarthRadiusKm;
+                if (bestKm <= ringKm * std::cos(std::min(89.0, std::fabs(lat) + ring * kCellDegrees) * M_PI / 180)) break;
+            }
+        }
+        if (distanceKm && best >= 0) *distanceKm = 2 * std::asin(std::min(1.0, std::sqrt(bestChordSq) / 2)) * kEarthRadiusKm;
+        return best;
+    }
+
+    const std::string& name(uint32_t station) const { return names[station]; }
+    size_t size() const { return names.size(); }
+
+private:
+    static void toUnit(double lat, double lon, double& ux, double& uy, double& uz) {
+        double phi = lat * M_PI / 180, lambda = lon * M_PI / 180;
+        ux = std::cos(phi) * std::cos(lambda);
+        uy = std::cos(phi) * std::sin(lambda);
+        uz = std::sin(phi);
+    }
+
+    static int latCell(double lat) {
+        int rows = static_cast<int>(180 / kCellDegrees);
+        return std::min(rows - 1, std::max(0, static_cast<int>(std::floor((lat + 90) / kCellDegrees))));
+    }
+
+    static int lonCell(double lon) {
+        int cols = static_cast<int>(360 / kCellDegrees);
+        int col = static_cast<int>(std::floor((lon + 180) / kCellDegrees)) % cols;
+        return col < 0 ? col + cols : col;
+    }
+
+    static uint64_t packCell(int row, int col) { return static_cast<uint64_t>(row) << 32 | static_cast<uint32_t>(col); }
+    static uint64_t cellKey(double lat, double lon) { return packCell(latCell(lat), lonCell(lon)); }
+
+    template <class Visit>
+    void forCellsNear(double lat, double lon, double radiusKm, Visit visit) const {
+        double latSpan = radiusKm / kEarthRadiusKm * 180 / M_PI;
+        int rowFirst = latCell(lat - latSpan), rowLast = latCell(lat + latSpan);
+        int cols = static_cast<int>(360 / kCellDegrees);
+        double maxAbsLat = std::min(90.0, std::fabs(lat) + latSpan);
+        double cosLat = std::cos(maxAbsLat * M_PI / 180);
+        int colSpan = cosLat < 1e-6 ? cols : static_cast<int>(std::ceil(latSpan / cosLat / kCellDegrees)) + 1;
+        colSpan = std::min(colSpan, cols / 2);
+        int col0 = lonCell(lon);
+        for (int row = rowFirst; row <= rowLast; ++row) {
+            for (int step = -colSpan; step <= colSpan; ++step) {
+                if (colSpan == cols / 2 && step == colSpan) break; // avoid visiting the antimeridian column twice
+                auto cell = cells.find(packCell(row, ((col0 + step) % cols + cols) % cols));
+                if (cell != cells.end()) visit(cell->second);
+            }
+        }
+    }
+
+    void adjustRegion(int region, double sumDelta, int countDelta) {
+        regionSums[region].sum += sumDelta;
+        regionSums[region].count += countDelta;
+    }
+
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<std::string> names;
+    std::vector<double> x, y, z, lats, lons, temps;
+    std::vector<uint8_t> hasTemp;
+    std::vector<int> regionOf;
+    std::vector<uint64_t> cellOf;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    std::unordered_map<std::string, int> regionIds;
+    std::vector<std::string> regionNames;
+    std::vector<Aggregate> regionSums;
+    std::vector<std::vector<uint32_t>> regionMembers;
+};
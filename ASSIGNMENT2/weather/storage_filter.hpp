@@ -0,0 +1,132 @@
+// Deadband and swinging-door filtering of the readings written to rawData.
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include "observation.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// StorageFilter class
+// Decides which observations are written to rawData, per city and per metric (temperature,
+// humidity). Deadband stores a reading once it moves more than the tolerance away from the
+// last stored one (reconstruct by holding the previous value). Swinging door holds the newest
+// reading back and stores it only when the line from the last stored reading to the next one
+// would pass further than the tolerance from some skipped reading (reconstruct by linear
+// interpolation). A late reading, at or before the last stored or held one, is stored as it is
+// and leaves the filter's state alone. Summaries are computed from every reading before this
+// filter runs.
+class StorageFilter {
+public:
+    enum Mode { Off, Deadband, SwingingDoor };
+    static constexpr int kMetrics = 2;
+
+    struct Config {
+        Mode mode = Off;
+        std::array<double, kMetrics> tolerance = {0.1, 1.0}; // °C, % humidity
+    };
+
+    StorageFilter() = default;
+    explicit StorageFilter(Config config) : config(config) {}
+
+    void setConfig(Config next) { config = next; }
+    const Config& getConfig() const { return config; }
+
+    // Appends the documents to store now: none, the held reading, and/or this one.
+    void offer(uint32_t city, const Observation& obs, const nlohmann::json& data, std::vector<nlohmann::json>& toStore) {
+        if (config.mode == Off) {
+            toStore.push_back(data);
+            return;
+        }
+        if (city >= states.size()) states.resize(city + 1);
+        CityState& state = states[city];
+        std::array<double, kMetrics> values = {obs.tempC, obs.humidity};
+        if (!state.started) {
+            archive(state, obs.dt, values);
+            toStore.push_back(data);
+            return;
+        }
+        if (obs.dt <= state.archiveTime || (state.holding && obs.dt <= state.heldTime)) {
+            toStore.push_back(data); // Late: the held reading and the door stay as they are
+            return;
+        }
+        if (config.mode == Deadband) {
+            for (int m = 0; m < kMetrics; ++m) {
+                if (std::fabs(values[m] - state.archiveValues[m]) > config.tolerance[m]) {
+                    archive(state, obs.dt, values);
+                    toStore.push_back(data);
+                    return;
+                }
+            }
+            return;
+        }
+
+        // Swinging door: the held reading becomes a skipped one if the line to this reading
+        // stays within tolerance of it and of every reading skipped before it.
+        if (state.holding) {
+            std::array<double, kMetrics> upper = state.upper, lower = state.lower;
+            bool fits = true;
+            double span = static_cast<double>(obs.dt - state.archiveTime);
+            double heldSpan = static_cast<double>(state.heldTime - state.archiveTime);
+            for (int m = 0; m < kMetrics; ++m) {
+                upper[m] = std::min(upper[m], (state.heldValues[m] + config.tolerance[m] - state.archiveValues[m]) / heldSpan);
+                lower[m] = std::max(lower[m], (state.heldValues[m] - config.tolerance[m] - state.archiveValues[m]) / heldSpan);
+                double slope = (values[m] - state.archiveValues[m]) / span;
+                fits = fits && slope <= upper[m] && slope >= lower[m];
+            }
+            if (fits) {
+                state.upper = upper;
+                state.lower = lower;
+            } else {
+                toStore.push_back(std::move(state.heldDocument));
+                archive(state, state.heldTime, state.heldValues);
+            }
+        }
+        state.holding = true;
+        state.heldTime = obs.dt;
+        state.heldValues = values;
+        state.heldDocument = data;
+    }
+
+    // Releases a city's held reading, e.g. on shutdown or when the city moves to another worker.
+    void flushCity(uint32_t city, std::vector<nlohmann::json>& toStore) {
+        if (city >= states.size() || !states[city].holding) return;
+        CityState& state = states[city];
+        toStore.push_back(std::move(state.heldDocument));
+        archive(state, state.heldTime, state.heldValues);
+    }
+
+    void flushAll(std::vector<nlohmann::json>& toStore) {
+        for (uint32_t city = 0; city < states.size(); ++city) flushCity(city, toStore);
+    }
+
+private:
+    struct CityState {
+        bool started = false;
+        bool holding = false;
+        int64_t archiveTime = 0;
+        int64_t heldTime = 0;
+        std::array<double, kMetrics> archiveValues{};
+        std::array<double, kMetrics> heldValues{};
+        std::array<double, kMetrics> upper{};
+        std::array<double, kMetrics> lower{};
+        nlohmann::json heldDocument;
+    };
+
+    static void archive(CityState& state, int64_t time, const std::array<double, kMetrics>& values) {
+        state.started = true;
+        state.holding = false;
+        state.archiveTime = time;
+        state.archiveValues = values;
+        state.upper.fill(std::numeric_limits<double>::infinity());
+        state.lower.fill(-std::numeric_limits<double>::infinity());
+        state.heldDocument = nullptr;
+    }
+
+    Config config;
+    std::vector<CityState> states;
+};
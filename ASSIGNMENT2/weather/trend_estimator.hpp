@@ -0,0 +1,132 @@
+// Streaming per-city temperature trends for predicted-breach alerts.
+#pragma once
+
+#include "binary_io.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// TrendEstimator class
+// Per-city least-squares line over a sliding window of recent readings (the last hour, at most
+// kMaxSamples), kept as running sums so a reading costs O(1): it is added to the sums and the
+// readings that left the window are subtracted. Extrapolating the line predicts a breach of the
+// alert threshold before it happens. One alert is raised per approach; the city is re-armed once
+// no breach is predicted and the temperature is below the threshold.
+// Sums are recomputed from the window whenever the time origin moves, so rounding does not build up.
+class TrendEstimator {
+public:
+    static constexpr int kMaxSamples = 16;
+
+    struct Config {
+        int64_t windowSeconds = 3600;
+        int64_t horizonSeconds = 3600; // Alert when the line reaches the threshold this soon
+        double threshold = 35.0;
+        int minSamples = 4;
+        int64_t minSpanSeconds = 900; // Fit only over at least 15 minutes of readings
+    };
+
+    struct Prediction {
+        bool valid = false; // Enough readings for a fit
+        double slopePerHour = 0;
+        double predictedC = 0;       // Value of the line at dt + horizon
+        int64_t breachIn = -1;       // Seconds until the line reaches the threshold, -1 if not within the horizon
+        bool alert = false;          // First predicted breach of this approach
+    };
+
+    TrendEstimator() = default;
+    explicit TrendEstimator(Config config) : config(config) {}
+
+    void setConfig(Config config) { this->config = config; }
+    const Config& settings() const { return config; }
+    void reserve(size_t cities) { windows.reserve(cities); }
+
+    // Folds in a reading and returns the fitted trend; readings not newer than the last one are ignored.
+    Prediction update(uint32_t city, int64_t dt, double tempC) {
+        if (city >= windows.size()) windows.resize(city + 1);
+        Window& w = windows[city];
+        Prediction prediction;
+        if (w.size && dt <= w.origin + static_cast<int64_t>(w.times[newest(w)])) return prediction;
+        if (!w.size || dt - w.origin > kRebaseSeconds) rebase(w, dt);
+
+        while (w.size && (w.size == kMaxSamples || dt - w.origin - static_cast<int64_t>(w.times[w.head]) > config.windowSeconds)) {
+            double t = w.times[w.head], y = w.temps[w.head];
+            w.st -= t, w.sy -= y, w.stt -= t * t, w.sty -= t * y;
+            w.head = static_cast<uint8_t>((w.head + 1) % kMaxSamples);
+            --w.size;
+        }
+        double t = static_cast<double>(dt - w.origin), y = tempC;
+        size_t slot = (w.head + w.size) % kMaxSamples;
+        w.times[slot] = static_cast<float>(t);
+        w.temps[slot] = static_cast<float>(y);
+        ++w.size;
+        w.st += t, w.sy += y, w.stt += t * t, w.sty += t * y;
+
+        double n = w.size;
+        double denominator = n * w.stt - w.st * w.st;
+        double span = t - w.times[w.head];
+        if (w.size < config.minSamples || span < static_cast<double>(config.minSpanSeconds) || denominator <= 0) return prediction;
+        double slope = (n * w.sty - w.st * w.sy) / denominator; // °C per second
+        double intercept = (w.sy - slope * w.st) / n;
+        double fitted = intercept + slope * t;
+        prediction.valid = true;
+        prediction.slopePerHour = slope * 3600;
+        prediction.predictedC = fitted + slope * static_cast<double>(config.horizonSeconds);
+        if (tempC < config.threshold && slope > 0) {
+            double seconds = std::max(0.0, (config.threshold - fitted) / slope);
+            if (seconds <= static_cast<double>(config.horizonSeconds)) prediction.breachIn = static_cast<int64_t>(seconds);
+        }
+        if (prediction.breachIn >= 0 && !w.alerted) {
+            prediction.alert = true;
+            w.alerted = true;
+        } else if (prediction.breachIn < 0 && tempC < config.threshold) {
+            w.alerted = false;
+        }
+        return prediction;
+    }
+
+    size_t memoryBytes() const { return windows.capacity() * sizeof(Window); }
+
+    // The windows are checkpointed: replay only covers readings after the checkpoint, so it
+    // could not rebuild the samples a window held before it.
+    void save(BinaryWriter& out) const { out.podVector(windows); }
+
+    void load(BinaryReader& in) {
+        windows = in.podVector<Window>();
+        for (const auto& w : windows) {
+            if (w.head >= kMaxSamples || w.size > kMaxSamples) throw std::runtime_error("checkpoint has a corrupt trend window");
+        }
+    }
+
+private:
+    static constexpr int64_t kRebaseSeconds = 12 * 3600;
+
+    struct Window {
+        int64_t origin = 0; // Sample times are seconds after origin
+        double st = 0, sy = 0, stt = 0, sty = 0;
+        float times[kMaxSamples];
+        float temps[kMaxSamples];
+        uint8_t head = 0; // Oldest sample
+        uint8_t size = 0;
+        bool alerted = false;
+    };
+
+    static size_t newest(const Window& w) { return (w.head + w.size - 1) % kMaxSamples; }
+
+    // Moves the origin to dt and recomputes the sums from the samples in the window.
+    static void rebase(Window& w, int64_t dt) {
+        w.st = w.sy = w.stt = w.sty = 0;
+        for (int i = 0; i < w.size; ++i) {
+            size_t slot = (w.head + i) % kMaxSamples;
+            double t = static_cast<double>(w.origin - dt) + w.times[slot];
+            double y = w.temps[slot];
+            w.times[slot] = static_cast<float>(t);
+            w.st += t, w.sy += y, w.stt += t * t, w.sty += t * y;
+        }
+        w.origin = dt;
+    }
+
+    Config config;
+    std::vector<Window> windows;
+};
@@ -0,0 +1,347 @@
+// Asynchronous logging shared by the rule engine (ASSIGNMENT1) and the weather monitor (ASSIGNMENT2).
+//
+// A log call copies its format string pointer and binary-encoded arguments into a slot of a
+// lock-free multi-producer, single-consumer ring and returns; a background thread formats the
+// records and writes them out. Calls below ASYNC_LOG_MIN_LEVEL compile to nothing, and each
+// call site is rate limited (ASYNC_LOG_RATE_PER_SECOND records per second, the rest are counted
+// and reported as suppressed). When the ring is full records are dropped, never waited for.
+// LOG_ALERT is for records that are the program's output rather than diagnostics: it is never
+// compiled out, rate limited or dropped, and waits for room when the ring is full.
+//
+//     LOG_INFO("Rule {} saved", name);
+//     LOG_WARN("Fetch failed for {}: {}", city, e.what());
+//     LOG_ALERT("Alert: {} exceeds {} °C", city, threshold);
+//
+// "{}" placeholders take integers, floating point (printed like std::ostream), bools and strings.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <pthread.h>
+
+#ifndef ASYNC_LOG_MIN_LEVEL
+#define ASYNC_LOG_MIN_LEVEL 1 // 0 debug, 1 info, 2 warn, 3 error
+#endif
+
+#ifndef ASYNC_LOG_RATE_PER_SECOND
+#define ASYNC_LOG_RATE_PER_SECOND 100
+#endif
+
+// AsyncLogger class
+class AsyncLogger {
+public:
+    enum Level : uint8_t { Debug, Info, Warn, Error };
+
+    static constexpr size_t kSlots = 4096; // Power of two
+    static constexpr size_t kSlotBytes = 256;
+    static constexpr int kMaxArgs = 8;
+
+    // Per-call-site limiter: at most `perSecond` records in each wall-clock second.
+    class RateLimiter {
+    public:
+        explicit RateLimiter(uint32_t perSecond) : perSecond(perSecond) {}
+
+        bool allow(const char* file, int line) {
+            timespec now;
+            clock_gettime(CLOCK_REALTIME_COARSE, &now); // Only the second matters; the coarse clock is cheaper
+            int64_t second = now.tv_sec;
+            int64_t window = currentSecond.load(std::memory_order_relaxed);
+            if (second != window && currentSecond.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+                count.store(0, std::memory_order_relaxed);
+                uint64_t dropped = suppressed.exchange(0, std::memory_order_relaxed);
+                if (dropped) AsyncLogger::instance().log(Warn, "{} similar messages suppressed at {}:{}", dropped, file, line);
+            }
+            if (count.fetch_add(1, std::memory_order_relaxed) < perSecond) return true;
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+    private:
+        uint32_t perSecond;
+        std::atomic<int64_t> currentSecond{0};
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint64_t> suppressed{0};
+    };
+
+    static AsyncLogger& instance() {
+        static AsyncLogger logger;
+        return logger;
+    }
+
+    // Encodes the record into the ring; returns false if it was dropped because the ring is full.
+    template <class... Args>
+    bool log(Level level, const char* format, const Args&... args) {
+        return append<false>(level, format, args...);
+    }
+
+    // Like log(), but waits for the consumer to free a slot instead of dropping the record.
+    template <class... Args>
+    void logReliably(Level level, const char* format, const Args&... args) {
+        append<true>(level, format, args...);
+    }
+
+    // Blocks until every record logged before the call has been written.
+    void flush() {
+        uint64_t target = tail.load(std::memory_order_acquire);
+        while (written.load(std::memory_order_acquire) < target) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    // Redirects output; info and debug go to `out`, warnings and errors to `err`.
+    void setOutput(std::FILE* out, std::FILE* err) {
+        flush();
+        this->out.store(out, std::memory_order_release);
+        this->err.store(err, std::memory_order_release);
+    }
+
+    uint64_t droppedRecords() const { return dropped.load(std::memory_order_relaxed); }
+
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // Drains what is left at exit.
+    ~AsyncLogger() {
+        stopping.store(true, std::memory_order_release);
+        while (!finished.load(std::memory_order_acquire)) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+private:
+    enum ArgType : uint8_t { Int, Uint, Double, Bool, String };
+
+    struct Header {
+        int64_t timeNs;
+        const char* format;
+        Level level;
+        uint8_t argc;
+        uint16_t size;
+        ArgType types[kMaxArgs];
+    };
+
+    struct Record : Header {
+        char payload[kSlotBytes - sizeof(Header) - 16];
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence{0};
+        Record record;
+    };
+
+    // The consumer is detached so a forked child (checkpoints, shard workers) can start its own.
+    AsyncLogger() {
+        for (size_t i = 0; i < kSlots; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+        std::thread([this] { run(); }).detach();
+        pthread_atfork(nullptr, nullptr, [] {
+            AsyncLogger& logger = instance();
+            logger.finished.store(false, std::memory_order_relaxed);
+            std::thread([&logger] { logger.run(); }).detach();
+        });
+    }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    template <bool Wait, class... Args>
+    bool append(Level level, const char* format, const Args&... args) {
+        static_assert(sizeof...(Args) <= kMaxArgs, "too many log arguments");
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &slots[pos & (kSlots - 1)];
+            int64_t diff = static_cast<int64_t>(slot->sequence.load(std::memory_order_acquire)) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                if constexpr (!Wait) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                std::this_thread::yield(); // Full: the consumer frees the slot once it has written it
+                pos = tail.load(std::memory_order_relaxed);
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        Record& record = slot->record;
+        record.timeNs = nowNs();
+        record.format = format;
+        record.level = level;
+        record.argc = 0;
+        record.size = 0;
+        (encode(record, args), ...);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    static void put(Record& record, ArgType type, const void* data, size_t size) {
+        if (record.size + size > sizeof(record.payload)) return; // Out of room; the placeholder stays empty
+        record.types[record.argc++] = type;
+        std::memcpy(record.payload + record.size, data, size);
+        record.size = static_cast<uint16_t>(record.size + size);
+    }
+
+    template <class T>
+    static void encode(Record& record, const T& value) {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, bool>) {
+            put(record, Bool, &value, 1);
+        } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+            int64_t v = value;
+            put(record, Int, &v, sizeof(v));
+        } else if constexpr (std::is_integral_v<U>) {
+            uint64_t v = value;
+            put(record, Uint, &v, sizeof(v));
+        } else if constexpr (std::is_floating_point_v<U>) {
+            double v = value;
+            put(record, Double, &v, sizeof(v));
+        } else {
+            static_assert(std::is_convertible_v<const T&, std::string_view>, "unsupported log argument type");
+            std::string_view text = value;
+            size_t room = sizeof(record.payload) - record.size;
+            if (room < sizeof(uint16_t)) return;
+            uint16_t length = static_cast<uint16_t>(std::min(text.size(), room - sizeof(uint16_t)));
+            char buffer[sizeof(record.payload)];
+            std::memcpy(buffer, &length, sizeof(length));
+            std::memcpy(buffer + sizeof(length), text.data(), length);
+            put(record, String, buffer, sizeof(length) + length);
+        }
+    }
+
+    void format(const Record& record, std::string& line) {
+        static const char* names[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+        std::time_t seconds = static_cast<std::time_t>(record.timeNs / 1000000000);
+        if (seconds != cachedSecond) {
+            std::tm local{};
+            localtime_r(&seconds, &local);
+            std::strftime(cachedTime, sizeof(cachedTime), "%Y-%m-%d %H:%M:%S", &local);
+            cachedSecond = seconds;
+        }
+        char prefix[64];
+        std::snprintf(prefix, sizeof(prefix), "%s.%03d %s ", cachedTime, static_cast<int>(record.timeNs / 1000000 % 1000),
+                      names[record.level]);
+        line = prefix;
+
+        const char* offset = record.payload;
+        int arg = 0;
+        for (const char* p = record.format; *p; ++p) {
+            if (p[0] != '{' || p[1] != '}') {
+                line += *p;
+                continue;
+            }
+            ++p;
+            if (arg >= record.argc) continue;
+            char number[32];
+            switch (record.types[arg++]) {
+            case Int: {
+                int64_t v;
+                std::memcpy(&v, offset, sizeof(v));
+                offset += sizeof(v);
+                line += std::to_string(v);
+                break;
+            }
+            case Uint: {
+                uint64_t v;
+                std::memcpy(&v, offset, sizeof(v));
+                offset += sizeof(v);
+                line += std::to_string(v);
+                break;
+            }
+            case Double: {
+                double v;
+                std::memcpy(&v, offset, sizeof(v));
+                offset += sizeof(v);
+                std::snprintf(number, sizeof(number), "%g", v);
+                line += number;
+                break;
+            }
+            case Bool:
+                line += *offset++ ? "true" : "false";
+                break;
+            case String: {
+                uint16_t length;
+                std::memcpy(&length, offset, sizeof(length));
+                line.append(offset + sizeof(length), length);
+                offset += sizeof(length) + length;
+                break;
+            }
+            }
+        }
+        line += '\n';
+    }
+
+    // Consumer loop: drains published slots in order, then sleeps briefly when idle.
+    void run() {
+        std::string line;
+        uint64_t reportedDrops = 0;
+        for (;;) {
+            bool wrote = false;
+            for (;;) {
+                Slot& slot = slots[head & (kSlots - 1)];
+                if (slot.sequence.load(std::memory_order_acquire) != head + 1) break;
+                format(slot.record, line);
+                std::FILE* target = slot.record.level >= Warn ? err.load(std::memory_order_acquire)
+                                                              : out.load(std::memory_order_acquire);
+                std::fwrite(line.data(), 1, line.size(), target);
+                slot.sequence.store(head + kSlots, std::memory_order_release);
+                ++head;
+                written.store(head, std::memory_order_release);
+                wrote = true;
+            }
+            uint64_t drops = dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops) {
+                std::fprintf(err.load(std::memory_order_acquire), "logger: %llu records dropped (ring full)\n",
+                             static_cast<unsigned long long>(drops - reportedDrops));
+                reportedDrops = drops;
+                wrote = true;
+            }
+            if (wrote) {
+                std::fflush(out.load(std::memory_order_acquire));
+                std::fflush(err.load(std::memory_order_acquire));
+                continue;
+            }
+            if (stopping.load(std::memory_order_acquire) && written.load() == tail.load()) {
+                finished.store(true, std::memory_order_release);
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    Slot slots[kSlots];
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<std::FILE*> out{stdout};
+    std::atomic<std::FILE*> err{stderr};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> finished{false};
+    uint64_t head = 0; // Consumer only
+    std::time_t cachedSecond = -1;
+    char cachedTime[32] = {};
+};
+
+// Levels below ASYNC_LOG_MIN_LEVEL are discarded at compile time; arguments are not evaluated.
+#define ASYNC_LOG_AT(level, ...)                                                                    \
+    do {                                                                                            \
+        if constexpr (AsyncLogger::level >= ASYNC_LOG_MIN_LEVEL) {                                  \
+            static AsyncLogger::RateLimiter asyncLogLimiter(ASYNC_LOG_RATE_PER_SECOND);             \
+            if (asyncLogLimiter.allow(__FILE__, __LINE__)) AsyncLogger::instance().log(AsyncLogger::level, __VA_ARGS__); \
+        }                                                                                           \
+    } while (0)
+
+#define LOG_DEBUG(...) ASYNC_LOG_AT(Debug, __VA_ARGS__)
+#define LOG_INFO(...) ASYNC_LOG_AT(Info, __VA_ARGS__)
+#define LOG_WARN(...) ASYNC_LOG_AT(Warn, __VA_ARGS__)
+#define LOG_ERROR(...) ASYNC_LOG_AT(Error, __VA_ARGS__)
+
+// Written at warning level, whatever ASYNC_LOG_MIN_LEVEL is, without rate limit or drops.
+#define LOG_ALERT(...) AsyncLogger::instance().logReliably(AsyncLogger::Warn, __VA_ARGS__)